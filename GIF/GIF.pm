@@ -4,7 +4,7 @@ use Imager;
 use vars qw($VERSION @ISA);
 
 BEGIN {
-  $VERSION = "0.88";
+  $VERSION = "0.89";
 
   require XSLoader;
   XSLoader::load('Imager::File::GIF', $VERSION);
@@ -54,6 +54,18 @@ Imager->register_reader
        return;
      }
 
+     return map bless({ IMG => $_, ERRSTR => undef }, "Imager"), @imgs;
+   },
+   pages =>
+   sub {
+     my ($io, $pages, %hsh) = @_;
+
+     my @imgs = i_readgif_multi_pages_wiol($io, @$pages);
+     unless (@imgs) {
+       Imager->_set_error(Imager->_error_as_msg);
+       return;
+     }
+
      return map bless({ IMG => $_, ERRSTR => undef }, "Imager"), @imgs;
    },
   );
@@ -80,6 +92,11 @@ Imager->register_writer
 
      Imager->_set_opts($opts, "gif_", @ims);
 
+     if ($opts->{gif_optimize} && @ims > 1) {
+       @ims = _optimize_frames($opts, @ims)
+	 or return;
+     }
+
      my @work = map $_->{IMG}, @ims;
      unless (i_writegif_wiol($io, $opts, @work)) {
        Imager->_set_error(Imager->_error_as_msg);
@@ -90,6 +107,71 @@ Imager->register_writer
    },
   );
 
+# replace each frame after the first with the rectangle that changed
+# since the frame before it
+sub _optimize_frames {
+  my ($opts, @ims) = @_;
+
+  my @out = $ims[0];
+  for my $index (1 .. $#ims) {
+    my $frame = _frame_change($opts, $ims[$index-1], $ims[$index])
+      or return;
+    push @out, $frame;
+  }
+
+  # make the unchanged pixels transparent
+  $opts->{transp} ||= "threshold"
+    if $opts->{gif_optimize_transp};
+
+  return @out;
+}
+
+sub _frame_change {
+  my ($opts, $prev, $im) = @_;
+
+  # the screen after $prev is only the same as $prev if $prev covers
+  # the whole screen, has no transparency and isn't disposed of
+  for my $check ($prev, $im) {
+    my $channels = $check->getchannels;
+    return $im
+      if $channels == 2 || $channels == 4
+	|| $check->tags(name => "gif_left")
+	  || $check->tags(name => "gif_top");
+  }
+  my $disposal = $prev->tags(name => "gif_disposal") || 0;
+  return $im
+    if $disposal > 1
+      || $prev->getwidth != $im->getwidth
+	|| $prev->getheight != $im->getheight
+	  || $prev->getchannels != $im->getchannels;
+
+  my ($left, $top, $right, $bottom) = $prev->difference_bounds(other => $im)
+    or return Imager->_set_error($prev->errstr);
+  if ($right == $left) {
+    # nothing changed, but keep a pixel to hold the delay
+    ($right, $bottom) = ($left + 1, $top + 1);
+  }
+
+  my $src = $opts->{gif_optimize_transp}
+    ? $prev->difference(other => $im) : $im;
+  $src
+    or return Imager->_set_error($prev->errstr);
+  my $frame = $src->crop(left => $left, top => $top,
+			 right => $right, bottom => $bottom)
+    or return Imager->_set_error($src->errstr);
+
+  for my $tag ($im->tags) {
+    my ($name, $value) = @$tag;
+    $frame->addtag(name => $name, value => $value);
+  }
+  $frame->settag(name => "gif_left", value => $left);
+  $frame->settag(name => "gif_top", value => $top);
+
+  return $frame;
+}
+
+1;
+
 __END__
 
 =head1 NAME
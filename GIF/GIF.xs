@@ -34,7 +34,7 @@ i_writegif_wiol(ig, opts,...)
 	    croak("i_writegif_callback: Second argument must be a hash ref");
 	hv = (HV *)SvRV(ST(1));
 	memset(&quant, 0, sizeof(quant));
-	quant.version = 1;
+	quant.version = 2;
 	quant.mc_size = 256;
 	quant.transp = tr_threshold;
 	quant.tr_threshold = 127;
@@ -144,6 +144,32 @@ i_readgif_multi_wiol(ig)
         }
 
 
+void
+i_readgif_multi_pages_wiol(ig, ...)
+        Imager::IO ig
+      PREINIT:
+        i_img **imgs;
+        int *pages;
+        int page_count = items - 1;
+        int count;
+        int i;
+      PPCODE:
+        pages = mymalloc(sizeof(int) * (page_count ? page_count : 1));
+        for (i = 0; i < page_count; ++i)
+          pages[i] = SvIV(ST(i + 1));
+        imgs = i_readgif_multi_pages_wiol(ig, pages, page_count, &count);
+        myfree(pages);
+        if (imgs) {
+          EXTEND(SP, count);
+          for (i = 0; i < count; ++i) {
+            SV *sv = sv_newmortal();
+            sv_setref_pv(sv, "Imager::ImgRaw", (void *)imgs[i]);
+            PUSHs(sv);
+          }
+          myfree(imgs);
+        }
+
+
 BOOT:
 	PERL_INITIALIZE_IMAGER_CALLBACKS;
 	PERL_INITIALIZE_IMAGER_PERL_CALLBACKS;
@@ -414,15 +414,18 @@ free_images(i_img **imgs, int count) {
 }
 
 /*
-=item i_readgif_multi_low(GifFileType *gf, int *count, int page)
+=item i_readgif_multi_low(GifFileType *gf, int *count, const int *pages, int page_count)
 
 Reads one of more gif images from the given GIF file.
 
 Returns a pointer to an array of i_img *, and puts the count into 
 *count.
 
-If page is not -1 then the given image _only_ is returned from the
-file, where the first image is 0, the second 1 and so on.
+If pages is not NULL then only the page_count images listed in pages,
+which must be in ascending order, are returned from the file, where
+the first image is 0, the second 1 and so on.  The compressed data of
+the other images is skipped without being decoded, and the file isn't
+read past the last page wanted.
 
 Unlike the normal i_readgif*() functions the images are paletted
 images rather than a combined RGB image.
@@ -497,10 +500,13 @@ standard.
 =cut
 */
 
-i_img **
-i_readgif_multi_low(GifFileType *GifFile, int *count, int page) {
+static i_img **
+i_readgif_multi_low(GifFileType *GifFile, int *count, const int *pages,
+		    int page_count) {
   i_img *img;
-  int i, j, Size, Width, Height, ExtCode, Count;
+  int i, j, Size, Width, Height, ExtCode, Count, CodeSize;
+  GifByteType *CodeBlock;
+  int next_page = 0; /* index in pages of the next page wanted */
   int ImageNum = 0, ColorMapSize = 0;
   ColorMapObject *ColorMap;
  
@@ -561,7 +567,7 @@ i_readgif_multi_low(GifFileType *GifFile, int *count, int page) {
 
       Width = GifFile->Image.Width;
       Height = GifFile->Image.Height;
-      if (page == -1 || page == ImageNum) {
+      if (!pages || pages[next_page] == ImageNum) {
 	if (( ColorMap = (GifFile->Image.ColorMap ? GifFile->Image.ColorMap : GifFile->SColorMap) )) {
 	  mm_log((1, "Adding local colormap\n"));
 	  ColorMapSize = ColorMap->ColorCount;
@@ -737,8 +743,8 @@ i_readgif_multi_low(GifFileType *GifFile, int *count, int page) {
 	  }
 	}
 
-	/* must be only one image wanted and that was it */
-	if (page != -1) {
+	/* that was the last page wanted, don't read any further */
+	if (pages && ++next_page == page_count) {
 	  myfree(GifRow);
 	  DGifCloseFile(GifFile);
 	  if (comment)
@@ -747,13 +753,22 @@ i_readgif_multi_low(GifFileType *GifFile, int *count, int page) {
 	}
       }
       else {
-	/* skip the image */
-	/* whether interlaced or not, it has the same number of lines */
-	/* giflib does't have an interface to skip the image data */
-	for (i = 0; i < Height; i++) {
-	  if (DGifGetLine(GifFile, GifRow, Width) == GIF_ERROR) {
+	/* skip the image, reading the LZW compressed blocks without
+	   decompressing them */
+	if (DGifGetCode(GifFile, &CodeSize, &CodeBlock) == GIF_ERROR) {
+	  gif_push_error(myGifError(GifFile));
+	  i_push_error(0, "Skipping GIF image data");
+	  free_images(results, *count);
+	  myfree(GifRow);
+	  DGifCloseFile(GifFile);
+	  if (comment) 
+	    myfree(comment);
+	  return NULL;
+	}
+	while (CodeBlock) {
+	  if (DGifGetCodeNext(GifFile, &CodeBlock) == GIF_ERROR) {
 	    gif_push_error(myGifError(GifFile));
-	    i_push_error(0, "Reading GIF line");
+	    i_push_error(0, "Skipping GIF image data");
 	    free_images(results, *count);
 	    myfree(GifRow);
 	    DGifCloseFile(GifFile);
@@ -763,6 +778,9 @@ i_readgif_multi_low(GifFileType *GifFile, int *count, int page) {
 	  }
 	}
 
+	/* the graphic control extension belonged to the skipped image */
+	got_gce = 0;
+
 	/* kill the comment so we get the right comment for the page */
 	if (comment) {
 	  myfree(comment);
@@ -864,9 +882,10 @@ i_readgif_multi_low(GifFileType *GifFile, int *count, int page) {
     return NULL;
   }
 
-  if (ImageNum && page != -1) {
-    /* there were images, but the page selected wasn't found */
-    i_push_errorf(0, "page %d not found (%d total)", page, ImageNum);
+  if (ImageNum && pages) {
+    /* there were images, but a page selected wasn't found */
+    i_push_errorf(0, "page %d not found (%d total)", pages[next_page],
+		  ImageNum);
     free_images(results, *count);
     return NULL;
   }
@@ -900,7 +919,63 @@ i_readgif_multi_wiol(io_glue *ig, int *count) {
     return NULL;
   }
     
-  result = i_readgif_multi_low(GifFile, count, -1);
+  result = i_readgif_multi_low(GifFile, count, NULL, 0);
+
+  gif_mutex_unlock(mutex);
+
+  return result;
+}
+
+/*
+=item i_readgif_multi_pages_wiol(ig, pages, page_count, count)
+
+Read the I<page_count> pages listed in I<pages> from a GIF file, where
+the pages are indexed from 0 and must be in ascending order.
+
+The image data of the other pages is skipped without being decoded,
+so this is much faster than reading every page when only a few are
+wanted.
+
+Returns NULL if any page isn't found.
+
+=cut
+*/
+
+i_img **
+i_readgif_multi_pages_wiol(io_glue *ig, const int *pages, int page_count,
+			   int *count) {
+  GifFileType *GifFile;
+  int gif_error;
+  i_img **result;
+  int i;
+
+  i_clear_error();
+  if (page_count < 1) {
+    i_push_error(0, "no pages selected");
+    return NULL;
+  }
+  for (i = 0; i < page_count; ++i) {
+    if (pages[i] < 0) {
+      i_push_error(0, "page must be non-negative");
+      return NULL;
+    }
+    if (i && pages[i] <= pages[i-1]) {
+      i_push_error(0, "pages must be in ascending order");
+      return NULL;
+    }
+  }
+
+  gif_mutex_lock(mutex);
+
+  if ((GifFile = myDGifOpen((void *)ig, io_glue_read_cb, &gif_error )) == NULL) {
+    gif_push_error(gif_error);
+    i_push_error(0, "Cannot create giflib callback object");
+    mm_log((1,"i_readgif_multi_pages_wiol: Unable to open callback datasource.\n"));
+    gif_mutex_unlock(mutex);
+    return NULL;
+  }
+    
+  result = i_readgif_multi_low(GifFile, count, pages, page_count);
 
   gif_mutex_unlock(mutex);
 
@@ -953,7 +1028,7 @@ i_readgif_single_low(GifFileType *GifFile, int page) {
   int count = 0;
   i_img **imgs;
 
-  imgs = i_readgif_multi_low(GifFile, &count, page);
+  imgs = i_readgif_multi_low(GifFile, &count, &page, 1);
 
   if (imgs && count) {
     i_img *result = imgs[0];
@@ -1402,6 +1477,59 @@ quant_paletted(i_quantize *quant, i_img *img) {
   return data;
 }
 
+/*
+=item translate_global(quant, imgs, count, localmaps, imgn, pending)
+
+Translate frame I<imgn> and the frames after it that use the global
+color map, up to one per thread, so they can be translated
+concurrently, storing the indexes in I<pending>.
+
+Returns non-zero on success.
+
+=cut
+*/
+
+static int
+translate_global(i_quantize *quant, i_img **imgs, int count, int *localmaps,
+		 int imgn, i_palidx **pending) {
+  int batch = im_context_get_threads(imgs[imgn]->context);
+  i_img **work = mymalloc(sizeof(i_img *) * batch);
+  i_palidx **results = mymalloc(sizeof(i_palidx *) * batch);
+  int *index = mymalloc(sizeof(int) * batch);
+  int n = 0, i, ok;
+
+  for (i = imgn; i < count && n < batch; ++i) {
+    if (!localmaps[i]) {
+      work[n] = imgs[i];
+      index[n] = i;
+      ++n;
+    }
+  }
+
+  ok = i_quant_translate_multi(quant, work, n, results);
+  if (ok) {
+    for (i = 0; i < n; ++i)
+      pending[index[i]] = results[i];
+  }
+
+  myfree(index);
+  myfree(results);
+  myfree(work);
+
+  return ok;
+}
+
+static void
+free_pending(i_palidx **pending, int count) {
+  int i;
+
+  for (i = 0; i < count; ++i) {
+    if (pending[i])
+      myfree(pending[i]);
+  }
+  myfree(pending);
+}
+
 /*
 =item i_writegif_low(i_quantize *quant, GifFileType *gf, i_img **imgs, int count, i_gif_opts *opts)
 
@@ -1435,6 +1563,7 @@ i_writegif_low(i_quantize *quant, GifFileType *gf, i_img **imgs, int count) {
   int want_trans = 0;
   int interlace;
   int gif_background;
+  i_palidx **pending; /* frames translated ahead of being written */
 
   mm_log((1, "i_writegif_low(quant %p, gf  %p, imgs %p, count %d)\n", 
 	  quant, gf, imgs, count));
@@ -1699,6 +1828,8 @@ i_writegif_low(i_quantize *quant, GifFileType *gf, i_img **imgs, int count) {
   myfree(result);
 
   /* that first awful image is out of the way, do the rest */
+  pending = mymalloc(sizeof(i_palidx *) * count);
+  memset(pending, 0, sizeof(i_palidx *) * count);
   for (imgn = 1; imgn < count; ++imgn) {
     if (localmaps[imgn]) {
       quant->mc_colors = orig_colors;
@@ -1726,6 +1857,7 @@ i_writegif_low(i_quantize *quant, GifFileType *gf, i_img **imgs, int count) {
 	myfree(glob_colors);
 	myfree(localmaps);
 	myfree(glob_imgs);
+        free_pending(pending, count);
         quant->mc_colors = orig_colors;
         EGifCloseFile(gf);
         mm_log((1, "error in i_quant_translate()"));
@@ -1740,6 +1872,7 @@ i_writegif_low(i_quantize *quant, GifFileType *gf, i_img **imgs, int count) {
 	myfree(glob_colors);
 	myfree(localmaps);
 	myfree(glob_imgs);
+        free_pending(pending, count);
         quant->mc_colors = orig_colors;
         myfree(result);
         EGifCloseFile(gf);
@@ -1752,8 +1885,21 @@ i_writegif_low(i_quantize *quant, GifFileType *gf, i_img **imgs, int count) {
       quant->mc_count = glob_color_count;
       if (glob_paletted)
         result = quant_paletted(quant, imgs[imgn]);
-      else
-        result = i_quant_translate(quant, imgs[imgn]);
+      else {
+        if (!pending[imgn]
+            && !translate_global(quant, imgs, count, localmaps, imgn,
+                                 pending)) {
+          myfree(glob_colors);
+          myfree(localmaps);
+          myfree(glob_imgs);
+          free_pending(pending, count);
+          quant->mc_colors = orig_colors;
+          EGifCloseFile(gf);
+          return 0;
+        }
+        result = pending[imgn];
+        pending[imgn] = NULL;
+      }
       want_trans = glob_want_trans && imgs[imgn]->channels == 4;
       if (want_trans) {
         i_quant_transparent(quant, result, imgs[imgn], quant->mc_count);
@@ -1766,6 +1912,7 @@ i_writegif_low(i_quantize *quant, GifFileType *gf, i_img **imgs, int count) {
       myfree(glob_colors);
       myfree(localmaps);
       myfree(glob_imgs);
+      free_pending(pending, count);
       quant->mc_colors = orig_colors;
       myfree(result);
       EGifCloseFile(gf);
@@ -1776,6 +1923,7 @@ i_writegif_low(i_quantize *quant, GifFileType *gf, i_img **imgs, int count) {
       myfree(glob_colors);
       myfree(localmaps);
       myfree(glob_imgs);
+      free_pending(pending, count);
       quant->mc_colors = orig_colors;
       myfree(result);
       EGifCloseFile(gf);
@@ -1794,6 +1942,7 @@ i_writegif_low(i_quantize *quant, GifFileType *gf, i_img **imgs, int count) {
       myfree(glob_colors);
       myfree(localmaps);
       myfree(glob_imgs);
+      free_pending(pending, count);
       quant->mc_colors = orig_colors;
       gif_push_error(myGifError(gf));
       i_push_error(0, "Could not save image descriptor");
@@ -1811,6 +1960,7 @@ i_writegif_low(i_quantize *quant, GifFileType *gf, i_img **imgs, int count) {
       myfree(glob_colors);
       myfree(localmaps);
       myfree(glob_imgs);
+      free_pending(pending, count);
       quant->mc_colors = orig_colors;
       EGifCloseFile(gf);
       myfree(result);
@@ -1823,6 +1973,7 @@ i_writegif_low(i_quantize *quant, GifFileType *gf, i_img **imgs, int count) {
     myfree(glob_colors);
     myfree(localmaps);
     myfree(glob_imgs);
+    free_pending(pending, count);
     gif_push_error(myGifError(gf));
     i_push_error(0, "Could not close GIF file");
     mm_log((1, "Error in EGifCloseFile\n"));
@@ -1834,6 +1985,7 @@ i_writegif_low(i_quantize *quant, GifFileType *gf, i_img **imgs, int count) {
       orig_colors[i] = glob_colors[i];
   }
 
+  free_pending(pending, count);
   myfree(glob_colors);
   myfree(localmaps);
   myfree(glob_imgs);
@@ -8,6 +8,8 @@ double i_giflib_version(void);
 i_img *i_readgif_wiol(io_glue *ig, int **colour_table, int *colours);
 i_img *i_readgif_single_wiol(io_glue *ig, int page);
 extern i_img **i_readgif_multi_wiol(io_glue *ig, int *count);
+extern i_img **i_readgif_multi_pages_wiol(io_glue *ig, const int *pages,
+					  int page_count, int *count);
 undef_int i_writegif_wiol(io_glue *ig, i_quantize *quant, 
                           i_img **imgs, int count);
 
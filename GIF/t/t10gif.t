@@ -24,7 +24,7 @@ $SIG{__DIE__} = sub { confess @_ };
 
 init_log("testout/t105gif.log",1);
 
-plan tests => 146;
+plan tests => 154;
 
 my $green=i_color_new(0,255,0,255);
 my $blue=i_color_new(0,0,255,255);
@@ -622,6 +622,18 @@ ok(!$ooim->write(file=>"testout/t105nocolors.gif",
     ok(!$res->read(file=>$test_file, page=>3), "fail reading fourth page");
   cmp_ok($res->errstr, "=~", 'page 3 not found',
 	 "check error message");
+
+  # several pages in one pass
+  my @pages = Imager->read_multi(file => $test_file, pages => [ 2, 0 ]);
+  is(@pages, 2, "read pages 0 and 2");
+  is(i_img_diff($im1->{IMG}, $pages[0]{IMG}), 0, "compare against first");
+  is($pages[0]->tags(name=>'gif_comment'), 'First page', "gif_comment");
+  is(i_img_diff($im3->{IMG}, $pages[1]{IMG}), 0, "compare against third");
+  is($pages[1]->tags(name=>'gif_left'), 35, "gif_left");
+  is($pages[1]->tags(name=>'gif_comment'), undef, 'gif_comment undef');
+  ok(!Imager->read_multi(file => $test_file, pages => [ 1, 3 ]),
+     "fail reading pages 1 and 3");
+  is(Imager->errstr, "page 3 not found (3 total)", "check error message");
 }
 SKIP:
 {
@@ -0,0 +1,90 @@
+#!perl -w
+use strict;
+use Imager;
+use Test::More tests => 20;
+
+-d "testout" or mkdir "testout";
+
+Imager->open_log(log => "testout/t60optimize.log");
+
+# mostly static frames, a small box moving over a fixed background
+my $base = Imager->new(xsize => 200, ysize => 150);
+$base->box(filled => 1, color => "#4080C0");
+$base->box(filled => 1, color => "#FFFF00", xmin => 20, ymin => 20,
+	   xmax => 179, ymax => 129);
+my @frames;
+for my $i (0 .. 5) {
+  my $frame = $base->copy;
+  $frame->box(filled => 1, color => "#FF0000", xmin => 10 + 20 * $i,
+	      ymin => 30, xmax => 25 + 20 * $i, ymax => 45);
+  $frame->settag(name => "gif_delay", value => 10 + $i);
+  push @frames, $frame;
+}
+push @frames, $frames[-1]->copy; # an unchanged frame
+
+{
+  ok(Imager->write_multi({ data => \my $plain, type => "gif" }, @frames),
+     "write without optimization")
+    or diag(Imager->errstr);
+  ok(Imager->write_multi({ data => \my $data, type => "gif",
+			   gif_optimize => 1 }, @frames),
+     "write optimized")
+    or diag(Imager->errstr);
+  cmp_ok(length $data, "<", length($plain) / 2, "much smaller");
+
+  my @read = Imager->read_multi(data => $data, type => "gif");
+  is(@read, @frames, "same number of frames");
+  is($read[0]->getwidth, 200, "first frame is full width");
+  is($read[1]->getwidth, 36, "second frame is cropped");
+  is($read[1]->getheight, 16, "second frame height");
+  is($read[1]->tags(name => "gif_left"), 10, "check left");
+  is($read[1]->tags(name => "gif_top"), 30, "check top");
+  is($read[1]->tags(name => "gif_delay"), 11, "tags are kept");
+  is($read[6]->getwidth, 1, "unchanged frame is a single pixel");
+  is($read[6]->tags(name => "gif_delay"), undef, "copy() doesn't keep tags");
+
+  my $screen = $read[0]->convert(preset => "noalpha");
+  my $bad = 0;
+  for my $i (1 .. $#read) {
+    $screen->paste(src => $read[$i], left => $read[$i]->tags(name => "gif_left"),
+		   top => $read[$i]->tags(name => "gif_top"));
+    ++$bad if Imager::i_img_diff($screen->{IMG}, $frames[$i]{IMG});
+  }
+  is($bad, 0, "frames combine to the originals");
+}
+
+{
+  ok(Imager->write_multi({ data => \my $data, type => "gif",
+			   gif_optimize => 1, gif_optimize_transp => 1 },
+			 @frames),
+     "write optimized with transparency")
+    or diag(Imager->errstr);
+  my @read = Imager->read_multi(data => $data, type => "gif");
+  is(@read, @frames, "same number of frames");
+  is($read[1]->getchannels, 4, "later frames are transparent");
+  my $screen = $read[0]->convert(preset => "noalpha");
+  my $bad = 0;
+  for my $i (1 .. $#read) {
+    $screen->rubthrough(src => $read[$i], tx => $read[$i]->tags(name => "gif_left"),
+			ty => $read[$i]->tags(name => "gif_top"));
+    ++$bad if Imager::i_img_diff($screen->{IMG}, $frames[$i]{IMG});
+  }
+  is($bad, 0, "transparent frames combine to the originals");
+}
+
+{ # frames that can't be compared are written in full
+  my @mixed = ($frames[0], $frames[1]->convert(preset => "addalpha"),
+	       $frames[2]);
+  ok(Imager->write_multi({ data => \my $data, type => "gif",
+			   gif_optimize => 1 }, @mixed),
+     "write frames with alpha");
+  my @read = Imager->read_multi(data => $data, type => "gif");
+  is($read[1]->getwidth, 200, "frame with alpha isn't cropped");
+  is($read[2]->getwidth, 200, "nor the frame after it");
+}
+
+Imager->close_log;
+
+unless ($ENV{IMAGER_KEEP_FILES}) {
+  unlink "testout/t60optimize.log";
+}
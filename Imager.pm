@@ -45,11 +45,14 @@ use Config;
 		i_rubthru
 		i_scaleaxis
 		i_scale_nn
+		i_scale_kernel
 		i_haar
 		i_count_colors
 
 		i_gaussian
+		i_gaussian2
 		i_conv
+		i_conv2d
 
 		i_convert
 		i_map
@@ -234,6 +237,20 @@ BEGIN {
      }
     };
 
+  $filters{conv2d} =
+    {
+     callseq => ['image', 'coef'],
+     defaults => { },
+     callsub =>
+     sub {
+       my %hsh=@_;
+       ref $hsh{coef} && ref $hsh{coef} eq "ARRAY"
+         or die "coef must be an array of arrays\n";
+       i_conv2d($hsh{image},$hsh{coef})
+	 or die Imager->_error_as_msg() . "\n";
+     }
+    };
+
   $filters{gradgen} =
     {
      callseq => ['image', 'xo', 'yo', 'colors', 'dist'],
@@ -268,11 +285,23 @@ BEGIN {
          or die Imager->_error_as_msg() . "\n";
      },
     };
-  $filters{gaussian} = {
-                        callseq => [ 'image', 'stddev' ],
-                        defaults => { },
-                        callsub => sub { my %hsh = @_; i_gaussian($hsh{image}, $hsh{stddev}); },
-                       };
+  $filters{gaussian} =
+    {
+     callseq => [ qw(image stddev method iir_threshold) ],
+     defaults => { method => 0, iir_threshold => 8 },
+     names => {
+               method => { auto => 0, fir => 1, iir => 2 },
+              },
+     callsub =>
+     sub {
+       my %hsh = @_;
+       $hsh{method} =~ /^[012]$/
+         or die "method must be one of auto, fir or iir\n";
+       i_gaussian2($hsh{image}, $hsh{stddev}, $hsh{method},
+                   $hsh{iir_threshold})
+         or die Imager->_error_as_msg() . "\n";
+     },
+    };
   $filters{mosaic} =
     {
      callseq => [ qw(image size) ],
@@ -897,7 +926,8 @@ sub _sametype {
 sub img_set {
   my $self=shift;
 
-  my %hsh=(xsize=>100, ysize=>100, channels=>3, bits=>8, type=>'direct', @_);
+  my %hsh=(xsize=>100, ysize=>100, channels=>3, bits=>8, type=>'direct',
+           storage => 'memory', @_);
 
   if (defined($self->{IMG})) {
     # let IIM_DESTROY destroy it, it's possible this image is
@@ -906,7 +936,21 @@ sub img_set {
     undef($self->{IMG});
   }
 
-  if ($hsh{type} eq 'paletted' || $hsh{type} eq 'pseudo') {
+  if ($hsh{storage} eq 'mmap') {
+    if ($hsh{type} eq 'paletted' || $hsh{type} eq 'pseudo') {
+      $self->{ERRSTR} = "mmap storage is only available for direct images";
+      return;
+    }
+    my $bits = $hsh{bits} eq 'double' ? $Config{doublesize} * 8
+      : $hsh{bits} == 16 ? 16 : 8;
+    $self->{IMG} = i_img_mmap_new($hsh{xsize}, $hsh{ysize}, $hsh{channels},
+                                  $bits, $hsh{storage_file});
+  }
+  elsif ($hsh{storage} ne 'memory') {
+    $self->{ERRSTR} = "storage must be 'memory' or 'mmap'";
+    return;
+  }
+  elsif ($hsh{type} eq 'paletted' || $hsh{type} eq 'pseudo') {
     $self->{IMG} = i_img_pal_new($hsh{xsize}, $hsh{ysize}, $hsh{channels},
                                  $hsh{maxcolors} || 256);
   }
@@ -988,6 +1032,33 @@ sub to_paletted {
   return $result;
 }
 
+sub to_paletted_multi {
+  my ($class, $quant, @images) = @_;
+
+  unless (@images) {
+    Imager->_set_error("to_paletted_multi: supply at least one image");
+    return;
+  }
+  my $index = 1;
+  for my $img (@images) {
+    unless ($img->{IMG}) {
+      Imager->_set_error("to_paletted_multi: image $index is empty");
+      return;
+    }
+    ++$index;
+  }
+
+  my @result = i_img_to_pal_multi($quant, map $_->{IMG}, @images);
+  unless (@result) {
+    Imager->_set_error(Imager->_error_as_msg);
+    return;
+  }
+
+  return map { 
+        bless { IMG=>$_, DEBUG=>$DEBUG, ERRSTR=>undef }, 'Imager' 
+      } @result;
+}
+
 sub make_palette {
   my ($class, $quant, @images) = @_;
 
@@ -1344,11 +1415,22 @@ sub settag {
 sub _get_reader_io {
   my ($self, $input) = @_;
 
+  my @io = $self->_open_reader_io($input)
+    or return;
+  $self->_set_io_options($io[0], $input)
+    or return;
+
+  return @io;
+}
+
+sub _open_reader_io {
+  my ($self, $input) = @_;
+
   if ($input->{io}) {
     return $input->{io}, undef;
   }
   elsif ($input->{fd}) {
-    return io_new_fd($input->{fd});
+    return $input->{mmap} ? io_new_mmap($input->{fd}) : io_new_fd($input->{fd});
   }
   elsif ($input->{fh}) {
     unless (Scalar::Util::openhandle($input->{fh})) {
@@ -1364,7 +1446,9 @@ sub _get_reader_io {
       return;
     }
     binmode $file;
-    return (io_new_fd(fileno($file)), $file);
+    my $io = $input->{mmap} ? io_new_mmap(fileno($file))
+      : io_new_fd(fileno($file));
+    return ($io, $file);
   }
   elsif ($input->{data}) {
     return io_new_buffer($input->{data});
@@ -1440,10 +1524,36 @@ sub _get_writer_io {
   unless ($buffered) {
     $io->set_buffered(0);
   }
+  $self->_set_io_options($io, $input)
+    or return;
 
   return ($io, @extras);
 }
 
+# apply the io_buffer_size and io_async options
+sub _set_io_options {
+  my ($self, $io, $input) = @_;
+
+  if (defined $input->{io_buffer_size}) {
+    my $size = $input->{io_buffer_size};
+    unless ($size =~ /^\d+$/ && $size > 0) {
+      $self->_set_error("io_buffer_size must be a positive integer");
+      return;
+    }
+    unless ($io->set_buffer_size($size)) {
+      $self->_set_error($self->_error_as_msg);
+      return;
+    }
+  }
+
+  # only file descriptor sources support this, quietly ignored for
+  # others
+  $input->{io_async}
+    and $io->set_async(1);
+
+  return 1;
+}
+
 # Read an image from file
 
 sub read {
@@ -1457,27 +1567,43 @@ sub read {
     undef($self->{IMG});
   }
 
-  my ($IO, $fh) = $self->_get_reader_io(\%input) or return;
+  my ($IO, $fh, $type) = $self->_reader_io_type(\%input) or return;
 
-  my $type = $input{'type'};
+  return $self->_read_type($IO, $type, %input);
+}
+
+# open the source for read() and work out the file type
+sub _reader_io_type {
+  my ($self, $input) = @_;
+
+  my ($IO, $fh) = $self->_get_reader_io($input) or return;
+
+  my $type = $input->{'type'};
   unless ($type) {
     $type = i_test_format_probe($IO, -1);
   }
 
-  if ($input{file} && !$type) {
+  if ($input->{file} && !$type) {
     # guess the type 
-    $type = $FORMATGUESS->($input{file});
+    $type = $FORMATGUESS->($input->{file});
   }
 
   unless ($type) {
     my $msg = "type parameter missing and it couldn't be determined from the file contents";
-    $input{file} and $msg .= " or file name";
+    $input->{file} and $msg .= " or file name";
     $self->_set_error($msg);
-    return undef;
+    return;
   }
 
   _reader_autoload($type);
 
+  return ($IO, $fh, $type);
+}
+
+# read a single image of the given type from $IO
+sub _read_type {
+  my ($self, $IO, $type, %input) = @_;
+
   if ($readers{$type} && $readers{$type}{single}) {
     return $readers{$type}{single}->($self, $IO, %input);
   }
@@ -1568,10 +1694,44 @@ sub register_reader {
   if ($opts{multiple}) {
     $readers{$type}{multiple} = $opts{multiple};
   }
+  if ($opts{rows}) {
+    $readers{$type}{rows} = $opts{rows};
+  }
+  if ($opts{pages}) {
+    $readers{$type}{pages} = $opts{pages};
+  }
 
   return 1;
 }
 
+# Read an image as a row image, which reads each row from the file as
+# it's requested, for formats that support it, or the whole image for
+# other formats.  Used by Imager::Pipeline.
+#
+# The source is kept in the object, since the row image reads from it.
+sub _read_rows {
+  my ($self, %input) = @_;
+
+  undef $self->{IMG};
+
+  my ($IO, $fh, $type) = $self->_reader_io_type(\%input) or return;
+
+  $self->{ROWS_IO} = [ $IO, $fh ];
+  if ($readers{$type} && $readers{$type}{rows}) {
+    return $readers{$type}{rows}->($self, $IO, %input);
+  }
+  elsif ($type eq 'pnm') {
+    $self->{IMG} = i_readpnm_rows_wiol($IO);
+    unless ($self->{IMG}) {
+      $self->_set_error('unable to read pnm image: ' . _error_as_msg());
+      return;
+    }
+    return $self;
+  }
+
+  return $self->_read_type($IO, $type, %input);
+}
+
 sub register_writer {
   my ($class, %opts) = @_;
 
@@ -1888,7 +2048,7 @@ sub write {
 
   if (exists $input{'data'}) {
     my $data = io_slurp($IO);
-    if (!$data) {
+    unless (length $data) {
       $self->{ERRSTR}='Could not slurp from buffer';
       return undef;
     }
@@ -1959,7 +2119,7 @@ sub write_multi {
 
   if (exists $opts->{'data'}) {
     my $data = io_slurp($IO);
-    if (!$data) {
+    unless (length $data) {
       Imager->_set_error('Could not slurp from buffer');
       return undef;
     }
@@ -1994,8 +2154,24 @@ sub read_multi {
 
   _reader_autoload($type);
 
+  my $pages = delete $opts{pages};
+  if ($pages) {
+    unless (ref $pages eq "ARRAY" && @$pages
+	    && !grep { !defined || !/^\d+$/ } @$pages) {
+      Imager->_set_error("read_multi: pages must be a reference to an array of page numbers");
+      return;
+    }
+    my %seen;
+    $pages = [ sort { $a <=> $b } grep !$seen{$_}++, @$pages ];
+    if ($readers{$type} && $readers{$type}{pages}) {
+      return $readers{$type}{pages}->($IO, $pages, %opts);
+    }
+  }
+
   if ($readers{$type} && $readers{$type}{multiple}) {
-    return $readers{$type}{multiple}->($IO, %opts);
+    my @imgs = $readers{$type}{multiple}->($IO, %opts)
+      or return;
+    return $pages ? _select_pages($pages, @imgs) : @imgs;
   }
 
   unless ($formats{$type}) {
@@ -2011,7 +2187,7 @@ sub read_multi {
   else {
     my $img = Imager->new;
     if ($img->read(%opts, io => $IO, type => $type)) {
-      return ( $img );
+      return $pages ? _select_pages($pages, $img) : ( $img );
     }
     Imager->_set_error($img->errstr);
     return;
@@ -2021,9 +2197,25 @@ sub read_multi {
     $ERRSTR = _error_as_msg();
   return;
   }
-  return map { 
+  @imgs = map { 
         bless { IMG=>$_, DEBUG=>$DEBUG, ERRSTR=>undef }, 'Imager' 
       } @imgs;
+
+  return $pages ? _select_pages($pages, @imgs) : @imgs;
+}
+
+# the images listed in @$pages, for readers that can't skip pages
+sub _select_pages {
+  my ($pages, @imgs) = @_;
+
+  for my $page (@$pages) {
+    if ($page >= @imgs) {
+      Imager->_set_error("page $page not found (" . @imgs . " total)");
+      return;
+    }
+  }
+
+  return @imgs[@$pages];
 }
 
 # Destroy an Imager object
@@ -2213,13 +2405,24 @@ sub scale_calculate {
   
 }
 
+# filter kernels for scale(), values from i_scale_kernel_t
+my %scale_kernels =
+  (
+   normal => 4,
+   box => 0,
+   triangle => 1,
+   catmullrom => 2,
+   mitchell => 3,
+   lanczos2 => 4,
+   lanczos3 => 5,
+  );
+
 # Scale an image to requested size and return the scaled version
 
 sub scale {
   my $self=shift;
   my %opts = (qtype=>'normal' ,@_);
   my $img = Imager->new();
-  my $tmp = Imager->new();
 
   unless (defined wantarray) {
     my @caller = caller;
@@ -2234,15 +2437,11 @@ sub scale {
     $self->scale_calculate(%opts)
       or return;
 
-  if ($opts{qtype} eq 'normal') {
-    $tmp->{IMG} = i_scaleaxis($self->{IMG}, $x_scale, 0);
-    if ( !defined($tmp->{IMG}) ) { 
-      $self->{ERRSTR} = 'unable to scale image: ' . $self->_error_as_msg;
-      return undef;
-    }
-    $img->{IMG}=i_scaleaxis($tmp->{IMG}, $y_scale, 1);
+  if (exists $scale_kernels{$opts{qtype}}) {
+    $img->{IMG} = i_scale_kernel($self->{IMG}, $new_width, $new_height,
+				 $scale_kernels{$opts{qtype}});
     if ( !defined($img->{IMG}) ) { 
-      $self->{ERRSTR}='unable to scale image: ' . $self->_error_as_msg; 
+      $self->{ERRSTR} = 'unable to scale image: ' . $self->_error_as_msg;
       return undef;
     }
 
@@ -3750,6 +3949,79 @@ sub map {
   return $self;
 }
 
+# must match i_level_type in imdatatypes.h
+my %level_types =
+  (
+   contrast => 0,
+   hardinvert => 1,
+   hardinvertall => 2,
+   postlevels => 3,
+   autolevels => 4,
+   map => 5,
+  );
+
+sub apply_levels {
+  my ($self, $ops) = @_;
+
+  $self->_valid_image("apply_levels")
+    or return;
+
+  ref $ops eq "ARRAY"
+    or return $self->_set_error("apply_levels: ops must be an array reference");
+
+  my @chlist = qw(red green blue alpha);
+  my @ops;
+  for my $op (@$ops) {
+    ref $op eq "HASH" && defined $op->{type}
+      or return $self->_set_error("apply_levels: each operation must be a hash reference with a type");
+    my $type = $op->{type};
+    exists $level_types{$type}
+      or return $self->_set_error("apply_levels: unknown operation type '$type'");
+    if ($type eq "contrast") {
+      defined $op->{intensity}
+	or return $self->_set_error("apply_levels: contrast requires intensity");
+      push @ops, [ $level_types{$type}, $op->{intensity} ];
+    }
+    elsif ($type eq "postlevels") {
+      push @ops, [ $level_types{$type},
+		   defined $op->{levels} ? $op->{levels} : 10 ];
+    }
+    elsif ($type eq "autolevels") {
+      push @ops, [ $level_types{$type},
+		   defined $op->{lsat} ? $op->{lsat} : 0.1,
+		   defined $op->{usat} ? $op->{usat} : 0.1 ];
+    }
+    elsif ($type eq "map") {
+      my @maps = $op->{maps} ? @{$op->{maps}}
+	: map { exists $op->{$_} ? $op->{$_} : $op->{all} } @chlist;
+      my $mask = 0;
+      my $packed = "";
+      for my $ch (0 .. 3) {
+	my $map = $maps[$ch];
+	if (ref $map eq "ARRAY" && @$map == 256) {
+	  $mask |= 1 << $ch;
+	  $packed .= pack "C*",
+	    map { !defined $_ || $_ < 0 ? 0 : $_ > 255 ? 255 : $_ } @$map;
+	}
+	else {
+	  $packed .= "\0" x 256;
+	}
+      }
+      push @ops, [ $level_types{$type}, 0, 0, $mask, $packed ];
+    }
+    else {
+      push @ops, [ $level_types{$type} ];
+    }
+  }
+
+  unless (i_apply_levels($self->{IMG}, \@ops)) {
+    $self->_set_error($self->_error_as_msg);
+    return;
+  }
+
+  return $self;
+}
+
 sub difference {
   my ($self, %opts) = @_;
 
@@ -3773,6 +4045,28 @@ sub difference {
   return $result;
 }
 
+sub difference_bounds {
+  my ($self, %opts) = @_;
+
+  $self->_valid_image("difference_bounds")
+    or return;
+
+  defined $opts{mindist} or $opts{mindist} = 0;
+
+  defined $opts{other}
+    or return $self->_set_error("No 'other' parameter supplied");
+  unless ($opts{other}->_valid_image("difference_bounds")) {
+    $self->_set_error($opts{other}->errstr . " (other image)");
+    return;
+  }
+
+  my @bounds = i_diff_bounds($self->{IMG}, $opts{other}{IMG},
+			     $opts{mindist})
+    or return $self->_set_error($self->_error_as_msg());
+
+  return @bounds;
+}
+
 # destructive border - image is shrunk by one pixel all around
 
 sub border {
@@ -3999,6 +4293,39 @@ sub get_file_limits {
   i_get_image_file_limits();
 }
 
+sub set_threads {
+  my ($class, $count) = @_;
+
+  unless (defined $count) {
+    $class->_set_error("set_threads: missing thread count");
+    return;
+  }
+
+  unless (i_set_threads($count)) {
+    $class->_set_error($class->_error_as_msg);
+    return;
+  }
+
+  return 1;
+}
+
+sub get_threads {
+  i_get_threads();
+}
+
+sub set_seed {
+  my ($class, $seed) = @_;
+
+  unless (defined $seed && $seed =~ /^\d+$/) {
+    $class->_set_error("set_seed: seed must be a non-negative integer");
+    return;
+  }
+
+  i_set_seed($seed);
+
+  return 1;
+}
+
 my @check_args = qw(width height channels sample_size);
 
 sub check_file_limits {
@@ -4493,6 +4820,11 @@ L<Imager::Fountain> - Helper for making gradient profiles.
 
 =item *
 
+L<Imager::Pipeline> - Scale an image from file to file a few rows at
+a time.
+
+=item *
+
 L<Imager::IO> - Imager I/O abstraction.
 
 =item *
@@ -4581,6 +4913,9 @@ addtag() -  L<Imager::ImageTypes/addtag()> - add image tags
 align_string() - L<Imager::Draw/align_string()> - draw text aligned on a
 point
 
+apply_levels() - L<Imager::Transformations/apply_levels()> - apply a
+chain of per-sample operations in one pass
+
 arc() - L<Imager::Draw/arc()> - draw a filled arc
 
 bits() - L<Imager::ImageTypes/bits()> - number of bits per sample for the
@@ -4623,6 +4958,9 @@ deltag() -  L<Imager::ImageTypes/deltag()> - delete image tags
 difference() - L<Imager::Filters/difference()> - produce a difference
 images from two input images.
 
+difference_bounds() - L<Imager::Filters/difference_bounds()> - the
+rectangle holding the pixels that differ between two images.
+
 errstr() - L</errstr()> - the error from the last failed operation.
 
 filter() - L<Imager::Filters/filter()> - image filtering
@@ -4662,6 +5000,9 @@ colors
 getsamples() - L<Imager::Draw/getsamples()> - retrieve samples from a
 row or partial row of pixels.
 
+get_threads() - L<Imager::Threads/get_threads()> - the number of
+threads Imager's filters use.
+
 getscanline() - L<Imager::Draw/getscanline()> - retrieve colors for a
 row or partial row of pixels.
 
@@ -4771,6 +5112,12 @@ setsamples() - L<Imager::Draw/setsamples()>
 
 setscanline() - L<Imager::Draw/setscanline()>
 
+set_seed() - L<Imager::Threads/set_seed()> - make the random numbers
+used by filters and quantization repeatable.
+
+set_threads() - L<Imager::Threads/set_threads()> - set the number of
+threads Imager's filters use.
+
 settag() - L<Imager::ImageTypes/settag()>
 
 string() - L<Imager::Draw/string()> - draw text on an image
@@ -4779,6 +5126,9 @@ tags() -  L<Imager::ImageTypes/tags()> - fetch image tags
 
 to_paletted() -  L<Imager::ImageTypes/to_paletted()>
 
+to_paletted_multi() -  L<Imager::ImageTypes/to_paletted_multi()> -
+convert several images to paletted images with a common palette
+
 to_rgb16() - L<Imager::ImageTypes/to_rgb16()>
 
 to_rgb8() - L<Imager::ImageTypes/to_rgb8()>
@@ -4932,13 +5282,13 @@ PNM - L<Imager::Files/"PNM (Portable aNy Map)">
 rectangles, drawing - L<Imager::Draw/box()>
 
 resizing an image - L<Imager::Transformations/scale()>, 
-L<Imager::Transformations/crop()>
+L<Imager::Transformations/crop()>, L<Imager::Pipeline>
 
 RGB (SGI) files - L<Imager::Files/"SGI (RGB, BW)">
 
 saving an image - L<Imager::Files>
 
-scaling - L<Imager::Transformations/scale()>
+scaling - L<Imager::Transformations/scale()>, L<Imager::Pipeline>
 
 security - L<Imager::Security>
 
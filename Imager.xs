@@ -447,6 +447,34 @@ static void io_destroyer(void *p) {
   myfree(cbd);
 }
 
+/* copy the content of a bufchain straight into a new SV */
+static SV *
+do_io_slurp(pTHX_ i_io_glue_t *ig) {
+  size_t count = io_bufchain_iovec(ig, NULL, 0);
+  i_io_iovec *iov = mymalloc(sizeof(i_io_iovec) * (count ? count : 1));
+  size_t total = 0;
+  size_t i;
+  SV *sv;
+  char *p;
+
+  io_bufchain_iovec(ig, iov, count);
+  for (i = 0; i < count; ++i)
+    total += iov[i].len;
+
+  sv = newSV(total);
+  sv_setpvn(sv, "", 0);
+  p = SvPVX(sv);
+  for (i = 0; i < count; ++i) {
+    memcpy(p, iov[i].base, iov[i].len);
+    p += iov[i].len;
+  }
+  SvCUR_set(sv, total);
+  *SvEND(sv) = '\0';
+  myfree(iov);
+
+  return sv;
+}
+
 static i_io_glue_t *
 do_io_new_buffer(pTHX_ SV *data_sv) {
   const char *data;
@@ -521,6 +549,7 @@ static struct value_name make_color_names[] =
   { "webmap", mc_web_map, },
   { "addi", mc_addi, },
   { "mediancut", mc_median_cut, },
+  { "wu", mc_wu, },
   { "mono", mc_mono, },
   { "monochrome", mc_mono, },
   { "gray", mc_gray, },
@@ -687,13 +716,32 @@ ip_handle_quant_opts(pTHX_ i_quantize *quant, HV *hv)
       }
     }
   }
+  sv = hv_fetch(hv, "errdiff_serpentine", 18, 0);
+  if (sv && *sv && SvTRUE(*sv))
+    quant->errdiff |= ed_bidir;
   sv = hv_fetch(hv, "perturb", 7, 0);
   if (sv && *sv)
     quant->perturb = SvIV(*sv);
+
+  if (quant->version >= 2) {
+    quant->lookup_bits = 5;
+    sv = hv_fetch(hv, "lookup_bits", 11, 0);
+    if (sv && *sv && SvOK(*sv))
+      quant->lookup_bits = SvIV(*sv);
+    quant->lookup_exact = 1;
+    sv = hv_fetch(hv, "lookup_exact", 12, 0);
+    if (sv && *sv && SvOK(*sv))
+      quant->lookup_exact = SvTRUE(*sv);
+    quant->sample = 1;
+    sv = hv_fetch(hv, "quant_sample", 12, 0);
+    if (sv && *sv && SvOK(*sv) && SvIV(*sv) > 1)
+      quant->sample = SvIV(*sv);
+  }
 }
 
 static void
 ip_cleanup_quant_opts(pTHX_ i_quantize *quant) {
+  i_quant_cleanup(quant);
   myfree(quant->mc_colors);
   if (quant->ed_map)
     myfree(quant->ed_map);
@@ -1098,6 +1146,10 @@ Imager::IO
 io_new_fd(fd)
                          int     fd
 
+Imager::IO
+io_new_mmap(fd)
+                         int     fd
+
 Imager::IO
 io_new_bufchain()
 
@@ -1124,14 +1176,8 @@ io_new_cb(writecb, readcb, seekcb, closecb, maxwrite = CBDATA_BUFSIZE)
 SV *
 io_slurp(ig)
         Imager::IO     ig
-	     PREINIT:
-	      unsigned char*    data;
-	      size_t    tlength;
 	     CODE:
- 	      data    = NULL;
-              tlength = io_slurp(ig, &data);
-              RETVAL = newSVpv((char *)data,tlength);
-              myfree(data);
+              RETVAL = do_io_slurp(aTHX_ ig);
 	     OUTPUT:
 	      RETVAL
 
@@ -1155,6 +1201,17 @@ i_get_image_file_limits()
           PUSHs(sv_2mortal(newSVuv(bytes)));
         }
 
+undef_int
+i_set_threads(count)
+	int count
+
+int
+i_get_threads()
+
+void
+i_set_seed(seed)
+	unsigned long seed
+
 bool
 i_int_check_image_file_limits(width, height, channels, sample_size)
 	i_img_dim width
@@ -1173,6 +1230,14 @@ io_new_fd(class, fd)
     OUTPUT:
 	RETVAL
 
+Imager::IO
+io_new_mmap(class, fd)
+	int fd
+    CODE:
+	RETVAL = io_new_mmap(fd);
+    OUTPUT:
+	RETVAL
+
 Imager::IO
 io_new_buffer(class, data_sv)
 	SV *data_sv
@@ -1210,14 +1275,8 @@ io__new_perlio(class, io)
 SV *
 io_slurp(class, ig)
         Imager::IO     ig
-    PREINIT:
-	unsigned char*    data;
-	size_t    tlength;
     CODE:
-	data    = NULL;
-	tlength = io_slurp(ig, &data);
-	RETVAL = newSVpv((char *)data,tlength);
-	myfree(data);
+	RETVAL = do_io_slurp(aTHX_ ig);
     OUTPUT:
 	RETVAL
 
@@ -1475,6 +1534,55 @@ bool
 i_io_is_buffered(ig)
 	Imager::IO ig
 
+bool
+i_io_set_buffer_size(ig, size)
+	Imager::IO ig
+	size_t size
+
+size_t
+i_io_buffer_size(ig)
+	Imager::IO ig
+
+bool
+i_io_set_async(ig, flag = 1)
+	Imager::IO ig
+	int flag
+
+void
+i_io_set_stats(ig, flag = 1)
+	Imager::IO ig
+	int flag
+
+void
+i_io_stats(ig)
+	Imager::IO ig
+      PREINIT:
+	i_io_stats stats;
+      PPCODE:
+	if (i_io_get_stats(ig, &stats)) {
+	  EXTEND(SP, 20);
+	  PUSHs(sv_2mortal(newSVpv("bytes_read", 0)));
+	  PUSHs(sv_2mortal(newSVnv((double)stats.bytes_read)));
+	  PUSHs(sv_2mortal(newSVpv("bytes_written", 0)));
+	  PUSHs(sv_2mortal(newSVnv((double)stats.bytes_written)));
+	  PUSHs(sv_2mortal(newSVpv("reads", 0)));
+	  PUSHs(sv_2mortal(newSVuv(stats.reads)));
+	  PUSHs(sv_2mortal(newSVpv("writes", 0)));
+	  PUSHs(sv_2mortal(newSVuv(stats.writes)));
+	  PUSHs(sv_2mortal(newSVpv("seeks", 0)));
+	  PUSHs(sv_2mortal(newSVuv(stats.seeks)));
+	  PUSHs(sv_2mortal(newSVpv("fills", 0)));
+	  PUSHs(sv_2mortal(newSVuv(stats.fills)));
+	  PUSHs(sv_2mortal(newSVpv("peek_fills", 0)));
+	  PUSHs(sv_2mortal(newSVuv(stats.peek_fills)));
+	  PUSHs(sv_2mortal(newSVpv("read_time", 0)));
+	  PUSHs(sv_2mortal(newSVnv(stats.read_time)));
+	  PUSHs(sv_2mortal(newSVpv("write_time", 0)));
+	  PUSHs(sv_2mortal(newSVnv(stats.write_time)));
+	  PUSHs(sv_2mortal(newSVpv("seek_time", 0)));
+	  PUSHs(sv_2mortal(newSVnv(stats.seek_time)));
+	}
+
 bool
 i_io_eof(ig)
 	Imager::IO ig
@@ -2009,6 +2117,13 @@ i_gaussian(im,stdev)
     Imager::ImgRaw     im
 	    double     stdev
 
+undef_int
+i_gaussian2(im,stdev,method,iir_threshold)
+    Imager::ImgRaw     im
+	    double     stdev
+	       int     method
+	    double     iir_threshold
+
 void
 i_unsharp_mask(im,stdev,scale)
     Imager::ImgRaw     im
@@ -2036,6 +2151,48 @@ i_conv(im,coef)
     OUTPUT:
 	RETVAL
 
+int
+i_conv2d(im,coef)
+	Imager::ImgRaw     im
+	AV *coef
+     PREINIT:
+	double*    c_coef;
+	int     xlen, ylen;
+	SV **temp;
+	AV *avrow;
+	int i, j;
+    CODE:
+	ylen = av_len(coef) + 1;
+	xlen = 0;
+	for (j = 0; j < ylen; ++j) {
+	  temp = av_fetch(coef, j, 0);
+	  if (temp && SvROK(*temp) && SvTYPE(SvRV(*temp)) == SVt_PVAV) {
+	    avrow = (AV*)SvRV(*temp);
+	    if (j == 0)
+	      xlen = av_len(avrow) + 1;
+	    else if (av_len(avrow) + 1 != xlen) {
+	      i_push_error(0, "all kernel rows must be the same length");
+	      XSRETURN(0);
+	    }
+	  }
+	  else {
+	    i_push_errorf(0, "invalid kernel: row %d is not an array ref", j);
+	    XSRETURN(0);
+	  }
+	}
+	c_coef = mymalloc(sizeof(double) * (xlen * ylen + 1));
+	for (j = 0; j < ylen; ++j) {
+	  avrow = (AV*)SvRV(*av_fetch(coef, j, 0));
+	  for (i = 0; i < xlen; ++i) {
+	    temp = av_fetch(avrow, i, 0);
+	    c_coef[i + j * xlen] = temp ? SvNV(*temp) : 0;
+	  }
+	}
+	RETVAL = i_conv2d(im, c_coef, xlen, ylen);
+	myfree(c_coef);
+    OUTPUT:
+	RETVAL
+
 Imager::ImgRaw
 i_convert(src, avmain)
     Imager::ImgRaw     src
@@ -2367,6 +2524,10 @@ i_readpnm_wiol(ig, allow_incomplete)
         Imager::IO     ig
 	       int     allow_incomplete
 
+Imager::ImgRaw
+i_readpnm_rows_wiol(ig)
+        Imager::IO     ig
+
 
 void
 i_readpnm_multi_wiol(ig, allow_incomplete)
@@ -2464,6 +2625,29 @@ i_scale_mixing(im, width, height)
 	       i_img_dim     width
 	       i_img_dim     height
 
+Imager::ImgRaw
+i_scale_mixing_float(im, width, height)
+    Imager::ImgRaw     im
+	       i_img_dim     width
+	       i_img_dim     height
+
+Imager::ImgRaw
+i_scale_mixing_rows(im, width, height)
+    Imager::ImgRaw     im
+	       i_img_dim     width
+	       i_img_dim     height
+
+const char *
+i_img_rows_error(im)
+    Imager::ImgRaw     im
+
+Imager::ImgRaw
+i_scale_kernel(im, xsize, ysize, kernel)
+    Imager::ImgRaw     im
+	       i_img_dim     xsize
+	       i_img_dim     ysize
+	       int     kernel
+
 Imager::ImgRaw
 i_haar(im)
     Imager::ImgRaw     im
@@ -2678,6 +2862,57 @@ i_autolevels(im,lsat,usat,skew)
              float     usat
              float     skew
 
+undef_int
+i_apply_levels(im, ops_av)
+    Imager::ImgRaw     im
+    AV *ops_av
+  PREINIT:
+    i_level_op *ops;
+    int count, i;
+  CODE:
+    /* each op is [ type, param0, param1, mask, maps ], where maps is a
+       string of 256 bytes per channel */
+    i_clear_error();
+    count = av_len(ops_av) + 1;
+    ops = mymalloc(sizeof(i_level_op) * (count ? count : 1));
+    RETVAL = 1;
+    for (i = 0; i < count; ++i) {
+      SV **entry = av_fetch(ops_av, i, 0);
+      AV *op_av;
+      SV **sv;
+      if (!entry || !SvROK(*entry) || SvTYPE(SvRV(*entry)) != SVt_PVAV) {
+        i_push_error(0, "levels operations must be array references");
+        RETVAL = 0;
+        break;
+      }
+      op_av = (AV *)SvRV(*entry);
+      sv = av_fetch(op_av, 0, 0);
+      ops[i].type = sv ? (i_level_type)SvIV(*sv) : i_lo_contrast;
+      sv = av_fetch(op_av, 1, 0);
+      ops[i].param[0] = sv ? SvNV(*sv) : 0;
+      sv = av_fetch(op_av, 2, 0);
+      ops[i].param[1] = sv ? SvNV(*sv) : 0;
+      sv = av_fetch(op_av, 3, 0);
+      ops[i].mask = sv ? SvUV(*sv) : 0;
+      ops[i].maps = NULL;
+      sv = av_fetch(op_av, 4, 0);
+      if (sv && SvOK(*sv)) {
+        STRLEN len;
+        char *maps = SvPV(*sv, len);
+        if (len != 256 * MAXCHANNELS) {
+          i_push_error(0, "levels maps must be 256 bytes per channel");
+          RETVAL = 0;
+          break;
+        }
+        ops[i].maps = (unsigned char (*)[256])maps;
+      }
+    }
+    if (RETVAL)
+      RETVAL = i_apply_levels(im, ops, count);
+    myfree(ops);
+  OUTPUT:
+    RETVAL
+
 void
 i_radnoise(im,xo,yo,rscale,ascale)
     Imager::ImgRaw     im
@@ -2718,6 +2953,21 @@ i_diff_image(im, im2, mindist=0)
     Imager::ImgRaw     im2
             double     mindist
 
+void
+i_diff_bounds(im, im2, mindist=0)
+    Imager::ImgRaw     im
+    Imager::ImgRaw     im2
+            double     mindist
+      PREINIT:
+	i_img_dim bounds[4];
+	int i;
+      PPCODE:
+	if (i_diff_bounds(im, im2, mindist, bounds)) {
+	  EXTEND(SP, 4);
+	  for (i = 0; i < 4; ++i)
+	    PUSHs(sv_2mortal(newSViv(bounds[i])));
+	}
+
 undef_int
 i_fountain(im, xa, ya, xb, yb, type, repeat, combine, super_sample, ssample_param, segs)
     Imager::ImgRaw     im
@@ -2952,7 +3202,7 @@ i_img_to_pal(src, quant)
           croak("i_img_to_pal: second argument must be a hash ref");
         hv = (HV *)SvRV(ST(1));
         memset(&quant, 0, sizeof(quant));
-	quant.version = 1;
+	quant.version = 2;
         quant.mc_size = 256;
 	ip_handle_quant_opts(aTHX_ &quant, hv);
         RETVAL = i_img_to_pal(src, &quant);
@@ -2967,6 +3217,46 @@ Imager::ImgRaw
 i_img_to_rgb(src)
         Imager::ImgRaw src
 
+void
+i_img_to_pal_multi(HV *quant_hv, ...)
+      PREINIT:
+        size_t count = items - 1;
+	i_quantize quant;
+	i_img **imgs = NULL;
+	i_img **results;
+	ssize_t i;
+      PPCODE:
+        if (count <= 0)
+	  croak("Please supply at least one image (%d)", (int)count);
+        imgs = mymalloc(sizeof(i_img *) * count);
+	for (i = 0; i < count; ++i) {
+	  SV *img_sv = ST(i + 1);
+	  if (SvROK(img_sv) && sv_derived_from(img_sv, "Imager::ImgRaw")) {
+	    imgs[i] = INT2PTR(i_img *, SvIV((SV*)SvRV(img_sv)));
+	  }
+	  else {
+	    myfree(imgs);
+	    croak("Image %d is not an image object", (int)i+1);
+          }
+	}
+        memset(&quant, 0, sizeof(quant));
+	quant.version = 2;
+	quant.mc_size = 256;
+        ip_handle_quant_opts(aTHX_ &quant, quant_hv);
+	results = mymalloc(sizeof(i_img *) * count);
+	if (i_img_to_pal_multi(&quant, imgs, count, results)) {
+	  ip_copy_colors_back(aTHX_ quant_hv, &quant);
+	  EXTEND(SP, count);
+	  for (i = 0; i < count; ++i) {
+	    SV *sv = sv_newmortal();
+	    sv_setref_pv(sv, "Imager::ImgRaw", (void *)results[i]);
+	    PUSHs(sv);
+	  }
+	}
+	myfree(results);
+	myfree(imgs);
+ 	ip_cleanup_quant_opts(aTHX_ &quant);
+
 void
 i_img_make_palette(HV *quant_hv, ...)
       PREINIT:
@@ -2989,7 +3279,7 @@ i_img_make_palette(HV *quant_hv, ...)
           }
 	}
         memset(&quant, 0, sizeof(quant));
-	quant.version = 1;
+	quant.version = 2;
 	quant.mc_size = 256;
         ip_handle_quant_opts(aTHX_ &quant, quant_hv);
 	i_quant_makemap(&quant, imgs, count);
@@ -3605,6 +3895,26 @@ i_img_double_new(x, y, ch)
         i_img_dim y
         int ch
 
+Imager::ImgRaw
+i_img_mmap_new(x, y, ch, bits, path_sv = &PL_sv_undef)
+        i_img_dim x
+        i_img_dim y
+        int ch
+        int bits
+        SV *path_sv
+      PREINIT:
+        const char *path;
+        STRLEN len;
+      CODE:
+        SvGETMAGIC(path_sv);
+        if (SvOK(path_sv))
+          path = SvPV_nomg(path_sv, len);
+        else
+          path = NULL;
+        RETVAL = i_img_mmap_new(x, y, ch, bits, path);
+      OUTPUT:
+        RETVAL
+
 Imager::ImgRaw
 i_img_to_drgb(im)
        Imager::ImgRaw im
@@ -1,15 +1,63 @@
 package Imager::File::JPEG;
 use strict;
 use Imager;
+use Scalar::Util ();
 use vars qw($VERSION @ISA);
 
 BEGIN {
-  $VERSION = "0.88";
+  $VERSION = "0.89";
 
   require XSLoader;
   XSLoader::load('Imager::File::JPEG', $VERSION);
 }
 
+# must match i_jpeg_dct_method in imjpeg.h
+my %dct_methods =
+  (
+   int => 0,
+   fast => 1,
+   float => 2,
+  );
+
+# convert read() parameters to the trailing arguments of
+# i_readjpeg_wiol() and i_readjpeg_rows_wiol()
+sub _read_options {
+  my ($im, $hsh) = @_;
+
+  my $denom = 1;
+  if (defined $hsh->{jpeg_scale}) {
+    my $scale = $hsh->{jpeg_scale};
+    $scale =~ m(^\s*(\d+)\s*/\s*(\d+)\s*$) && $2
+      and $scale = $1 / $2;
+    unless (Scalar::Util::looks_like_number($scale)
+	    && $scale > 0 && $scale <= 1) {
+      $im->_set_error("jpeg_scale must be a number greater than 0 and no more than 1");
+      return;
+    }
+    # the smallest scale libjpeg supports that isn't below the
+    # requested scale
+    $denom = 8;
+    $denom /= 2 while 1 / $denom < $scale - 1e-9;
+  }
+
+  my $dct = -1;
+  if (defined $hsh->{jpeg_dct}) {
+    $dct = $dct_methods{$hsh->{jpeg_dct}};
+    unless (defined $dct) {
+      $im->_set_error("jpeg_dct must be one of "
+		      . join(", ", sort keys %dct_methods));
+      return;
+    }
+  }
+
+  return ($denom, $hsh->{jpeg_max_width} || 0,
+	  $hsh->{jpeg_max_height} || 0, $dct,
+	  defined $hsh->{jpeg_fancy_upsampling}
+	  ? $hsh->{jpeg_fancy_upsampling} : 1,
+	  defined $hsh->{jpeg_block_smoothing}
+	  ? $hsh->{jpeg_block_smoothing} : 1);
+}
+
 Imager->register_reader
   (
    type=>'jpeg',
@@ -17,7 +65,25 @@ Imager->register_reader
    sub { 
      my ($im, $io, %hsh) = @_;
 
-     ($im->{IMG},$im->{IPTCRAW}) = i_readjpeg_wiol( $io );
+     my @opts = _read_options($im, \%hsh)
+       or return;
+
+     ($im->{IMG},$im->{IPTCRAW}) = i_readjpeg_wiol($io, @opts);
+
+     unless ($im->{IMG}) {
+       $im->_set_error(Imager->_error_as_msg);
+       return;
+     }
+     return $im;
+   },
+   rows =>
+   sub {
+     my ($im, $io, %hsh) = @_;
+
+     my @opts = _read_options($im, \%hsh)
+       or return;
+
+     $im->{IMG} = i_readjpeg_rows_wiol($io, @opts);
 
      unless ($im->{IMG}) {
        $im->_set_error(Imager->_error_as_msg);
@@ -24,16 +24,30 @@ i_writejpeg_wiol(im, ig, qfactor)
 
 
 void
-i_readjpeg_wiol(ig)
+i_readjpeg_wiol(ig, scale_denom = 1, max_width = 0, max_height = 0, dct_method = -1, fancy_upsampling = 1, block_smoothing = 1)
         Imager::IO     ig
+	       int     scale_denom
+	 i_img_dim     max_width
+	 i_img_dim     max_height
+	       int     dct_method
+	       int     fancy_upsampling
+	       int     block_smoothing
 	     PREINIT:
 	      char*    iptc_itext;
 	       int     tlength;
 	     i_img*    rimg;
                 SV*    r;
+	     i_jpeg_read_options opts;
 	     PPCODE:
  	      iptc_itext = NULL;
-	      rimg = i_readjpeg_wiol(ig,-1,&iptc_itext,&tlength);
+	      i_jpeg_read_options_init(&opts);
+	      opts.scale_denom = scale_denom;
+	      opts.max_width = max_width;
+	      opts.max_height = max_height;
+	      opts.dct_method = (i_jpeg_dct_method)dct_method;
+	      opts.fancy_upsampling = fancy_upsampling;
+	      opts.block_smoothing = block_smoothing;
+	      rimg = i_readjpeg_opts_wiol(ig,-1,&iptc_itext,&tlength,&opts);
 	      if (iptc_itext == NULL) {
 		    r = sv_newmortal();
 	            EXTEND(SP,1);
@@ -48,5 +62,28 @@ i_readjpeg_wiol(ig)
                     myfree(iptc_itext);
 	      }
 
+Imager::ImgRaw
+i_readjpeg_rows_wiol(ig, scale_denom = 1, max_width = 0, max_height = 0, dct_method = -1, fancy_upsampling = 1, block_smoothing = 1)
+        Imager::IO     ig
+	       int     scale_denom
+	 i_img_dim     max_width
+	 i_img_dim     max_height
+	       int     dct_method
+	       int     fancy_upsampling
+	       int     block_smoothing
+	     PREINIT:
+	     i_jpeg_read_options opts;
+	     CODE:
+	      i_jpeg_read_options_init(&opts);
+	      opts.scale_denom = scale_denom;
+	      opts.max_width = max_width;
+	      opts.max_height = max_height;
+	      opts.dct_method = (i_jpeg_dct_method)dct_method;
+	      opts.fancy_upsampling = fancy_upsampling;
+	      opts.block_smoothing = block_smoothing;
+	      RETVAL = i_readjpeg_rows_wiol(ig, &opts);
+	     OUTPUT:
+	      RETVAL
+
 BOOT:
 	PERL_INITIALIZE_IMAGER_CALLBACKS;
@@ -42,6 +42,10 @@ Reads and writes JPEG images
 
 #define JPEG_DIM_MAX JPEG_MAX_DIMENSION
 
+/* most scanlines we ask libjpeg for at a time when decoding directly
+   into the image, libjpeg never returns more than 4 */
+#define JPEG_MAX_ROWS 16
+
 #define _STRINGIFY(x) #x
 #define STRINGIFY(x) _STRINGIFY(x)
 
@@ -362,133 +366,188 @@ i_libjpeg_version(void) {
 /*
 =item i_readjpeg_wiol(data, length, iptc_itext, itlength)
 
+Read a JPEG image at full size.
+
 =cut
 */
 i_img*
 i_readjpeg_wiol(io_glue *data, int length, char** iptc_itext, int *itlength) {
-  i_img * volatile im = NULL;
-  int seen_exif = 0;
-  i_color * volatile line_buffer = NULL;
-  struct jpeg_decompress_struct cinfo;
-  struct my_error_mgr jerr;
-  JSAMPARRAY buffer;		/* Output row buffer */
-  int row_stride;		/* physical row width in output buffer */
-  jpeg_saved_marker_ptr markerp;
-  transfer_function_t transfer_f;
-  int channels;
-  volatile int src_set = 0;
+  i_jpeg_read_options opts;
 
-  mm_log((1,"i_readjpeg_wiol(data %p, length %d,iptc_itext %p)\n", data, length, iptc_itext));
+  i_jpeg_read_options_init(&opts);
 
-  i_clear_error();
+  return i_readjpeg_opts_wiol(data, length, iptc_itext, itlength, &opts);
+}
 
-  *iptc_itext = NULL;
-  *itlength = 0;
+/*
+=item i_jpeg_read_options_init(opts)
 
-  cinfo.err = jpeg_std_error(&jerr.pub);
-  jerr.pub.error_exit     = my_error_exit;
-  jerr.pub.output_message = my_output_message;
+Set C<opts> to the defaults, decoding at full size with libjpeg's
+default quality settings.
 
-  /* Set error handler */
-  if (setjmp(jerr.setjmp_buffer)) {
-    if (src_set)
-      wiol_term_source(&cinfo);
-    jpeg_destroy_decompress(&cinfo); 
-    if (line_buffer)
-      myfree(line_buffer);
-    if (im)
-      i_img_destroy(im);
-    return NULL;
+=cut
+*/
+
+void
+i_jpeg_read_options_init(i_jpeg_read_options *opts) {
+  opts->scale_denom = 1;
+  opts->max_width = opts->max_height = 0;
+  opts->dct_method = i_jpeg_dct_default;
+  opts->fancy_upsampling = 1;
+  opts->block_smoothing = 1;
+}
+
+/*
+Find the largest denominator for libjpeg's DCT scaling that keeps
+the decoded image at least max_width by max_height.  A limit of zero
+or less is ignored.
+*/
+
+static int
+jpeg_fit_denom(j_decompress_ptr cinfo, i_img_dim max_width,
+	       i_img_dim max_height) {
+  int denom;
+
+  for (denom = 8; denom > 1; denom /= 2) {
+    i_img_dim width = (cinfo->image_width + denom - 1) / denom;
+    i_img_dim height = (cinfo->image_height + denom - 1) / denom;
+
+    if ((max_width <= 0 || width >= max_width)
+	&& (max_height <= 0 || height >= max_height))
+      break;
   }
-  
-  jpeg_create_decompress(&cinfo);
-  jpeg_save_markers(&cinfo, JPEG_APP13, 0xFFFF);
-  jpeg_save_markers(&cinfo, JPEG_APP1, 0xFFFF);
-  jpeg_save_markers(&cinfo, JPEG_COM, 0xFFFF);
-  jpeg_wiol_src(&cinfo, data, length);
-  src_set = 1;
 
-  (void) jpeg_read_header(&cinfo, TRUE);
-  (void) jpeg_start_decompress(&cinfo);
+  return denom;
+}
+
+/*
+Check the options for i_readjpeg_opts_wiol() and
+i_readjpeg_rows_wiol(), pushing an error if they're invalid.
+*/
+
+static int
+jpeg_check_options(const i_jpeg_read_options *opts) {
+  int scale_denom = opts->scale_denom;
 
-  channels = cinfo.output_components;
-  switch (cinfo.out_color_space) {
+  if (scale_denom != 1 && scale_denom != 2 && scale_denom != 4
+      && scale_denom != 8) {
+    i_push_errorf(0, "scale_denom must be 1, 2, 4 or 8, not %d", scale_denom);
+    return 0;
+  }
+  switch (opts->dct_method) {
+  case i_jpeg_dct_default:
+  case i_jpeg_dct_int:
+  case i_jpeg_dct_fast:
+  case i_jpeg_dct_float:
+    break;
+  default:
+    i_push_errorf(0, "unknown DCT method %d", (int)opts->dct_method);
+    return 0;
+  }
+
+  return 1;
+}
+
+/*
+Set up C<cinfo> to decode as C<opts> requests, once the header has
+been read.  Returns the scale denominator used.
+*/
+
+static int
+jpeg_apply_options(j_decompress_ptr cinfo, const i_jpeg_read_options *opts) {
+  int scale_denom = opts->scale_denom;
+
+  if (opts->max_width > 0 || opts->max_height > 0) {
+    int fit_denom = jpeg_fit_denom(cinfo, opts->max_width, opts->max_height);
+    if (scale_denom == 1 || fit_denom < scale_denom)
+      scale_denom = fit_denom;
+  }
+  cinfo->scale_num = 1;
+  cinfo->scale_denom = scale_denom;
+  switch (opts->dct_method) {
+  case i_jpeg_dct_int:
+    cinfo->dct_method = JDCT_ISLOW;
+    break;
+  case i_jpeg_dct_fast:
+    cinfo->dct_method = JDCT_IFAST;
+    break;
+  case i_jpeg_dct_float:
+    cinfo->dct_method = JDCT_FLOAT;
+    break;
+  default:
+    break;
+  }
+  cinfo->do_fancy_upsampling = opts->fancy_upsampling ? TRUE : FALSE;
+  cinfo->do_block_smoothing = opts->block_smoothing ? TRUE : FALSE;
+
+  return scale_denom;
+}
+
+/*
+Choose the function to convert libjpeg's output to Imager colors,
+once decompression has started, and set C<*channels> to the number
+of channels in the image.
+
+Returns NULL, pushing an error, for an unsupported color space.
+*/
+
+static transfer_function_t
+jpeg_transfer_for(j_decompress_ptr cinfo, int *channels) {
+  *channels = cinfo->output_components;
+  switch (cinfo->out_color_space) {
   case JCS_GRAYSCALE:
-    if (cinfo.output_components != 1) {
-      mm_log((1, "i_readjpeg: grayscale image with %d channels\n", cinfo.output_components));
-      i_push_errorf(0, "grayscale image with invalid components %d", cinfo.output_components);
-      wiol_term_source(&cinfo);
-      jpeg_destroy_decompress(&cinfo);
+    if (cinfo->output_components != 1) {
+      mm_log((1, "i_readjpeg: grayscale image with %d channels\n", cinfo->output_components));
+      i_push_errorf(0, "grayscale image with invalid components %d", cinfo->output_components);
       return NULL;
     }
-    transfer_f = transfer_gray;
-    break;
+    return transfer_gray;
   
   case JCS_RGB:
-    transfer_f = transfer_rgb;
-    if (cinfo.output_components != 3) {
-      mm_log((1, "i_readjpeg: RGB image with %d channels\n", cinfo.output_components));
-      i_push_errorf(0, "RGB image with invalid components %d", cinfo.output_components);
-      wiol_term_source(&cinfo);
-      jpeg_destroy_decompress(&cinfo);
+    if (cinfo->output_components != 3) {
+      mm_log((1, "i_readjpeg: RGB image with %d channels\n", cinfo->output_components));
+      i_push_errorf(0, "RGB image with invalid components %d", cinfo->output_components);
       return NULL;
     }
-    break;
+    return transfer_rgb;
 
   case JCS_CMYK:
-    if (cinfo.output_components == 4) {
+    if (cinfo->output_components == 4) {
       /* we treat the CMYK values as inverted, because that's what that
 	 buggy photoshop does, and everyone has to follow the gorilla.
 
 	 Is there any app that still produces correct CMYK JPEGs?
       */
-      transfer_f = transfer_cmyk_inverted;
-      channels = 3;
+      *channels = 3;
+      return transfer_cmyk_inverted;
     }
     else {
-      mm_log((1, "i_readjpeg: cmyk image with %d channels\n", cinfo.output_components));
-      i_push_errorf(0, "CMYK image with invalid components %d", cinfo.output_components);
-      wiol_term_source(&cinfo);
-      jpeg_destroy_decompress(&cinfo);
+      mm_log((1, "i_readjpeg: cmyk image with %d channels\n", cinfo->output_components));
+      i_push_errorf(0, "CMYK image with invalid components %d", cinfo->output_components);
       return NULL;
     }
-    break;
 
   default:
-    mm_log((1, "i_readjpeg: unknown color space %d\n", cinfo.out_color_space));
-    i_push_errorf(0, "Unknown color space %d", cinfo.out_color_space);
-    wiol_term_source(&cinfo);
-    jpeg_destroy_decompress(&cinfo);
+    mm_log((1, "i_readjpeg: unknown color space %d\n", cinfo->out_color_space));
+    i_push_errorf(0, "Unknown color space %d", cinfo->out_color_space);
     return NULL;
   }
+}
 
-  if (!i_int_check_image_file_limits(cinfo.output_width, cinfo.output_height,
-				     channels, sizeof(i_sample_t))) {
-    mm_log((1, "i_readjpeg: image size exceeds limits\n"));
-    wiol_term_source(&cinfo);
-    jpeg_destroy_decompress(&cinfo);
-    return NULL;
-  }
+/*
+Set the tags for an image read from C<cinfo> from the saved markers
+and the header.  If C<iptc_itext> is non-NULL it's set to a copy of
+any IPTC data.
+*/
 
-  im = i_img_8_new(cinfo.output_width, cinfo.output_height, channels);
-  if (!im) {
-    wiol_term_source(&cinfo);
-    jpeg_destroy_decompress(&cinfo);
-    return NULL;
-  }
-  row_stride = cinfo.output_width * cinfo.output_components;
-  buffer = (*cinfo.mem->alloc_sarray) ((j_common_ptr) &cinfo, JPOOL_IMAGE, row_stride, 1);
-  line_buffer = mymalloc(sizeof(i_color) * cinfo.output_width);
-  while (cinfo.output_scanline < cinfo.output_height) {
-    (void) jpeg_read_scanlines(&cinfo, buffer, 1);
-    transfer_f(line_buffer, buffer, cinfo.output_width);
-    i_plin(im, 0, cinfo.output_width, cinfo.output_scanline-1, line_buffer);
-  }
-  myfree(line_buffer);
-  line_buffer = NULL;
+static void
+jpeg_set_tags(i_img *im, j_decompress_ptr cinfo, int scale_denom,
+	      char **iptc_itext, int *itlength) {
+  jpeg_saved_marker_ptr markerp;
+  int seen_exif = 0;
 
   /* check for APP1 marker and save */
-  markerp = cinfo.marker_list;
+  markerp = cinfo->marker_list;
   while (markerp != NULL) {
     if (markerp->marker == JPEG_COM) {
       i_tags_set(&im->tags, "jpeg_comment", (const char *)markerp->data,
@@ -497,7 +556,7 @@ i_readjpeg_wiol(io_glue *data, int length, char** iptc_itext, int *itlength) {
     else if (markerp->marker == JPEG_APP1 && !seen_exif) {
       seen_exif = i_int_decode_exif(im, markerp->data, markerp->data_length);
     }
-    else if (markerp->marker == JPEG_APP13) {
+    else if (markerp->marker == JPEG_APP13 && iptc_itext) {
       *iptc_itext = mymalloc(markerp->data_length);
       memcpy(*iptc_itext, markerp->data, markerp->data_length);
       *itlength = markerp->data_length;
@@ -506,15 +565,15 @@ i_readjpeg_wiol(io_glue *data, int length, char** iptc_itext, int *itlength) {
     markerp = markerp->next;
   }
 
-  i_tags_setn(&im->tags, "jpeg_out_color_space", cinfo.out_color_space);
-  i_tags_setn(&im->tags, "jpeg_color_space", cinfo.jpeg_color_space);
+  i_tags_setn(&im->tags, "jpeg_out_color_space", cinfo->out_color_space);
+  i_tags_setn(&im->tags, "jpeg_color_space", cinfo->jpeg_color_space);
 
-  if (cinfo.saw_JFIF_marker) {
-    double xres = cinfo.X_density;
-    double yres = cinfo.Y_density;
+  if (cinfo->saw_JFIF_marker) {
+    double xres = cinfo->X_density;
+    double yres = cinfo->Y_density;
     
-    i_tags_setn(&im->tags, "jpeg_density_unit", cinfo.density_unit);
-    switch (cinfo.density_unit) {
+    i_tags_setn(&im->tags, "jpeg_density_unit", cinfo->density_unit);
+    switch (cinfo->density_unit) {
     case 0: /* values are just the aspect ratio */
       i_tags_setn(&im->tags, "i_aspect_only", 1);
       i_tags_set(&im->tags, "jpeg_density_unit_name", "none", -1);
@@ -540,14 +599,288 @@ i_readjpeg_wiol(io_glue *data, int length, char** iptc_itext, int *itlength) {
    * thing.
    */
   i_tags_setn(&im->tags, "jpeg_progressive", 
-	      cinfo.progressive_mode ? 1 : 0);
+	      cinfo->progressive_mode ? 1 : 0);
+  i_tags_setn(&im->tags, "jpeg_scale_denom", scale_denom);
+
+  i_tags_set(&im->tags, "i_format", "jpeg", 4);
+}
+
+/*
+=item i_readjpeg_opts_wiol(data, length, iptc_itext, itlength, opts)
+
+Read a JPEG image, with C<opts> controlling how libjpeg decodes it,
+trading quality for speed.
+
+C<< opts->scale_denom >> is 1, 2, 4 or 8 to have libjpeg scale the
+image to that fraction of the full size while decoding, which skips
+most of the work of decoding the full size image.
+
+If either of C<< opts->max_width >> or C<< opts->max_height >> is
+positive the image is decoded at the smallest of those fractions that
+still has at least that many columns or rows.  If C<scale_denom> is
+also more than 1 the larger of the two sizes is used.
+
+The denominator used is stored in the C<jpeg_scale_denom> tag.
+
+C<< opts->dct_method >> selects the inverse DCT, one of
+C<i_jpeg_dct_default>, C<i_jpeg_dct_int>, C<i_jpeg_dct_fast> or
+C<i_jpeg_dct_float>.
+
+Setting C<< opts->fancy_upsampling >> or C<< opts->block_smoothing >>
+to zero turns off libjpeg's smooth chroma upsampling or the smoothing
+of progressive images decoded before all scans have arrived.
+
+Returns NULL if C<scale_denom> or C<dct_method> is invalid.
+
+=cut
+*/
+i_img*
+i_readjpeg_opts_wiol(io_glue *data, int length, char** iptc_itext,
+		     int *itlength, const i_jpeg_read_options *opts) {
+  i_img * volatile im = NULL;
+  i_color * volatile line_buffer = NULL;
+  struct jpeg_decompress_struct cinfo;
+  struct my_error_mgr jerr;
+  JSAMPARRAY buffer;		/* Output row buffer */
+  int row_stride;		/* physical row width in output buffer */
+  transfer_function_t transfer_f;
+  int channels;
+  volatile int src_set = 0;
+  int scale_denom;
+
+  mm_log((1,"i_readjpeg_opts_wiol(data %p, length %d,iptc_itext %p, opts %p)\n", data, length, iptc_itext, opts));
+
+  i_clear_error();
+
+  if (!jpeg_check_options(opts))
+    return NULL;
+
+  *iptc_itext = NULL;
+  *itlength = 0;
+
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit     = my_error_exit;
+  jerr.pub.output_message = my_output_message;
+
+  /* Set error handler */
+  if (setjmp(jerr.setjmp_buffer)) {
+    if (src_set)
+      wiol_term_source(&cinfo);
+    jpeg_destroy_decompress(&cinfo); 
+    if (line_buffer)
+      myfree(line_buffer);
+    if (im)
+      i_img_destroy(im);
+    return NULL;
+  }
+  
+  jpeg_create_decompress(&cinfo);
+  jpeg_save_markers(&cinfo, JPEG_APP13, 0xFFFF);
+  jpeg_save_markers(&cinfo, JPEG_APP1, 0xFFFF);
+  jpeg_save_markers(&cinfo, JPEG_COM, 0xFFFF);
+  jpeg_wiol_src(&cinfo, data, length);
+  src_set = 1;
+
+  (void) jpeg_read_header(&cinfo, TRUE);
+
+  scale_denom = jpeg_apply_options(&cinfo, opts);
+
+  (void) jpeg_start_decompress(&cinfo);
+
+  transfer_f = jpeg_transfer_for(&cinfo, &channels);
+  if (!transfer_f) {
+    wiol_term_source(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return NULL;
+  }
+
+  if (!i_int_check_image_file_limits(cinfo.output_width, cinfo.output_height,
+				     channels, sizeof(i_sample_t))) {
+    mm_log((1, "i_readjpeg: image size exceeds limits\n"));
+    wiol_term_source(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return NULL;
+  }
+
+  im = i_img_8_new(cinfo.output_width, cinfo.output_height, channels);
+  if (!im) {
+    wiol_term_source(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return NULL;
+  }
+  row_stride = cinfo.output_width * cinfo.output_components;
+#if BITS_IN_JSAMPLE == 8
+  if (!im->virtual && im->type == i_direct_type && im->bits == i_8_bits
+      && im->channels == cinfo.output_components) {
+    /* libjpeg produces the samples in the same order we store them,
+       so decode straight into the image, as many rows at a time as
+       libjpeg can return */
+    JSAMPROW rows[JPEG_MAX_ROWS];
+    int row_count = cinfo.rec_outbuf_height < JPEG_MAX_ROWS
+      ? cinfo.rec_outbuf_height : JPEG_MAX_ROWS;
+    int i;
+
+    while (cinfo.output_scanline < cinfo.output_height) {
+      int count = row_count;
+      if (count > cinfo.output_height - cinfo.output_scanline)
+	count = cinfo.output_height - cinfo.output_scanline;
+      for (i = 0; i < count; ++i)
+	rows[i] = im->idata + (size_t)(cinfo.output_scanline + i) * row_stride;
+      (void) jpeg_read_scanlines(&cinfo, rows, count);
+    }
+  }
+  else
+#endif
+  {
+    buffer = (*cinfo.mem->alloc_sarray) ((j_common_ptr) &cinfo, JPOOL_IMAGE, row_stride, 1);
+    line_buffer = mymalloc(sizeof(i_color) * cinfo.output_width);
+    while (cinfo.output_scanline < cinfo.output_height) {
+      (void) jpeg_read_scanlines(&cinfo, buffer, 1);
+      transfer_f(line_buffer, buffer, cinfo.output_width);
+      i_plin(im, 0, cinfo.output_width, cinfo.output_scanline-1, line_buffer);
+    }
+    myfree(line_buffer);
+    line_buffer = NULL;
+  }
+
+  jpeg_set_tags(im, &cinfo, scale_denom, iptc_itext, itlength);
 
   (void) jpeg_finish_decompress(&cinfo);
   jpeg_destroy_decompress(&cinfo);
 
-  i_tags_set(&im->tags, "i_format", "jpeg", 4);
+  mm_log((1,"i_readjpeg_opts_wiol -> (%p)\n",im));
+  return im;
+}
+
+/* state for a i_readjpeg_rows_wiol() image */
+typedef struct {
+  struct jpeg_decompress_struct cinfo;
+  struct my_error_mgr jerr;
+  transfer_function_t transfer_f;
+  int channels;
+  JSAMPARRAY buffer;
+  i_color *line_buffer;
+} jpeg_rows;
+
+static int
+jpeg_rows_read(void *data, i_img_dim y, i_sample_t *samps) {
+  jpeg_rows *rows = data;
+  j_decompress_ptr cinfo = &rows->cinfo;
+
+  if (setjmp(rows->jerr.setjmp_buffer)) {
+    /* my_output_message() pushed the error */
+    return 0;
+  }
+
+#if BITS_IN_JSAMPLE == 8
+  if (rows->channels == cinfo->output_components) {
+    JSAMPROW row = samps;
+    (void) jpeg_read_scanlines(cinfo, &row, 1);
+  }
+  else
+#endif
+  {
+    i_img_dim x;
+    int ch;
+
+    (void) jpeg_read_scanlines(cinfo, rows->buffer, 1);
+    rows->transfer_f(rows->line_buffer, rows->buffer, cinfo->output_width);
+    for (x = 0; x < cinfo->output_width; ++x) {
+      for (ch = 0; ch < rows->channels; ++ch)
+	*samps++ = rows->line_buffer[x].channel[ch];
+    }
+  }
+
+  return 1;
+}
+
+static void
+jpeg_rows_destroy(void *data) {
+  jpeg_rows *rows = data;
+
+  wiol_term_source(&rows->cinfo);
+  jpeg_destroy_decompress(&rows->cinfo);
+  if (rows->line_buffer)
+    myfree(rows->line_buffer);
+  myfree(rows);
+}
+
+/*
+=item i_readjpeg_rows_wiol(data, opts)
+
+Read the header of a JPEG image and return a read-only row image (see
+im_img_rows_new()) that decodes each row from C<data> as it is
+requested, with C<opts> as for i_readjpeg_opts_wiol().
+
+Only a few rows of the image are held in memory at once, mostly the
+buffers libjpeg itself needs.  Progressive images still need libjpeg
+to buffer the whole image's coefficients.
+
+The tags are set as i_readjpeg_opts_wiol() sets them, except that no
+IPTC data is returned.
+
+C<data> must stay open until the image is destroyed.
+
+=cut
+*/
+
+i_img *
+i_readjpeg_rows_wiol(io_glue *data, const i_jpeg_read_options *opts) {
+  jpeg_rows *rows;
+  i_img *im;
+  int scale_denom;
+  int channels;
+
+  mm_log((1,"i_readjpeg_rows_wiol(data %p, opts %p)\n", data, opts));
+
+  i_clear_error();
+
+  if (!jpeg_check_options(opts))
+    return NULL;
+
+  rows = mymalloc(sizeof(jpeg_rows));
+  rows->line_buffer = NULL;
+  rows->cinfo.err = jpeg_std_error(&rows->jerr.pub);
+  rows->jerr.pub.error_exit     = my_error_exit;
+  rows->jerr.pub.output_message = my_output_message;
+
+  if (setjmp(rows->jerr.setjmp_buffer)) {
+    jpeg_rows_destroy(rows);
+    return NULL;
+  }
+
+  jpeg_create_decompress(&rows->cinfo);
+  jpeg_save_markers(&rows->cinfo, JPEG_APP1, 0xFFFF);
+  jpeg_save_markers(&rows->cinfo, JPEG_COM, 0xFFFF);
+  jpeg_wiol_src(&rows->cinfo, data, -1);
+
+  (void) jpeg_read_header(&rows->cinfo, TRUE);
+
+  scale_denom = jpeg_apply_options(&rows->cinfo, opts);
+
+  (void) jpeg_start_decompress(&rows->cinfo);
+
+  rows->transfer_f = jpeg_transfer_for(&rows->cinfo, &channels);
+  if (!rows->transfer_f
+      || !i_int_check_image_file_limits(rows->cinfo.output_width,
+					rows->cinfo.output_height,
+					channels, sizeof(i_sample_t))) {
+    jpeg_rows_destroy(rows);
+    return NULL;
+  }
+  rows->channels = channels;
+  rows->buffer = (*rows->cinfo.mem->alloc_sarray)
+    ((j_common_ptr) &rows->cinfo, JPOOL_IMAGE,
+     rows->cinfo.output_width * rows->cinfo.output_components, 1);
+  rows->line_buffer = mymalloc(sizeof(i_color) * rows->cinfo.output_width);
+
+  im = i_img_rows_new(rows->cinfo.output_width, rows->cinfo.output_height,
+		      channels, 1, jpeg_rows_read, jpeg_rows_destroy, rows);
+  if (!im)
+    return NULL;
+
+  jpeg_set_tags(im, &rows->cinfo, scale_denom, NULL, NULL);
 
-  mm_log((1,"i_readjpeg_wiol -> (%p)\n",im));
   return im;
 }
 
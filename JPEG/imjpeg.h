@@ -6,6 +6,31 @@
 i_img*
 i_readjpeg_wiol(io_glue *data, int length, char** iptc_itext, int *itlength);
 
+typedef enum {
+  i_jpeg_dct_default = -1,
+  i_jpeg_dct_int,
+  i_jpeg_dct_fast,
+  i_jpeg_dct_float
+} i_jpeg_dct_method;
+
+typedef struct {
+  int scale_denom;
+  i_img_dim max_width, max_height;
+  i_jpeg_dct_method dct_method;
+  int fancy_upsampling;
+  int block_smoothing;
+} i_jpeg_read_options;
+
+void
+i_jpeg_read_options_init(i_jpeg_read_options *opts);
+
+i_img*
+i_readjpeg_opts_wiol(io_glue *data, int length, char** iptc_itext,
+		     int *itlength, const i_jpeg_read_options *opts);
+
+i_img*
+i_readjpeg_rows_wiol(io_glue *data, const i_jpeg_read_options *opts);
+
 undef_int
 i_writejpeg_wiol(i_img *im, io_glue *ig, int qfactor);
 
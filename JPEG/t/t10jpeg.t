@@ -2,7 +2,8 @@
 use strict;
 use Imager qw(:all);
 use Test::More;
-use Imager::Test qw(is_color_close3 test_image_raw test_image is_image);
+use Imager::Test qw(is_color_close3 test_image_raw test_image is_image
+                    is_image_similar);
 
 -d "testout" or mkdir "testout";
 
@@ -11,7 +12,7 @@ init_log("testout/t101jpeg.log",1);
 $Imager::formats{"jpeg"}
   or plan skip_all => "no jpeg support";
 
-plan tests => 103;
+plan tests => 177;
 
 print STDERR "libjpeg version: ", Imager::File::JPEG::i_libjpeg_version(), "\n";
 
@@ -450,3 +451,128 @@ SKIP:
     like($im->errstr, qr/synthetic close failure/,
 	 "check error message");
 }
+
+{ # scaling while reading
+  my $im = test_image();
+  my $data;
+  ok($im->write(data => \$data, type => "jpeg", jpegquality => 95),
+     "write image to scale on read");
+
+  my $full = Imager->new(data => $data, type => "jpeg");
+  ok($full, "read at full size");
+  is($full->tags(name => "jpeg_scale_denom"), 1, "full size denominator");
+
+  for my $test ([ "jpeg_scale 0.25", [ jpeg_scale => 0.25 ], 4, 38, 38 ],
+		[ "jpeg_scale 1/8", [ jpeg_scale => "1/8" ], 8, 19, 19 ],
+		[ "jpeg_scale 0.3", [ jpeg_scale => 0.3 ], 2, 75, 75 ],
+		[ "jpeg_max_width 40", [ jpeg_max_width => 40 ], 2, 75, 75 ],
+		[ "jpeg_max_width 38", [ jpeg_max_width => 38 ], 4, 38, 38 ],
+		[ "jpeg_max_height 1", [ jpeg_max_height => 1 ], 8, 19, 19 ],
+		[ "jpeg_scale and jpeg_max_width",
+		  [ jpeg_scale => 0.125, jpeg_max_width => 40 ], 2, 75, 75 ]) {
+    my ($name, $opts, $denom, $width, $height) = @$test;
+    my $scaled = Imager->new(data => $data, type => "jpeg", @$opts);
+    ok($scaled, "$name: read")
+      or diag(Imager->errstr);
+    is($scaled->getwidth, $width, "$name: width");
+    is($scaled->getheight, $height, "$name: height");
+    is($scaled->tags(name => "jpeg_scale_denom"), $denom,
+       "$name: denominator");
+  }
+
+  # compare whole 4x4 blocks, the last row and column only have 2
+  my $quarter = Imager->new(data => $data, type => "jpeg", jpeg_scale => 0.25)
+    ->crop(right => 37, bottom => 37);
+  my $cmp = $full->crop(right => 148, bottom => 148)
+    ->scale(scalefactor => 0.25, qtype => "mixing");
+  is_image_similar($quarter, $cmp, 37 * 37 * 3 * 16,
+		   "scaled read similar to scaling after reading");
+
+  for my $scale (0, 2, -1, "x") {
+    ok(!Imager->new(data => $data, type => "jpeg", jpeg_scale => $scale),
+       "jpeg_scale $scale should fail");
+    like(Imager->errstr, qr/jpeg_scale must be a number/, "check message");
+  }
+}
+
+{ # decoder speed controls
+  my $im = test_image();
+  my $data;
+  ok($im->write(data => \$data, type => "jpeg", jpegquality => 90),
+     "write image to test decoder options");
+  my $norm = Imager->new(data => $data, type => "jpeg");
+  ok($norm, "read with defaults");
+
+  my $int = Imager->new(data => $data, type => "jpeg", jpeg_dct => "int");
+  is_image($int, $norm, "int DCT is the default");
+  for my $test ([ "fast DCT", jpeg_dct => "fast" ],
+		[ "float DCT", jpeg_dct => "float" ],
+		[ "no fancy upsampling", jpeg_fancy_upsampling => 0 ],
+		[ "no block smoothing", jpeg_block_smoothing => 0 ],
+		[ "all fast", jpeg_dct => "fast", jpeg_fancy_upsampling => 0,
+		  jpeg_block_smoothing => 0 ]) {
+    my ($name, @opts) = @$test;
+    my $fast = Imager->new(data => $data, type => "jpeg", @opts);
+    ok($fast, "$name: read")
+      or diag(Imager->errstr);
+    # chroma upsampled without smoothing differs most on sharp edges
+    is_image_similar($fast, $norm, 150 * 150 * 3 * 64, "$name: similar");
+  }
+
+  ok(!Imager->new(data => $data, type => "jpeg", jpeg_dct => "slow"),
+     "unknown DCT method fails");
+  is(Imager->errstr, "jpeg_dct must be one of fast, float, int",
+     "check message");
+
+  my $gray = $im->convert(preset => "gray");
+  ok($gray->write(data => \$data, type => "jpeg"), "write gray");
+  my $rdgray = Imager->new(data => $data, type => "jpeg",
+			   jpeg_fancy_upsampling => 0);
+  ok($rdgray, "read gray without fancy upsampling");
+  is($rdgray->getchannels, 1, "still gray");
+  is_image_similar($rdgray, $gray, 150 * 150 * 16, "gray similar");
+}
+
+{ # decoding rows as they're read
+  my $im = test_image();
+  ok($im->write(data => \my $data, type => "jpeg"), "write image for rows");
+  my $full = Imager->new(data => $data, type => "jpeg");
+
+  my $rows = Imager->new;
+  ok($rows->_read_rows(data => $data), "read jpeg as rows")
+    or diag $rows->errstr;
+  ok($rows->virtual, "rows are decoded as needed");
+  is($rows->tags(name => "i_format"), "jpeg", "check i_format tag");
+  is_image($rows, $full, "same as a normal read");
+
+  $rows = Imager->new;
+  ok($rows->_read_rows(data => $data, jpeg_scale => 0.25,
+		       jpeg_dct => "fast"),
+     "read rows at 1/4 size");
+  is($rows->tags(name => "jpeg_scale_denom"), 4, "check denominator");
+  is_image($rows, Imager->new(data => $data, jpeg_scale => 0.25,
+			      jpeg_dct => "fast"),
+	   "same as a normal scaled read");
+
+  $rows = Imager->new;
+  ok(!$rows->_read_rows(data => $data, jpeg_dct => "slow"),
+     "rows: bad option fails");
+
+  for my $file (qw(testimg/scmyk.jpg testimg/exiftest.jpg)) {
+    my $rows = Imager->new;
+    ok($rows->_read_rows(file => $file), "read $file as rows")
+      or diag $rows->errstr;
+    is_image($rows, Imager->new(file => $file), "$file: same as normal read");
+  }
+
+  require Imager::Pipeline;
+  my $pipe = Imager::Pipeline->new;
+  ok($pipe->read(data => $data)
+     && $pipe->scale(xpixels => 40)
+     && $pipe->write(data => \my $out, type => "pnm"),
+     "pipeline from a jpeg")
+    or diag $pipe->errstr;
+  is_image(Imager->new(data => $out),
+	   $full->scale(xpixels => 40, qtype => "mixing"),
+	   "pipeline result matches scale()");
+}
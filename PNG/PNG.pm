@@ -4,7 +4,7 @@ use Imager;
 use vars qw($VERSION @ISA);
 
 BEGIN {
-  $VERSION = "0.89";
+  $VERSION = "0.90";
 
   require XSLoader;
   XSLoader::load('Imager::File::PNG', $VERSION);
@@ -21,6 +21,20 @@ Imager->register_reader
        and $flags |= IMPNG_READ_IGNORE_BENIGN_ERRORS;
      $im->{IMG} = i_readpng_wiol($io, $flags);
 
+     unless ($im->{IMG}) {
+       $im->_set_error(Imager->_error_as_msg);
+       return;
+     }
+     return $im;
+   },
+   rows =>
+   sub {
+     my ($im, $io, %hsh) = @_;
+     my $flags = 0;
+     $hsh{png_ignore_benign_errors}
+       and $flags |= IMPNG_READ_IGNORE_BENIGN_ERRORS;
+     $im->{IMG} = i_readpng_rows_wiol($io, $flags);
+
      unless ($im->{IMG}) {
        $im->_set_error(Imager->_error_as_msg);
        return;
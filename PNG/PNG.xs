@@ -18,6 +18,11 @@ i_readpng_wiol(ig, flags=0)
         Imager::IO     ig
 	int 	       flags
 
+Imager::ImgRaw
+i_readpng_rows_wiol(ig, flags=0)
+        Imager::IO     ig
+	int 	       flags
+
 undef_int
 i_writepng_wiol(im, ig)
     Imager::ImgRaw     im
@@ -22,6 +22,14 @@ read_paletted(png_structp png_ptr, png_infop info_ptr, int channels, i_img_dim w
 static i_img *
 read_bilevel(png_structp png_ptr, png_infop info_ptr, i_img_dim width, i_img_dim height);
 
+typedef struct {
+  char *warnings;
+} i_png_read_state, *i_png_read_statep;
+
+static i_img *
+read_rows(png_structp png_ptr, png_infop info_ptr, i_png_read_statep rs,
+	  i_img_dim width, i_img_dim height, int bit_depth, int color_type);
+
 static int
 write_direct8(png_structp png_ptr, png_infop info_ptr, i_img *im);
 
@@ -289,18 +297,46 @@ i_writepng_wiol(i_img *im, io_glue *ig) {
   return(1);
 }
 
-typedef struct {
-  char *warnings;
-} i_png_read_state, *i_png_read_statep;
-
 static void
 read_warn_handler(png_structp, png_const_charp);
 
 static void
 cleanup_read_state(i_png_read_statep);
 
+static i_img *
+read_png(io_glue *ig, int flags, int want_rows);
+
 i_img*
 i_readpng_wiol(io_glue *ig, int flags) {
+  return read_png(ig, flags, 0);
+}
+
+/*
+=item i_readpng_rows_wiol(ig, flags)
+
+Read the header of a PNG image and return a read-only row image (see
+im_img_rows_new()) that decodes each row from C<ig> as it is
+requested.
+
+The image always has 8-bit samples, palette images are expanded to
+RGB and a tRNS chunk to an alpha channel.  Text chunks after the
+image data aren't available as tags.
+
+Interlaced images can't be decoded a row at a time, so they are read
+completely, as i_readpng_wiol() does.
+
+C<ig> must stay open until the image is destroyed.
+
+=cut
+*/
+
+i_img *
+i_readpng_rows_wiol(io_glue *ig, int flags) {
+  return read_png(ig, flags, 1);
+}
+
+static i_img *
+read_png(io_glue *ig, int flags, int want_rows) {
   i_img *im = NULL;
   png_structp png_ptr;
   png_infop info_ptr;
@@ -313,7 +349,8 @@ i_readpng_wiol(io_glue *ig, int flags) {
   rs.warnings = NULL;
   sig_read  = 0;
 
-  mm_log((1,"i_readpng_wiol(ig %p)\n", ig));
+  mm_log((1,"i_readpng_wiol(ig %p, flags %d, want_rows %d)\n", ig, flags,
+	  want_rows));
   i_clear_error();
 
   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, &rs, 
@@ -380,6 +417,13 @@ i_readpng_wiol(io_glue *ig, int flags) {
     return NULL;
   }
 
+  if (want_rows && interlace_type == PNG_INTERLACE_NONE) {
+    im = read_rows(png_ptr, info_ptr, &rs, width, height, bit_depth,
+		   color_type);
+    mm_log((1,"(%p) <- i_readpng_wiol\n", im));
+    return im;
+  }
+
   if (color_type == PNG_COLOR_TYPE_PALETTE) {
     im = read_paletted(png_ptr, info_ptr, channels, width, height);
   }
@@ -471,6 +515,73 @@ read_direct8(png_structp png_ptr, png_infop info_ptr, int channels,
   return im;
 }
 
+/* state for a i_readpng_rows_wiol() image */
+typedef struct {
+  png_structp png_ptr;
+  png_infop info_ptr;
+  i_png_read_state rs;
+} png_rows;
+
+static int
+png_rows_read(void *data, i_img_dim y, i_sample_t *samps) {
+  png_rows *rows = data;
+
+  if (setjmp(png_jmpbuf(rows->png_ptr))) {
+    /* error_handler() pushed the error */
+    return 0;
+  }
+
+  png_read_row(rows->png_ptr, (png_bytep)samps, NULL);
+
+  return 1;
+}
+
+static void
+png_rows_destroy(void *data) {
+  png_rows *rows = data;
+
+  png_destroy_read_struct(&rows->png_ptr, &rows->info_ptr, (png_infopp)NULL);
+  cleanup_read_state(&rows->rs);
+  myfree(rows);
+}
+
+/*
+Set up libpng to expand each row of a non-interlaced image to 8-bit
+samples and return a row image that reads them as requested.
+
+The row image takes over png_ptr, info_ptr and the read state.
+*/
+
+static i_img *
+read_rows(png_structp png_ptr, png_infop info_ptr, i_png_read_statep rs,
+	  i_img_dim width, i_img_dim height, int bit_depth, int color_type) {
+  png_rows *rows;
+  i_img *im;
+
+  png_set_strip_16(png_ptr);
+  png_set_packing(png_ptr);
+  /* palette to RGB, low bit gray to 8 bits and tRNS to alpha */
+  png_set_expand(png_ptr);
+  png_read_update_info(png_ptr, info_ptr);
+
+  rows = mymalloc(sizeof(png_rows));
+  rows->png_ptr = png_ptr;
+  rows->info_ptr = info_ptr;
+  rows->rs = *rs;
+  png_set_error_fn(png_ptr, &rows->rs, error_handler, read_warn_handler);
+
+  im = i_img_rows_new(width, height, png_get_channels(png_ptr, info_ptr), 1,
+		      png_rows_read, png_rows_destroy, rows);
+  if (!im)
+    return NULL;
+
+  get_png_tags(im, png_ptr, info_ptr, bit_depth, color_type);
+  if (rows->rs.warnings)
+    i_tags_set(&im->tags, "png_warnings", rows->rs.warnings, -1);
+
+  return im;
+}
+
 static i_img *
 read_direct16(png_structp png_ptr, png_infop info_ptr, int channels,
 	     i_img_dim width, i_img_dim height) {
@@ -4,6 +4,7 @@
 #include "imext.h"
 
 i_img    *i_readpng_wiol(io_glue *ig, int flags);
+i_img    *i_readpng_rows_wiol(io_glue *ig, int flags);
 
 #define IMPNG_READ_IGNORE_BENIGN_ERRORS 1
 
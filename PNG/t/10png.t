@@ -2,7 +2,7 @@
 use strict;
 use Imager qw(:all);
 use Test::More;
-use Imager::Test qw(test_image_raw test_image is_image is_imaged test_image_16 test_image_double);
+use Imager::Test qw(test_image_raw test_image is_image is_image_similar is_imaged test_image_16 test_image_double);
 
 my $debug_writes = 1;
 
@@ -10,7 +10,7 @@ my $debug_writes = 1;
 
 init_log("testout/t102png.log",1);
 
-plan tests => 249;
+plan tests => 274;
 
 # this loads Imager::File::PNG too
 ok($Imager::formats{"png"}, "must have png format");
@@ -780,6 +780,42 @@ SKIP:
   }
 }
 
+{ # decoding rows as they're read
+  require Imager::Pipeline;
+  for my $file (qw(rgb8 gray graya pal paltrans bilevel coverpal
+		   rgb16 cover16 rgb8i)) {
+    my $path = "testimg/$file.png";
+    my $rows = Imager->new;
+    ok($rows->_read_rows(file => $path), "$file: read as rows")
+      or diag $rows->errstr;
+    my $full = Imager->new(file => $path);
+    if ($full->bits == 16) {
+      # libpng drops the low byte
+      is_image_similar($rows, $full,
+		       $full->getwidth * $full->getheight * $full->getchannels,
+		       "$file: similar to normal read");
+    }
+    else {
+      is_image($rows, $full, "$file: same as normal read");
+    }
+  }
+  my $rows = Imager->new;
+  ok($rows->_read_rows(file => "testimg/rgb8i.png"), "read interlaced");
+  ok(!$rows->virtual, "interlaced images are read completely");
+  is($rows->tags(name => "png_interlace"), 1, "check interlace tag");
+
+  my $pipe = Imager::Pipeline->new;
+  ok($pipe->read(file => "testimg/paltrans.png")
+     && $pipe->scale(scalefactor => 0.4)
+     && $pipe->write(data => \my $out, type => "png"),
+     "pipeline from png to png")
+    or diag $pipe->errstr;
+  is_image(Imager->new(data => $out),
+	   Imager->new(file => "testimg/paltrans.png")
+	   ->scale(scalefactor => 0.4, qtype => "mixing"),
+	   "pipeline result matches scale()");
+}
+
 sub limited_write {
   my ($limit) = @_;
 
@@ -45,6 +45,13 @@ im_context_new(void) {
     return NULL;
   }
 
+  i_rand_seed(&ctx->rand_state, 0, 0);
+
+  ctx->thread_count = 1;
+  ctx->pool = NULL;
+  ctx->pool_busy = 0;
+  ctx->pool_mutex = i_mutex_new();
+
   ctx->refcount = 1;
 
 #ifdef IMAGER_TRACE_CONTEXT
@@ -115,6 +122,10 @@ im_context_refdec(im_context_t ctx, const char *where) {
 
   free(ctx->slots);
 
+  if (ctx->pool)
+    im_thread_pool_destroy(ctx->pool);
+  i_mutex_destroy(ctx->pool_mutex);
+
   for (i = 0; i < IM_ERROR_COUNT; ++i) {
     if (ctx->error_stack[i].msg)
       myfree(ctx->error_stack[i].msg);
@@ -181,6 +192,14 @@ im_context_clone(im_context_t ctx, const char *where) {
   nctx->max_height = ctx->max_height;
   nctx->max_bytes = ctx->max_bytes;
 
+  nctx->rand_state = ctx->rand_state;
+
+  /* the pool is started when the clone first needs it */
+  nctx->thread_count = ctx->thread_count;
+  nctx->pool = NULL;
+  nctx->pool_busy = 0;
+  nctx->pool_mutex = i_mutex_new();
+
   nctx->refcount = 1;
 
 #ifdef IMAGER_TRACE_CONTEXT
@@ -287,3 +306,189 @@ im_context_slot_get(im_context_t ctx, im_slot_t slot) {
 
   return ctx->slots[slot];
 }
+
+/*
+=item im_context_set_threads(ctx, count)
+=synopsis if (!im_context_set_threads(aIMCTX, 4)) { ... error ... }
+
+Set the number of threads, including the calling thread, that
+im_parallel_for() splits work across for this context.  The default
+is 1, doing all work in the calling thread.
+
+Returns true on success.  Returns false and pushes an error if
+C<count> is out of range, if the worker threads can't be started, or
+if this build of Imager doesn't support threads.
+
+=cut
+*/
+
+int
+im_context_set_threads(im_context_t ctx, int count) {
+  im_thread_pool_t pool = NULL;
+  im_thread_pool_t old_pool;
+
+  im_clear_error(ctx);
+
+  if (count < 1 || count > IM_MAX_THREADS) {
+    im_push_errorf(ctx, 0, "thread count must be from 1 to %d",
+		   IM_MAX_THREADS);
+    return 0;
+  }
+
+  if (count > 1) {
+    pool = im_thread_pool_new(ctx, count - 1);
+    if (!pool)
+      return 0;
+  }
+
+  i_mutex_lock(ctx->pool_mutex);
+  if (ctx->pool_busy) {
+    i_mutex_unlock(ctx->pool_mutex);
+    if (pool)
+      im_thread_pool_destroy(pool);
+    im_push_error(ctx, 0, "cannot change the thread count while threads are running");
+    return 0;
+  }
+  old_pool = ctx->pool;
+  ctx->pool = pool;
+  ctx->thread_count = count;
+  i_mutex_unlock(ctx->pool_mutex);
+
+  if (old_pool)
+    im_thread_pool_destroy(old_pool);
+
+  return 1;
+}
+
+/*
+=item im_context_get_threads(ctx)
+=synopsis int threads = im_context_get_threads(aIMCTX);
+
+Return the number of threads set by im_context_set_threads().
+
+=cut
+*/
+
+int
+im_context_get_threads(im_context_t ctx) {
+  return ctx->thread_count;
+}
+
+/*
+=item im_parallel_for(ctx, start, end, min_band, f, data)
+=synopsis im_parallel_for(aIMCTX, 0, im->ysize, 16, process_rows, &info);
+
+Split the range C<start> (inclusive) to C<end> (exclusive) into
+contiguous bands of at least C<min_band> indexes, up to one per
+thread set by im_context_set_threads(), and call C<f> for each band,
+concurrently where possible.  Returns when all bands are complete.
+
+If there's only one band, or the context's threads are already busy,
+such as when im_parallel_for() is called from a band callback, C<f>
+is called once for the whole range in the calling thread.
+
+The callback must produce the same result no matter how the range is
+split, must not call back into perl, and shouldn't push errors or
+log, since neither the error stack nor the log is safe to use from
+several threads.
+
+=cut
+*/
+
+void
+im_parallel_for(im_context_t ctx, i_img_dim start, i_img_dim end,
+		i_img_dim min_band, im_parallel_band_f f, void *data) {
+  im_thread_pool_t pool = NULL;
+  i_img_dim bands;
+
+  if (end <= start)
+    return;
+
+  if (min_band < 1)
+    min_band = 1;
+  bands = (end - start + min_band - 1) / min_band;
+  if (bands > ctx->thread_count)
+    bands = ctx->thread_count;
+
+  if (bands > 1) {
+    i_mutex_lock(ctx->pool_mutex);
+    if (!ctx->pool_busy) {
+      if (!ctx->pool)
+	ctx->pool = im_thread_pool_new(ctx, ctx->thread_count - 1);
+      if (ctx->pool) {
+	pool = ctx->pool;
+	ctx->pool_busy = 1;
+      }
+    }
+    i_mutex_unlock(ctx->pool_mutex);
+  }
+
+  if (pool) {
+    im_thread_pool_run(pool, f, data, start, end, (int)bands);
+
+    i_mutex_lock(ctx->pool_mutex);
+    ctx->pool_busy = 0;
+    i_mutex_unlock(ctx->pool_mutex);
+  }
+  else {
+    f(data, start, end);
+  }
+}
+
+/*
+=item im_parallel_malloc(size)
+
+Allocate memory from an im_parallel_for() callback.  Like mymalloc()
+this exits the process if the memory can't be allocated, but it
+doesn't log.
+
+Release the memory with im_parallel_free().
+
+=cut
+*/
+
+void *
+im_parallel_malloc(size_t size) {
+  void *p = malloc(size);
+
+  if (!p) {
+    fprintf(stderr, "Unable to malloc %ld.\n", (long)size);
+    exit(3);
+  }
+
+  return p;
+}
+
+/*
+=item im_parallel_realloc(p, size)
+
+Resize a block from im_parallel_malloc(), or allocate a new block if
+I<p> is NULL, from an im_parallel_for() callback.
+
+=cut
+*/
+
+void *
+im_parallel_realloc(void *p, size_t size) {
+  void *result = realloc(p, size);
+
+  if (!result) {
+    fprintf(stderr, "Unable to realloc %ld.\n", (long)size);
+    exit(3);
+  }
+
+  return result;
+}
+
+/*
+=item im_parallel_free(p)
+
+Release memory allocated with im_parallel_malloc().
+
+=cut
+*/
+
+void
+im_parallel_free(void *p) {
+  free(p);
+}
@@ -171,12 +171,15 @@ undef_int i_flood_cfill_border(i_img *im, i_img_dim seedx, i_img_dim seedy, i_fi
 /* image processing functions */
 
 int i_gaussian    (i_img *im, double stdev);
+int i_gaussian2   (i_img *im, double stdev, i_gauss_method_t method, double iir_threshold);
 int i_conv        (i_img *im,const double *coeff,int len);
+int i_conv2d      (i_img *im, const double *coeff, int xlen, int ylen);
 void i_unsharp_mask(i_img *im, double stddev, double scale);
 
 /* colour manipulation */
 extern i_img *i_convert(i_img *src, const double *coeff, int outchan, int inchan);
 extern void i_map(i_img *im, unsigned char (*maps)[256], unsigned int mask);
+extern int i_apply_levels(i_img *im, const i_level_op *ops, int count);
 
 float i_img_diff   (i_img *im1,i_img *im2);
 double i_img_diffd(i_img *im1,i_img *im2);
@@ -204,15 +207,25 @@ size_t i_tt_glyph_name(TT_Fonthandle *handle, unsigned long ch, char *name_buf,
 
 extern void i_quant_makemap(i_quantize *quant, i_img **imgs, int count);
 extern i_palidx *i_quant_translate(i_quantize *quant, i_img *img);
+extern int i_quant_translate_multi(i_quantize *quant, i_img **imgs, int count, i_palidx **results);
 extern void i_quant_transparent(i_quantize *quant, i_palidx *indices, i_img *img, i_palidx trans_index);
+extern void i_quant_cleanup(i_quantize *quant);
 
 i_img *im_img_pal_new(pIMCTX, i_img_dim x, i_img_dim y, int ch, int maxpal);
 
 extern i_img *i_img_to_pal(i_img *src, i_quantize *quant);
+extern int i_img_to_pal_multi(i_quantize *quant, i_img **imgs, int count, i_img **results);
 extern i_img *i_img_to_rgb(i_img *src);
 extern i_img *i_img_masked_new(i_img *targ, i_img *mask, i_img_dim x, i_img_dim y, 
                                i_img_dim w, i_img_dim h);
 extern i_img *im_img_16_new(pIMCTX, i_img_dim x, i_img_dim y, int ch);
+extern i_img *im_img_rows_new(pIMCTX, i_img_dim xsize, i_img_dim ysize,
+			      int channels, int window,
+			      i_img_rows_read_f read_row,
+			      i_img_rows_destroy_f destroy, void *data);
+extern const char *i_img_rows_error(i_img *im);
+extern i_img *im_img_mmap_new(pIMCTX, i_img_dim x, i_img_dim y, int ch,
+			      int bits, const char *path);
 extern i_img *i_img_to_rgb16(i_img *im);
 extern i_img *im_img_double_new(pIMCTX, i_img_dim x, i_img_dim y, int ch);
 extern i_img *i_img_to_drgb(i_img *im);
@@ -229,6 +242,7 @@ undef_int i_writeraw_wiol(i_img* im, io_glue *ig);
 
 i_img   * i_readpnm_wiol(io_glue *ig, int allow_incomplete);
 i_img   ** i_readpnm_multi_wiol(io_glue *ig, int *count, int allow_incomplete);
+i_img   * i_readpnm_rows_wiol(io_glue *ig);
 undef_int i_writeppm_wiol(i_img *im, io_glue *ig);
 
 extern int    i_writebmp_wiol(i_img *im, io_glue *ig);
@@ -245,6 +259,9 @@ undef_int i_writergb_wiol(i_img *img, io_glue *ig, int wierdpack, int compress,
 i_img * i_scaleaxis(i_img *im, double Value, int Axis);
 i_img * i_scale_nn(i_img *im, double scx, double scy);
 i_img * i_scale_mixing(i_img *src, i_img_dim width, i_img_dim height);
+i_img * i_scale_mixing_float(i_img *src, i_img_dim width, i_img_dim height);
+i_img * i_scale_mixing_rows(i_img *src, i_img_dim width, i_img_dim height);
+i_img * i_scale_kernel(i_img *im, i_img_dim xsize, i_img_dim ysize, i_scale_kernel_t kernel);
 i_img * i_haar(i_img *im);
 int     i_count_colors(i_img *im,int maxc);
 int i_get_anonymous_color_histo(i_img *im, unsigned int **col_usage, int maxc);
@@ -276,6 +293,7 @@ void i_turbnoise(i_img *im,double xo,double yo,double scale);
 void i_gradgen(i_img *im, int num, i_img_dim *xo, i_img_dim *yo, i_color *ival, int dmeasure);
 int i_nearest_color(i_img *im, int num, i_img_dim *xo, i_img_dim *yo, i_color *ival, int dmeasure);
 i_img *i_diff_image(i_img *im, i_img *im2, double mindist);
+int i_diff_bounds(i_img *im, i_img *im2, double mindist, i_img_dim *bounds);
 int
 i_fountain(i_img *im, double xa, double ya, double xb, double yb, 
            i_fountain_type type, i_fountain_repeat repeat, 
@@ -389,6 +407,16 @@ extern im_context_t im_context_clone(im_context_t ctx, const char *where);
 extern im_slot_t im_context_slot_new(im_slot_destroy_t);
 extern void *im_context_slot_get(im_context_t ctx, im_slot_t slot);
 extern int im_context_slot_set(im_context_t ctx, im_slot_t slot, void *);
+extern int im_context_set_threads(im_context_t ctx, int count);
+extern int im_context_get_threads(im_context_t ctx);
+extern void im_context_set_seed(im_context_t ctx, unsigned long seed);
+extern unsigned long im_context_next_seed(im_context_t ctx);
+extern void i_rand_seed(i_rand_state *rs, unsigned long seed, unsigned long stream);
+extern unsigned long i_rand_next(i_rand_state *rs);
+extern double i_rand_double(i_rand_state *rs);
+extern void im_parallel_for(im_context_t ctx, i_img_dim start, i_img_dim end,
+			    i_img_dim min_band, im_parallel_band_f f,
+			    void *data);
 
 extern im_context_t (*im_get_context)(void);
 
@@ -112,6 +112,48 @@ i_img_dim i_abs(i_img_dim x);
 
 #define color_to_grey(col) ((col)->rgb.r * 0.222  + (col)->rgb.g * 0.707 + (col)->rgb.b * 0.071)
 
+/* worker thread pool, implemented in pool*.c */
+typedef struct im_thread_pool_tag *im_thread_pool_t;
+
+extern im_thread_pool_t im_thread_pool_new(im_context_t ctx, int workers);
+extern void im_thread_pool_destroy(im_thread_pool_t pool);
+extern void im_thread_pool_run(im_thread_pool_t pool, im_parallel_band_f f,
+			       void *data, i_img_dim start, i_img_dim end,
+			       int bands);
+
+/* a single background thread that runs one job at a time, also in
+   pool*.c, new returns NULL if the thread can't be created */
+typedef struct im_thread_worker_tag *im_thread_worker_t;
+typedef void (*im_thread_job_f)(void *data);
+
+extern im_thread_worker_t im_thread_worker_new(void);
+extern void im_thread_worker_start(im_thread_worker_t worker,
+				   im_thread_job_f f, void *data);
+extern void im_thread_worker_wait(im_thread_worker_t worker);
+extern void im_thread_worker_destroy(im_thread_worker_t worker);
+
+/* the start of band C<band> when splitting start..end into C<bands>
+   bands, band C<bands> gives end */
+#define im_band_start(start, end, bands, band) \
+  ((start) + ((end) - (start)) * (i_img_dim)(band) / (bands))
+
+/* allocation for im_parallel_for() callbacks, since mymalloc() logs
+   and may track blocks, neither of which is safe from worker threads */
+extern void *im_parallel_malloc(size_t size);
+extern void *im_parallel_realloc(void *p, size_t size);
+extern void im_parallel_free(void *p);
+
+/* limit on the number of threads im_context_set_threads() accepts */
+#define IM_MAX_THREADS 256
+
+/* true if kernels may write to rows of im from several threads at
+   once, palette images may modify their palette while writing */
+#define im_img_parallel_write_ok(im) \
+  (!(im)->virtual && (im)->type == i_direct_type)
+
+/* true if rows of im may be read from several threads at once */
+#define im_img_parallel_read_ok(im) (!(im)->virtual)
+
 #define IM_ERROR_COUNT 20
 typedef struct im_context_tag {
   int error_sp;
@@ -138,6 +180,15 @@ typedef struct im_context_tag {
   size_t slot_alloc;
   void **slots;
 
+  /* seeds for operations that need random numbers */
+  i_rand_state rand_state;
+
+  /* worker threads for im_parallel_for() */
+  int thread_count;
+  im_thread_pool_t pool;
+  int pool_busy;
+  i_mutex_t pool_mutex;
+
   ptrdiff_t refcount;
 } im_context_struct;
 
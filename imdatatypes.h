@@ -354,6 +354,10 @@ struct i_img_ {
   im_context_t context;
 };
 
+/* slots in the paletted image color hash, at least twice the maximum
+   palette size so probes are short and always reach an empty slot */
+#define IM_PAL_HASH_SIZE 512
+
 /* ext_data for paletted images
  */
 typedef struct {
@@ -361,6 +365,11 @@ typedef struct {
   int alloc; /* amount of space allocated for palette (in entries) */
   i_color *pal;
   int last_found;
+  /* open addressing hash of the palette colors for findcolor, each
+     slot is a palette index + 1, or 0 if empty.  Entries from
+     hash_count on haven't been added yet. */
+  unsigned short hash[IM_PAL_HASH_SIZE];
+  int hash_count;
 } i_img_pal_ext;
 
 /* Helper datatypes
@@ -509,6 +518,72 @@ typedef enum {
   i_fts_circle
 } i_ft_supersample;
 
+/* gaussian blur implementation, see i_gaussian2() */
+typedef enum {
+  i_gauss_auto,
+  i_gauss_fir,
+  i_gauss_iir
+} i_gauss_method_t;
+
+/* default stddev at which i_gaussian() switches to the recursive
+   filter */
+#define I_GAUSS_IIR_THRESHOLD 8.0
+
+/* point operations for i_apply_levels() */
+typedef enum {
+  i_lo_contrast,	/* param[0] is the intensity */
+  i_lo_hardinvert,	/* color channels only */
+  i_lo_hardinvertall,	/* including alpha */
+  i_lo_postlevels,	/* param[0] is the number of levels */
+  i_lo_autolevels,	/* param[0], param[1] are lsat and usat */
+  i_lo_map		/* maps and mask, as for i_map() */
+} i_level_type;
+
+/*
+=item i_level_op
+
+One operation in the chain passed to i_apply_levels().
+
+=over
+
+=item *
+
+C<type> - the operation, one of C<i_lo_contrast>,
+C<i_lo_hardinvert>, C<i_lo_hardinvertall>, C<i_lo_postlevels>,
+C<i_lo_autolevels> or C<i_lo_map>.
+
+=item *
+
+C<param> - the intensity for C<i_lo_contrast>, the number of levels
+for C<i_lo_postlevels>, or the lower and upper saturation fractions
+for C<i_lo_autolevels>.
+
+=item *
+
+C<maps>, C<mask> - for C<i_lo_map>, a 256 entry map for each channel
+whose bit is set in C<mask>.
+
+=back
+
+=cut
+*/
+typedef struct {
+  i_level_type type;
+  double param[2];
+  unsigned char (*maps)[256];
+  unsigned int mask;
+} i_level_op;
+
+/* filter kernels for i_scale_kernel() */
+typedef enum {
+  i_kernel_box,
+  i_kernel_triangle,
+  i_kernel_catmull_rom,
+  i_kernel_mitchell,
+  i_kernel_lanczos2,
+  i_kernel_lanczos3
+} i_scale_kernel_t;
+
 /*
 =item i_fill_t
 =category Data Types
@@ -569,6 +644,47 @@ Opaque type for Imager's mutex API.
  */
 typedef struct i_mutex_tag *i_mutex_t;
 
+/*
+=item im_parallel_band_f
+
+Type of the callback supplied to im_parallel_for().  Called with the
+data pointer supplied to im_parallel_for() and the range of indexes,
+typically rows, to process, start inclusive and end exclusive.
+
+=cut
+*/
+typedef void (*im_parallel_band_f)(void *data, i_img_dim start, i_img_dim end);
+
+/*
+=item i_rand_state
+
+State for Imager's pseudo-random number generator, see i_rand_seed()
+and i_rand_next().
+
+=cut
+*/
+typedef struct {
+  unsigned long s[4];
+} i_rand_state;
+
+/*
+=item i_img_rows_read_f
+
+Type of the callback supplied to im_img_rows_new() to produce a row
+of the image.  Called with the data pointer supplied to
+im_img_rows_new(), the row number and a buffer for the row's samples.
+Returns true on success.
+
+=item i_img_rows_destroy_f
+
+Type of the callback supplied to im_img_rows_new() to release the
+data pointer.
+
+=cut
+*/
+typedef int (*i_img_rows_read_f)(void *data, i_img_dim y, i_sample_t *samps);
+typedef void (*i_img_rows_destroy_f)(void *data);
+
 /*
    describes an axis of a MM font.
    Modelled on FT2's FT_MM_Axis.
@@ -619,6 +735,7 @@ typedef enum i_make_colors_tag {
   mc_gray, /* 256 gray map */
   mc_gray4, /* four step gray map */
   mc_gray16, /* sixteen step gray map */
+  mc_wu, /* Wu's variance minimization */
   mc_mask = 0xFF /* (mask for generator) */
 } i_make_colors;
 
@@ -698,6 +815,19 @@ typedef struct i_quantize_tag {
   /* the amount of perturbation to use for translate is mc_perturb */
   int perturb;
   /* version 2 members after here */
+
+  /* bits per channel for the inverse color map used to speed up
+     translation, 0 for none, 5 or 6 */
+  int lookup_bits;
+  /* non-zero to search the palette for table cells that aren't
+     closest to a single color, so the result is exact */
+  int lookup_exact;
+  /* the inverse color map, kept between calls to i_quant_translate()
+     while the palette is unchanged, release with i_quant_cleanup() */
+  struct i_quant_lookup_tag *lookup;
+  /* count only every sample-th pixel of every sample-th row when
+     building a color map, 1 to count every pixel */
+  int sample;
 } i_quantize;
 
 /* distance measures used by some filters */
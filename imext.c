@@ -204,7 +204,27 @@ im_ext_funcs imager_function_table =
     i_mutex_unlock,
     im_context_slot_new,
     im_context_slot_set,
-    im_context_slot_get
+    im_context_slot_get,
+
+    /* level 9 */
+    im_img_rows_new,
+    i_img_rows_error,
+    im_img_mmap_new,
+    i_quant_cleanup,
+    i_quant_translate_multi,
+    im_context_get_threads,
+    im_context_set_seed,
+    im_context_next_seed,
+    i_rand_seed,
+    i_rand_next,
+    i_rand_double,
+    i_apply_levels,
+    im_io_new_mmap,
+    i_io_set_buffer_size,
+    io_bufchain_iovec,
+    i_io_set_async,
+    i_io_set_stats,
+    i_io_get_stats
   };
 
 /* in general these functions aren't called by Imager internally, but
@@ -236,6 +236,28 @@ extern im_ext_funcs *imager_function_ext_table;
 #define im_context_slot_get(ctx, slot) ((im_extt->f_im_context_slot_get)((ctx), (slot)))
 #define im_context_slot_set(ctx, slot, value) ((im_extt->f_im_context_slot_set)((ctx), (slot), (value)))
 
+#define im_img_rows_new(ctx, xsize, ysize, channels, window, read_row, destroy, data) \
+  ((im_extt->f_im_img_rows_new)((ctx), (xsize), (ysize), (channels), (window), (read_row), (destroy), (data)))
+#define i_img_rows_error(im) ((im_extt->f_i_img_rows_error)(im))
+#define im_img_mmap_new(ctx, x, y, ch, bits, path) \
+  ((im_extt->f_im_img_mmap_new)((ctx), (x), (y), (ch), (bits), (path)))
+#define i_quant_cleanup(quant) ((im_extt->f_i_quant_cleanup)(quant))
+#define i_quant_translate_multi(quant, imgs, count, results) \
+  ((im_extt->f_i_quant_translate_multi)((quant), (imgs), (count), (results)))
+#define im_context_get_threads(ctx) ((im_extt->f_im_context_get_threads)(ctx))
+#define im_context_set_seed(ctx, seed) ((im_extt->f_im_context_set_seed)((ctx), (seed)))
+#define im_context_next_seed(ctx) ((im_extt->f_im_context_next_seed)(ctx))
+#define i_rand_seed(rs, seed, stream) ((im_extt->f_i_rand_seed)((rs), (seed), (stream)))
+#define i_rand_next(rs) ((im_extt->f_i_rand_next)(rs))
+#define i_rand_double(rs) ((im_extt->f_i_rand_double)(rs))
+#define i_apply_levels(im, ops, count) ((im_extt->f_i_apply_levels)((im), (ops), (count)))
+#define im_io_new_mmap(ctx, fd) ((im_extt->f_im_io_new_mmap)((ctx), (fd)))
+#define i_io_set_buffer_size(ig, size) ((im_extt->f_i_io_set_buffer_size)((ig), (size)))
+#define io_bufchain_iovec(ig, iov, count) ((im_extt->f_io_bufchain_iovec)((ig), (iov), (count)))
+#define i_io_set_async(ig, async) ((im_extt->f_i_io_set_async)((ig), (async)))
+#define i_io_set_stats(ig, enable) ((im_extt->f_i_io_set_stats)((ig), (enable)))
+#define i_io_get_stats(ig, stats) ((im_extt->f_i_io_get_stats)((ig), (stats)))
+
 #define im_push_errorf (im_extt->f_im_push_errorf)
 
 #ifdef IMAGER_LOG
@@ -34,7 +34,7 @@
  will result in an increment of IMAGER_API_LEVEL.
 */
 
-#define IMAGER_API_LEVEL 8
+#define IMAGER_API_LEVEL 9
 
 typedef struct {
   int version;
@@ -254,6 +254,26 @@ typedef struct {
   im_slot_t (*f_im_context_slot_new)(im_slot_destroy_t);
   int (*f_im_context_slot_set)(im_context_t, im_slot_t, void *);
   void *(*f_im_context_slot_get)(im_context_t, im_slot_t);
+
+  /* IMAGER_API_LEVEL 9 functions */
+  i_img *(*f_im_img_rows_new)(im_context_t ctx, i_img_dim xsize, i_img_dim ysize, int channels, int window, i_img_rows_read_f read_row, i_img_rows_destroy_f destroy, void *data);
+  const char *(*f_i_img_rows_error)(i_img *im);
+  i_img *(*f_im_img_mmap_new)(im_context_t ctx, i_img_dim x, i_img_dim y, int ch, int bits, const char *path);
+  void (*f_i_quant_cleanup)(i_quantize *quant);
+  int (*f_i_quant_translate_multi)(i_quantize *quant, i_img **imgs, int count, i_palidx **results);
+  int (*f_im_context_get_threads)(im_context_t ctx);
+  void (*f_im_context_set_seed)(im_context_t ctx, unsigned long seed);
+  unsigned long (*f_im_context_next_seed)(im_context_t ctx);
+  void (*f_i_rand_seed)(i_rand_state *rs, unsigned long seed, unsigned long stream);
+  unsigned long (*f_i_rand_next)(i_rand_state *rs);
+  double (*f_i_rand_double)(i_rand_state *rs);
+  int (*f_i_apply_levels)(i_img *im, const i_level_op *ops, int count);
+  i_io_glue_t *(*f_im_io_new_mmap)(im_context_t ctx, int fd);
+  int (*f_i_io_set_buffer_size)(io_glue *ig, size_t size);
+  size_t (*f_io_bufchain_iovec)(io_glue *ig, i_io_iovec *iov, size_t count);
+  int (*f_i_io_set_async)(io_glue *ig, int async);
+  void (*f_i_io_set_stats)(io_glue *ig, int enable);
+  int (*f_i_io_get_stats)(io_glue *ig, i_io_stats *stats);
 } im_ext_funcs;
 
 #define PERL_FUNCTION_TABLE_NAME "Imager::__ext_func_table"
@@ -492,12 +492,19 @@ i_gsamp_d(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y, i_sample_t *samps,
 		      chan_count);
 	return 0;
       }
-      for (i = 0; i < w; ++i) {
-        for (ch = 0; ch < chan_count; ++ch) {
-          *samps++ = data[ch];
-          ++count;
+      if (chan_count == im->channels) {
+        /* every channel in order, the samples are stored that way */
+        count = w * chan_count;
+        memcpy(samps, data, count);
+      }
+      else {
+        for (i = 0; i < w; ++i) {
+          for (ch = 0; ch < chan_count; ++ch) {
+            *samps++ = data[ch];
+            ++count;
+          }
+          data += im->channels;
         }
-        data += im->channels;
       }
     }
 
@@ -8,29 +8,66 @@
 #ifdef _MSC_VER
 #include <io.h>
 #endif
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
 #include <string.h>
 #include <errno.h>
 #include "imageri.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef IMAGER_MMAP
+#include <sys/mman.h>
+#endif
 
 #define IOL_DEB(x)
 #define IOL_DEBs stderr
 
 #define IO_BUF_SIZE 8192
 
-char *io_type_names[] = { "FDSEEK", "FDNOSEEK", "BUFFER", "CBSEEK", "CBNOSEEK", "BUFCHAIN" };
+/* automatic buffer sizing never goes past this */
+#define IO_BUF_MAX (1024 * 1024)
+
+/* double the buffer after this many fills or flushes without a seek */
+#define IO_BUF_GROW_AFTER 4
+
+/* bufchain links double in size up to this */
+#define BCHAIN_MAX (1024 * 1024)
+
+char *io_type_names[] = { "FDSEEK", "FDNOSEEK", "BUFFER", "CBSEEK", "CBNOSEEK", "BUFCHAIN", "MMAP" };
 
 typedef struct io_blink {
-  char buf[BBSIZ];
-  /* size_t cnt; */
-  size_t len;			/* How large is this buffer = BBZIS for now */
+  char *buf;			/* follows the link in the same block */
+  size_t len;			/* How large is this buffer */
   struct io_blink *next;
   struct io_blink *prev;
 } io_blink;
 
 
+/* what the background job of an asynchronous fd source is doing */
+typedef enum {
+  FD_ASYNC_NONE,
+  FD_ASYNC_READ,		/* abuf holds data read ahead */
+  FD_ASYNC_WRITE		/* abuf holds data being written */
+} fd_async_state;
+
 typedef struct {
   i_io_glue_t	base;
   int		fd;
+
+  /* read-ahead and write-behind, see i_io_set_async() */
+  int		async;
+  int		read_ahead;	/* async on a regular file */
+  fd_async_state astate;
+  im_thread_worker_t worker;
+  unsigned char	*abuf;
+  size_t	abuf_size;
+  size_t	apos;		/* read ahead data already returned */
+  size_t	awant;		/* bytes to write */
+  ssize_t	alen;		/* result of the read() or write() */
+  int		aerrno;
 } io_fdseek;
 
 typedef struct {
@@ -52,6 +89,13 @@ typedef struct {
   i_io_destroyl_t      destroycb;
 } io_cb;
 
+typedef struct {
+  i_io_glue_t   base;
+  unsigned char *data;		/* the mapping, NULL for an empty file */
+  size_t	len;
+  off_t		cpos;		/* never less than len, see mmap_seek() */
+} io_mmap;
+
 typedef struct {
   off_t offset;			/* Offset of the source - not used */
   off_t length;			/* Total length of chain in bytes */
@@ -63,6 +107,14 @@ typedef struct {
   off_t gpos;			/* Global position in stream */
 } io_ex_bchain;
 
+/* the counters and the callbacks they wrap, see i_io_set_stats() */
+typedef struct {
+  i_io_stats	stats;
+  i_io_readp_t	readcb;
+  i_io_writep_t	writecb;
+  i_io_seekp_t	seekcb;
+} io_stats_wrap;
+
 /* turn current offset, file length, whence and offset into a new offset */
 #define calc_seek_offset(curr_off, length, offset, whence) \
   (((whence) == SEEK_SET) ? (offset) : \
@@ -122,8 +174,28 @@ static ssize_t fd_write(io_glue *ig, const void *buf, size_t count);
 static off_t fd_seek(io_glue *ig, off_t offset, int whence);
 static int fd_close(io_glue *ig);
 static ssize_t fd_size(io_glue *ig);
+static void fd_destroy(io_glue *ig);
+static void fd_read_job(void *p);
+static void fd_write_job(void *p);
+static void fd_async_start(io_fdseek *ig, im_thread_job_f f);
+static void fd_async_wait(io_fdseek *ig);
+static ssize_t fd_read_ahead(io_fdseek *ig, void *buf, size_t count);
+static int fd_async_finish(io_fdseek *ig);
+#ifdef IMAGER_MMAP
+static ssize_t mmap_read(io_glue *ig, void *buf, size_t count);
+static ssize_t mmap_write(io_glue *ig, const void *buf, size_t count);
+static off_t mmap_seek(io_glue *ig, off_t offset, int whence);
+static int mmap_close(io_glue *ig);
+static ssize_t mmap_size(io_glue *ig);
+static void mmap_destroy(io_glue *ig);
+#endif
 static const char *my_strerror(int err);
+static double stats_now(void);
+static ssize_t stats_read(io_glue *ig, void *buf, size_t count);
+static ssize_t stats_write(io_glue *ig, const void *buf, size_t count);
+static off_t stats_seek(io_glue *ig, off_t offset, int whence);
 static void i_io_setup_buffer(io_glue *ig);
+static void i_io_grow_buffer(io_glue *ig);
 static void
 i_io_start_write(io_glue *ig);
 static int
@@ -140,7 +212,7 @@ static ssize_t buffer_write(io_glue *ig, const void *buf, size_t count);
 static int buffer_close(io_glue *ig);
 static off_t buffer_seek(io_glue *igo, off_t offset, int whence);
 static void buffer_destroy(io_glue *igo);
-static io_blink*io_blink_new(void);
+static io_blink*io_blink_new(size_t len);
 static void io_bchain_advance(io_ex_bchain *ieb);
 static void io_destroy_bufchain(io_ex_bchain *ieb);
 static ssize_t bufchain_read(io_glue *ig, void *buf, size_t count);
@@ -184,7 +256,7 @@ im_io_new_bufchain(pIMCTX) {
   ieb->gpos   = 0;
   ieb->tfill  = 0;
   
-  ieb->head   = io_blink_new();
+  ieb->head   = io_blink_new(BBSIZ);
   ieb->cp     = ieb->head;
   ieb->tail   = ieb->head;
   
@@ -271,13 +343,92 @@ im_io_new_fd(pIMCTX, int fd) {
 
   ig->base.closecb   = fd_close;
   ig->base.sizecb    = fd_size;
-  ig->base.destroycb = NULL;
+  ig->base.destroycb = fd_destroy;
   im_context_refinc(aIMCTX, "im_io_new_bufchain");
 
   im_log((aIMCTX, 1, "(%p) <- io_new_fd\n", ig));
   return (io_glue *)ig;
 }
 
+/*
+=item im_io_new_mmap(ctx, file)
+X<io_new_mmap API>X<im_io_new_mmap API>
+=order 10
+=category I/O Layers
+=synopsis io_glue *ig = im_io_new_mmap(aIMCTX, fd);
+
+Returns a new io_glue object that reads from the regular file open on
+the file descriptor I<file> by mapping it into memory.
+
+The buffered read functions, i_io_getc(), i_io_peekn(), i_io_read()
+and so on, work directly from the mapping, and i_io_seek() only moves
+a pointer, so reading makes no system calls.  Reading starts at the
+current position of I<file>, which isn't changed.
+
+The file is only read, writes fail.
+
+If I<file> isn't a regular file, such as a pipe, or can't be mapped,
+or mmap() isn't available, returns the same object as io_new_fd()
+would.
+
+Also callable as C<io_new_mmap(file)>.
+
+=cut
+*/
+
+io_glue *
+im_io_new_mmap(pIMCTX, int fd) {
+#ifdef IMAGER_MMAP
+  io_mmap *ig;
+  struct stat st;
+  off_t start;
+  void *data = NULL;
+  size_t len;
+
+  im_log((aIMCTX, 1, "io_new_mmap(fd %d)\n", fd));
+
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)
+      || (off_t)(size_t)st.st_size != st.st_size
+      || (start = lseek(fd, 0, SEEK_CUR)) < 0) {
+    im_log((aIMCTX, 1, "io_new_mmap: not a mappable file, using io_new_fd\n"));
+    return im_io_new_fd(aIMCTX, fd);
+  }
+
+  len = st.st_size;
+  if (len) {
+    data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      im_log((aIMCTX, 1, "io_new_mmap: mmap() failed (%d), using io_new_fd\n",
+	      errno));
+      return im_io_new_fd(aIMCTX, fd);
+    }
+#ifdef IMAGER_MADVISE
+    madvise(data, len, MADV_SEQUENTIAL);
+#endif
+  }
+
+  ig = mymalloc(sizeof(io_mmap));
+  memset(ig, 0, sizeof(*ig));
+  i_io_init(aIMCTX, &ig->base, MMAP, mmap_read, mmap_write, mmap_seek);
+  ig->data = data;
+  ig->len = len;
+
+  ig->base.closecb   = mmap_close;
+  ig->base.sizecb    = mmap_size;
+  ig->base.destroycb = mmap_destroy;
+  im_context_refinc(aIMCTX, "im_io_new_mmap");
+
+  /* point the read buffer at the mapping */
+  mmap_seek(&ig->base, start, SEEK_SET);
+
+  im_log((aIMCTX, 1, "(%p) <- io_new_mmap\n", ig));
+  return (io_glue *)ig;
+#else
+  im_log((aIMCTX, 1, "io_new_mmap(fd %d): no mmap(), using io_new_fd\n", fd));
+  return im_io_new_fd(aIMCTX, fd);
+#endif
+}
+
 /*
 =item im_io_new_cb(ctx, p, read_cb, write_cb, seek_cb, close_cb, destroy_cb)
 X<im_io_new_cb API>X<io_new_cb API>
@@ -403,6 +554,60 @@ io_slurp(io_glue *ig, unsigned char **c) {
   return rc;
 }
 
+/*
+=item io_bufchain_iovec(ig, iov, count)
+X<io_bufchain_iovec API>
+=category I/O Layers
+=synopsis size_t count = io_bufchain_iovec(ig, NULL, 0);
+=synopsis i_io_iovec *iov = mymalloc(sizeof(i_io_iovec) * count);
+=synopsis io_bufchain_iovec(ig, iov, count);
+
+Describes the content of an io_glue object created by
+io_new_bufchain() as a list of blocks, without copying it, so the
+caller can copy it once to its final destination.
+
+Fills in up to I<count> entries of I<iov>, each with a pointer to a
+block of data in C<base> and its length in C<len>, and returns the
+number of blocks needed for the whole content.  Call with a I<count>
+of zero to find how many entries are needed.
+
+The pointers are valid until the object is next written to or
+destroyed.  Data written with the buffered I/O functions is only
+included after i_io_flush() or i_io_close().
+
+io_bufchain_iovec() will abort the program if the supplied I/O layer
+is not from io_new_bufchain().
+
+=cut
+*/
+
+size_t
+io_bufchain_iovec(io_glue *ig, i_io_iovec *iov, size_t count) {
+  io_ex_bchain *ieb;
+  io_blink *cp;
+  off_t left;
+  size_t blocks = 0;
+
+  if (ig->type != BUFCHAIN) {
+    dIMCTXio(ig);
+    im_fatal(aIMCTX, 0, "io_bufchain_iovec: called on a source that is not from a bufchain\n");
+  }
+
+  ieb = ig->exdata;
+  left = ieb->length;
+  for (cp = ieb->head; cp && left > 0; cp = cp->next) {
+    size_t len = left < (off_t)cp->len ? (size_t)left : cp->len;
+    if (blocks < count) {
+      iov[blocks].base = (unsigned char *)cp->buf;
+      iov[blocks].len = len;
+    }
+    ++blocks;
+    left -= len;
+  }
+
+  return blocks;
+}
+
 /*
 =item io_glue_destroy(ig)
 X<io_glue_destroy API>
@@ -427,6 +632,9 @@ io_glue_destroy(io_glue *ig) {
 
   if (ig->buffer)
     myfree(ig->buffer);
+
+  if (ig->stats)
+    myfree(ig->stats);
   
   myfree(ig);
 
@@ -571,6 +779,8 @@ i_io_peekn(io_glue *ig, void *buf, size_t size) {
 
   if ((!ig->read_ptr || size > ig->read_end - ig->read_ptr)
       && !(ig->buf_eof || ig->error)) {
+    if (ig->stats)
+      ++ig->stats->peek_fills;
     i_io_read_fill(ig, size);
   }
   
@@ -643,6 +853,7 @@ i_io_putc_imp(io_glue *ig, int c) {
   if (ig->write_ptr && ig->write_ptr == ig->write_end) {
     if (!i_io_flush(ig))
       return EOF;
+    i_io_grow_buffer(ig);
   }
 
   i_io_start_write(ig);
@@ -813,6 +1024,7 @@ i_io_write(io_glue *ig, const void *buf, size_t size) {
       return write_count ? write_count : -1;
     }
 
+    i_io_grow_buffer(ig);
     i_io_start_write(ig);
     
     if (size > ig->buf_size) {
@@ -871,6 +1083,7 @@ i_io_seek(io_glue *ig, off_t offset, int whence) {
   ig->write_ptr = ig->write_end = NULL;
   ig->error = 0;
   ig->buf_eof = 0;
+  ig->seq_count = 0;
   
   new_off = i_io_raw_seek(ig, offset, whence);
   if (new_off < 0)
@@ -1024,6 +1237,9 @@ i_io_init(pIMCTX, io_glue *ig, int type, i_io_readp_t readcb, i_io_writep_t writ
   ig->buf_eof = 0;
   ig->error = 0;
   ig->buffered = 1;
+  ig->buf_size_set = 0;
+  ig->seq_count = 0;
+  ig->stats = NULL;
 }
 
 /*
@@ -1050,11 +1266,17 @@ unbuffered.
 Returns true on success.  This may fail if any buffered output cannot
 be flushed.
 
+A source from io_new_mmap() always holds the whole file in its buffer
+and stays buffered.
+
 =cut
 */
 
 int
 i_io_set_buffered(io_glue *ig, int buffered) {
+  if (ig->type == MMAP)
+    return 1;
+
   if (!buffered && ig->write_ptr) {
     if (!i_io_flush(ig)) {
       ig->error = 1;
@@ -1066,6 +1288,140 @@ i_io_set_buffered(io_glue *ig, int buffered) {
   return 1;
 }
 
+/*
+=item i_io_set_buffer_size(io, size)
+=category I/O Layers
+=synopsis if (!i_io_set_buffer_size(ig, 1024 * 1024)) { ... error ... }
+
+Set the size of the buffer used for buffered I/O to I<size> bytes.
+
+By default the buffer starts at 8192 bytes, or larger for a large
+file from io_new_fd(), and doubles, up to 1MB, as the stream is read
+or written without seeking.  Once the size is set here it stays fixed.
+
+Any buffered output is flushed first.  Buffered input is kept, and the
+buffer is never made smaller than that input.
+
+Returns true on success.  Fails for a I<size> of zero, or if buffered
+output can't be flushed.
+
+=cut
+*/
+
+int
+i_io_set_buffer_size(io_glue *ig, size_t size) {
+  size_t kept = 0;
+
+  IOL_DEB(fprintf(IOL_DEBs, "i_io_set_buffer_size(%p, %u)\n", ig,
+		  (unsigned)size));
+
+  if (size == 0) {
+    dIMCTXio(ig);
+    i_push_error(0, "buffer size must be positive");
+    return 0;
+  }
+
+  /* the mapping is the buffer */
+  if (ig->type == MMAP)
+    return 1;
+
+  if (ig->write_ptr && !i_io_flush(ig))
+    return 0;
+
+  if (ig->read_ptr && ig->read_ptr < ig->read_end) {
+    kept = ig->read_end - ig->read_ptr;
+    if (size < kept)
+      size = kept;
+  }
+
+  if (ig->buffer) {
+    unsigned char *buffer = mymalloc(size);
+
+    if (kept)
+      memcpy(buffer, ig->read_ptr, kept);
+    myfree(ig->buffer);
+    ig->buffer = buffer;
+    if (kept) {
+      ig->read_ptr = buffer;
+      ig->read_end = buffer + kept;
+    }
+    else {
+      ig->read_ptr = ig->read_end = NULL;
+    }
+  }
+  ig->buf_size = size;
+  ig->buf_size_set = 1;
+
+  return 1;
+}
+
+/*
+=item i_io_set_async(io, async)
+=category I/O Layers
+=synopsis i_io_set_async(ig, 1);
+
+Enable or disable read-ahead and write-behind for a source from
+io_new_fd(), so reading from or writing to a slow file, pipe or socket
+overlaps with processing the data.
+
+When enabled, each time the data read from the file descriptor has
+been consumed, a background thread reads the next block while the
+caller processes the current one.  Each block written is copied and
+written by a background thread while the caller continues.  Reads and
+writes large enough to bypass the buffer are done directly, once any
+background I/O has completed, rather than copied.
+
+End of file and read errors are returned in order, once all of the
+data before them has been read.  A write error is returned by the next
+write, seek or close after the failed write, so check the result of
+i_io_close().
+
+Read-ahead is only done when the file descriptor is a regular file,
+since a background read from a pipe or socket could wait for data that
+never arrives, and data read ahead but not used has to be given back
+by seeking.  Write-behind is done for any file descriptor.
+
+The background thread is created when async I/O is enabled and kept
+until it's disabled or the source is destroyed.  Without thread
+support the I/O is done in the calling thread.
+
+Returns true if the source supports asynchronous I/O, and false
+otherwise, including when disabling it reports a pending write error.
+
+=cut
+*/
+
+int
+i_io_set_async(io_glue *ig, int async) {
+  io_fdseek *fdig = (io_fdseek *)ig;
+
+  IOL_DEB(fprintf(IOL_DEBs, "i_io_set_async(%p, %d)\n", ig, async));
+
+  if (ig->type != FDSEEK)
+    return 0;
+
+  if (async) {
+    struct stat st;
+
+    fdig->read_ahead = fstat(fdig->fd, &st) == 0
+      && (st.st_mode & S_IFMT) == S_IFREG;
+    if (!fdig->worker)
+      fdig->worker = im_thread_worker_new();
+  }
+  else {
+    if (!fd_async_finish(fdig))
+      return 0;
+    fdig->read_ahead = 0;
+    if (fdig->worker) {
+      im_thread_worker_destroy(fdig->worker);
+      fdig->worker = NULL;
+    }
+  }
+  fdig->async = async;
+
+  return 1;
+}
+
 /*
 =item i_io_dump(ig)
 
@@ -1108,6 +1464,86 @@ i_io_dump(io_glue *ig, int flags) {
     fprintf(IOL_DEBs, "  error: %d\n", ig->error);
     fprintf(IOL_DEBs, "  buffered: %d\n", ig->buffered);
   }
+  if ((flags & I_IO_DUMP_STATS) && ig->stats) {
+    i_io_stats *st = ig->stats;
+    fprintf(IOL_DEBs, "  stats:\n");
+    fprintf(IOL_DEBs, "    read: %.0f bytes, %lu calls, %.6fs\n",
+	    (double)st->bytes_read, st->reads, st->read_time);
+    fprintf(IOL_DEBs, "    written: %.0f bytes, %lu calls, %.6fs\n",
+	    (double)st->bytes_written, st->writes, st->write_time);
+    fprintf(IOL_DEBs, "    seeks: %lu calls, %.6fs\n",
+	    st->seeks, st->seek_time);
+    fprintf(IOL_DEBs, "    fills: %lu, peek fills: %lu\n",
+	    st->fills, st->peek_fills);
+  }
+}
+
+/*
+=item i_io_set_stats(io, enable)
+=category I/O Layers
+=synopsis i_io_set_stats(ig, 1);
+
+Start or stop counting the I/O done by the stream: bytes read and
+written, calls to the underlying read, write and seek callbacks and
+the time spent in them, and how often the read buffer was filled,
+including for i_io_peekn().
+
+Counting is done by wrapping the callbacks, so there's no cost when
+it's off.  Enabling counting when it's already on resets the counts.
+
+Use i_io_get_stats() to fetch the counts, and i_io_dump() includes
+them.
+
+=cut
+*/
+
+void
+i_io_set_stats(io_glue *ig, int enable) {
+  io_stats_wrap *wrap = (io_stats_wrap *)ig->stats;
+
+  if (enable) {
+    if (!wrap) {
+      wrap = mymalloc(sizeof(io_stats_wrap));
+      wrap->readcb = ig->readcb;
+      wrap->writecb = ig->writecb;
+      wrap->seekcb = ig->seekcb;
+      ig->readcb = stats_read;
+      ig->writecb = stats_write;
+      ig->seekcb = stats_seek;
+      ig->stats = &wrap->stats;
+    }
+    memset(&wrap->stats, 0, sizeof(wrap->stats));
+  }
+  else if (wrap) {
+    ig->readcb = wrap->readcb;
+    ig->writecb = wrap->writecb;
+    ig->seekcb = wrap->seekcb;
+    ig->stats = NULL;
+    myfree(wrap);
+  }
+}
+
+/*
+=item i_io_get_stats(io, stats)
+=category I/O Layers
+=synopsis i_io_stats stats;
+=synopsis if (i_io_get_stats(ig, &stats)) { ... }
+
+Copy the counts collected since i_io_set_stats() into I<stats>.
+
+Returns false if counting isn't enabled.
+
+=cut
+*/
+
+int
+i_io_get_stats(io_glue *ig, i_io_stats *stats) {
+  if (!ig->stats)
+    return 0;
+
+  *stats = *ig->stats;
+
+  return 1;
 }
 
 /*
@@ -1139,9 +1575,42 @@ const char *my_strerror(int err) {
 
 static void
 i_io_setup_buffer(io_glue *ig) {
+  if (!ig->buf_size_set && ig->sizecb) {
+    /* a large source gets a large buffer from the start */
+    ssize_t size = ig->sizecb(ig);
+    while (ig->buf_size < IO_BUF_MAX && (ssize_t)ig->buf_size < size / 16)
+      ig->buf_size *= 2;
+  }
   ig->buffer = mymalloc(ig->buf_size);
 }
 
+/*
+=item i_io_grow_buffer(ig)
+
+Called each time the buffer is filled or flushed.  Doubles the buffer
+size, up to 1MB, after several fills or flushes with no seek between,
+unless the size was set with i_io_set_buffer_size().
+
+Nothing may point into the buffer when this is called.
+
+=cut
+*/
+
+static void
+i_io_grow_buffer(io_glue *ig) {
+  if (ig->buf_size_set || ig->buf_size >= IO_BUF_MAX)
+    return;
+
+  if (++ig->seq_count < IO_BUF_GROW_AFTER)
+    return;
+
+  ig->seq_count = 0;
+  ig->buf_size *= 2;
+  ig->buffer = myrealloc(ig->buffer, ig->buf_size);
+  IOL_DEB(fprintf(IOL_DEBs, "i_io_grow_buffer(%p) -> %u\n", ig,
+		  (unsigned)ig->buf_size));
+}
+
 static void
 i_io_start_write(io_glue *ig) {
   ig->write_ptr = ig->buffer;
@@ -1150,9 +1619,10 @@ i_io_start_write(io_glue *ig) {
 
 static int
 i_io_read_fill(io_glue *ig, ssize_t needed) {
-  unsigned char *buf_end = ig->buffer + ig->buf_size;
-  unsigned char *buf_start = ig->buffer;
-  unsigned char *work = ig->buffer;
+  unsigned char *buf_end;
+  unsigned char *buf_start;
+  unsigned char *work;
+  size_t kept = 0;
   ssize_t rc;
   int good = 0;
 
@@ -1166,7 +1636,7 @@ i_io_read_fill(io_glue *ig, ssize_t needed) {
     needed = ig->buf_size;
 
   if (ig->read_ptr && ig->read_ptr < ig->read_end) {
-    size_t kept = ig->read_end - ig->read_ptr;
+    kept = ig->read_end - ig->read_ptr;
 
     if (needed < kept) {
       IOL_DEB(fprintf(IOL_DEBs, "i_io_read_fill(%u) -> 1 (already have enough)\n", (unsigned)needed));
@@ -1177,12 +1647,18 @@ i_io_read_fill(io_glue *ig, ssize_t needed) {
       memmove(ig->buffer, ig->read_ptr, kept);
 
     good = 1; /* we have *something* available to read */
-    work = buf_start + kept;
     needed -= kept;
   }
-  else {
-    work = ig->buffer;
-  }
+  ig->read_ptr = ig->read_end = NULL;
+
+  if (ig->stats)
+    ++ig->stats->fills;
+
+  i_io_grow_buffer(ig);
+
+  buf_start = ig->buffer;
+  buf_end = ig->buffer + ig->buf_size;
+  work = buf_start + kept;
 
   /* there should always be buffer space the first time around, but
      avoid a compiler warning here */
@@ -1548,20 +2024,21 @@ buffer_destroy(io_glue *igo) {
 
 static
 io_blink*
-io_blink_new(void) {
+io_blink_new(size_t len) {
   io_blink *ib;
 
 #if 0
-  im_log((aIMCTX, 1, "io_blink_new()\n"));
+  im_log((aIMCTX, 1, "io_blink_new(%ld)\n", (long)len));
 #endif
 
-  ib = mymalloc(sizeof(io_blink));
+  ib = mymalloc(sizeof(io_blink) + len);
 
+  ib->buf  = (char *)(ib + 1);
   ib->next = NULL;
   ib->prev = NULL;
-  ib->len  = BBSIZ;
+  ib->len  = len;
 
-  memset(&ib->buf, 0, ib->len);
+  memset(ib->buf, 0, ib->len);
   return ib;
 }
 
@@ -1573,6 +2050,9 @@ io_blink_new(void) {
 Advances the buffer chain to the next link - extending if
 necessary.  Also adjusts the cpos and tfill counters as needed.
 
+Each new link is twice the size of the one before, up to 1MB, so
+large output needs few links.
+
    ieb   - buffer chain object
 
 =cut
@@ -1582,7 +2062,7 @@ static
 void
 io_bchain_advance(io_ex_bchain *ieb) {
   if (ieb->cp->next == NULL) {
-    ieb->tail = io_blink_new();
+    ieb->tail = io_blink_new(i_min(ieb->cp->len * 2, BCHAIN_MAX));
     ieb->tail->prev = ieb->cp;
     ieb->cp->next   = ieb->tail;
 
@@ -1938,12 +2418,31 @@ Read callback for file descriptor IO objects.
 static ssize_t fd_read(io_glue *igo, void *buf, size_t count) {
   io_fdseek *ig = (io_fdseek *)igo;
   ssize_t result;
+
+  if (ig->async) {
+    if (ig->astate == FD_ASYNC_WRITE && !fd_async_finish(ig))
+      return -1;
+    if (ig->astate == FD_ASYNC_READ)
+      return fd_read_ahead(ig, buf, count);
+  }
+
 #ifdef _MSC_VER
   result = _read(ig->fd, buf, count);
 #else
   result = read(ig->fd, buf, count);
 #endif
 
+  if (ig->read_ahead && result > 0 && count <= ig->base.buf_size) {
+    /* read the next block while the caller works on this one, but
+       not for reads large enough to bypass the buffer */
+    if (ig->abuf_size < count) {
+      ig->abuf = myrealloc(ig->abuf, count);
+      ig->abuf_size = count;
+    }
+    ig->astate = FD_ASYNC_READ;
+    fd_async_start(ig, fd_read_job);
+  }
+
   IOL_DEB(fprintf(IOL_DEBs, "fd_read(%p, %p, %u) => %d\n", ig, buf,
 		  (unsigned)count, (int)result));
 
@@ -1959,6 +2458,28 @@ static ssize_t fd_read(io_glue *igo, void *buf, size_t count) {
 static ssize_t fd_write(io_glue *igo, const void *buf, size_t count) {
   io_fdseek *ig = (io_fdseek *)igo;
   ssize_t result;
+
+  if (ig->async) {
+    /* report any error from the previous write */
+    if (!fd_async_finish(ig))
+      return -1;
+  }
+
+  /* writes larger than the buffer bypassed it, write those directly
+     rather than copying them */
+  if (ig->async && count <= ig->base.buf_size) {
+    if (ig->abuf_size < count) {
+      ig->abuf = myrealloc(ig->abuf, count);
+      ig->abuf_size = count;
+    }
+    memcpy(ig->abuf, buf, count);
+    ig->awant = count;
+    ig->astate = FD_ASYNC_WRITE;
+    fd_async_start(ig, fd_write_job);
+
+    return count;
+  }
+
 #ifdef _MSC_VER
   result = _write(ig->fd, buf, count);
 #else
@@ -1979,6 +2500,10 @@ static ssize_t fd_write(io_glue *igo, const void *buf, size_t count) {
 static off_t fd_seek(io_glue *igo, off_t offset, int whence) {
   io_fdseek *ig = (io_fdseek *)igo;
   off_t result;
+
+  if (!fd_async_finish(ig))
+    return (off_t)-1;
+
 #ifdef _MSC_VER
   result = _lseek(ig->fd, offset, whence);
 #else
@@ -1994,17 +2519,350 @@ static off_t fd_seek(io_glue *igo, off_t offset, int whence) {
 }
 
 static int fd_close(io_glue *ig) {
-  /* no, we don't close it */
-  return 0;
+  /* no, we don't close it, but wait for and check any write */
+  return fd_async_finish((io_fdseek *)ig) ? 0 : -1;
 }
 
-static ssize_t fd_size(io_glue *ig) {
-  dIMCTXio(ig);
-  im_log((aIMCTX, 1, "fd_size(ig %p) unimplemented\n", ig));
-  
+static void fd_destroy(io_glue *igo) {
+  io_fdseek *ig = (io_fdseek *)igo;
+
+  if (ig->worker)
+    im_thread_worker_destroy(ig->worker);
+  if (ig->abuf)
+    myfree(ig->abuf);
+}
+
+/*
+=item fd_read_job(p)
+
+=item fd_write_job(p)
+
+Background jobs for asynchronous fd sources.  These only touch the
+file descriptor and the source's async buffer and result fields, and
+don't use the context, since the calling thread may be using it.
+
+=cut
+*/
+
+static void
+fd_read_job(void *p) {
+  io_fdseek *ig = p;
+
+#ifdef _MSC_VER
+  ig->alen = _read(ig->fd, ig->abuf, ig->abuf_size);
+#else
+  ig->alen = read(ig->fd, ig->abuf, ig->abuf_size);
+#endif
+  ig->aerrno = ig->alen < 0 ? errno : 0;
+  ig->apos = 0;
+}
+
+static void
+fd_write_job(void *p) {
+  io_fdseek *ig = p;
+  size_t done = 0;
+
+  ig->aerrno = 0;
+  while (done < ig->awant) {
+    ssize_t rc;
+#ifdef _MSC_VER
+    rc = _write(ig->fd, ig->abuf + done, ig->awant - done);
+#else
+    rc = write(ig->fd, ig->abuf + done, ig->awant - done);
+#endif
+    if (rc <= 0) {
+      ig->aerrno = errno;
+      break;
+    }
+    done += rc;
+  }
+  ig->alen = done;
+}
+
+/*
+=item fd_async_start(ig, f)
+
+Start the background read or write on the source's worker, or do it
+now if there's no worker thread.
+
+=cut
+*/
+
+static void
+fd_async_start(io_fdseek *ig, im_thread_job_f f) {
+  if (ig->worker)
+    im_thread_worker_start(ig->worker, f, ig);
+  else
+    f(ig);
+}
+
+/*
+=item fd_async_wait(ig)
+
+Wait for any background read or write to complete.
+
+=cut
+*/
+
+static void
+fd_async_wait(io_fdseek *ig) {
+  if (ig->worker)
+    im_thread_worker_wait(ig->worker);
+}
+
+/*
+=item fd_read_ahead(ig, buf, count)
+
+Return data read in the background, starting the next read once it's
+all been returned, or the end of file or error the background read
+found.
+
+=cut
+*/
+
+static ssize_t
+fd_read_ahead(io_fdseek *ig, void *buf, size_t count) {
+  fd_async_wait(ig);
+
+  if (ig->alen > 0) {
+    size_t avail = ig->alen - ig->apos;
+    if (count > avail)
+      count = avail;
+    memcpy(buf, ig->abuf + ig->apos, count);
+    ig->apos += count;
+    if (ig->apos == (size_t)ig->alen)
+      fd_async_start(ig, fd_read_job);
+
+    return count;
+  }
+
+  /* the next read starts synchronously again */
+  ig->astate = FD_ASYNC_NONE;
+  if (ig->alen < 0) {
+    dIMCTXio(&ig->base);
+    im_push_errorf(aIMCTX, 0, "read() failure: %s (%d)",
+		   my_strerror(ig->aerrno), ig->aerrno);
+  }
+
+  return ig->alen;
+}
+
+/*
+=item fd_async_finish(ig)
+
+Complete any background I/O before the source changes direction,
+seeks or is closed.
+
+Data read ahead but not returned is discarded and the file position
+moved back to where it would have been without read-ahead.
+
+Returns false, with an error pushed, if a background write failed or
+the file position can't be moved back.
+
+=cut
+*/
+
+static int
+fd_async_finish(io_fdseek *ig) {
+  fd_async_state state = ig->astate;
+
+  fd_async_wait(ig);
+  ig->astate = FD_ASYNC_NONE;
+
+  if (state == FD_ASYNC_READ && ig->alen > (ssize_t)ig->apos) {
+    off_t unread = ig->alen - ig->apos;
+    off_t result;
+#ifdef _MSC_VER
+    result = _lseek(ig->fd, -unread, SEEK_CUR);
+#else
+    result = lseek(ig->fd, -unread, SEEK_CUR);
+#endif
+    if (result == (off_t)-1) {
+      dIMCTXio(&ig->base);
+      im_push_errorf(aIMCTX, errno, "lseek() failure: %s (%d)",
+		     my_strerror(errno), errno);
+      return 0;
+    }
+  }
+  else if (state == FD_ASYNC_WRITE && ig->alen != (ssize_t)ig->awant) {
+    dIMCTXio(&ig->base);
+    im_push_errorf(aIMCTX, ig->aerrno, "write() failure: %s (%d)",
+		   my_strerror(ig->aerrno), ig->aerrno);
+    return 0;
+  }
+
+  return 1;
+}
+
+#ifdef IMAGER_MMAP
+
+/*
+=item mmap_seek(ig, offset, whence)
+
+Seek callback for memory mapped IO objects.
+
+The whole file is always in the read buffer, read_ptr is pointed at
+the new position and the raw position is left at the end of the
+file, or the new position if that's past the end, so i_io_seek()'s
+adjustment for C<SEEK_CUR> works and raw reads see end of file.
+
+=cut
+*/
+
+static off_t
+mmap_seek(io_glue *igo, off_t offset, int whence) {
+  io_mmap *ig = (io_mmap *)igo;
+  off_t reqpos = calc_seek_offset(ig->cpos, (off_t)ig->len, offset, whence);
+  size_t pos;
+
+  if (reqpos < 0) {
+    dIMCTXio(igo);
+    i_push_error(0, "seek before beginning of file");
+    return (off_t)-1;
+  }
+
+  pos = reqpos < (off_t)ig->len ? (size_t)reqpos : ig->len;
+  if (ig->data) {
+    igo->read_ptr = ig->data + pos;
+    igo->read_end = ig->data + ig->len;
+  }
+  igo->buf_eof = 1;
+  ig->cpos = reqpos > (off_t)ig->len ? reqpos : (off_t)ig->len;
+
+  IOL_DEB(fprintf(IOL_DEBs, "mmap_seek(%p, %ld, %d) => %ld\n", ig,
+		  (long)offset, whence, (long)reqpos));
+
+  return reqpos;
+}
+
+static ssize_t
+mmap_read(io_glue *igo, void *buf, size_t count) {
+  io_mmap *ig = (io_mmap *)igo;
+
+  /* everything has already been "read" into the buffer */
+  if (ig->cpos >= (off_t)ig->len)
+    return 0;
+  if (count > ig->len - ig->cpos)
+    count = ig->len - ig->cpos;
+  memcpy(buf, ig->data + ig->cpos, count);
+  ig->cpos += count;
+
+  return count;
+}
+
+static ssize_t
+mmap_write(io_glue *igo, const void *buf, size_t count) {
+  dIMCTXio(igo);
+  i_push_error(0, "cannot write to a mmap source");
   return -1;
 }
 
+static int
+mmap_close(io_glue *ig) {
+  return 0;
+}
+
+static ssize_t
+mmap_size(io_glue *igo) {
+  io_mmap *ig = (io_mmap *)igo;
+
+  return ig->len;
+}
+
+static void
+mmap_destroy(io_glue *igo) {
+  io_mmap *ig = (io_mmap *)igo;
+
+  if (ig->data)
+    munmap(ig->data, ig->len);
+}
+
+#endif
+
+/*
+=item stats_read(ig, buf, count)
+
+=item stats_write(ig, buf, count)
+
+=item stats_seek(ig, offset, whence)
+
+Count calls to the wrapped callbacks and the time spent in them.
+
+=cut
+*/
+
+static ssize_t
+stats_read(io_glue *ig, void *buf, size_t count) {
+  io_stats_wrap *wrap = (io_stats_wrap *)ig->stats;
+  double start = stats_now();
+  ssize_t rc = wrap->readcb(ig, buf, count);
+
+  wrap->stats.read_time += stats_now() - start;
+  ++wrap->stats.reads;
+  if (rc > 0)
+    wrap->stats.bytes_read += rc;
+
+  return rc;
+}
+
+static ssize_t
+stats_write(io_glue *ig, const void *buf, size_t count) {
+  io_stats_wrap *wrap = (io_stats_wrap *)ig->stats;
+  double start = stats_now();
+  ssize_t rc = wrap->writecb(ig, buf, count);
+
+  wrap->stats.write_time += stats_now() - start;
+  ++wrap->stats.writes;
+  if (rc > 0)
+    wrap->stats.bytes_written += rc;
+
+  return rc;
+}
+
+static off_t
+stats_seek(io_glue *ig, off_t offset, int whence) {
+  io_stats_wrap *wrap = (io_stats_wrap *)ig->stats;
+  double start = stats_now();
+  off_t rc = wrap->seekcb(ig, offset, whence);
+
+  wrap->stats.seek_time += stats_now() - start;
+  ++wrap->stats.seeks;
+
+  return rc;
+}
+
+/* wall clock time in seconds, for timing the callbacks */
+static double
+stats_now(void) {
+#ifdef _WIN32
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER now;
+
+  if (!freq.QuadPart)
+    QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&now);
+
+  return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+#endif
+}
+
+static ssize_t fd_size(io_glue *igo) {
+  io_fdseek *ig = (io_fdseek *)igo;
+  struct stat st;
+
+  /* only a regular file has a useful size */
+  if (fstat(ig->fd, &st) < 0 || (st.st_mode & S_IFMT) != S_IFREG)
+    return -1;
+
+  return (ssize_t)st.st_size;
+}
+
 
 /*
 =back
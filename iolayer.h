@@ -23,10 +23,12 @@ void io_glue_gettypes    (io_glue *ig, int reqmeth);
 
 /* XS functions */
 io_glue *im_io_new_fd(pIMCTX, int fd);
+io_glue *im_io_new_mmap(pIMCTX, int fd);
 io_glue *im_io_new_bufchain(pIMCTX);
 io_glue *im_io_new_buffer(pIMCTX, const char *data, size_t len, i_io_closebufp_t closecb, void *closedata);
 io_glue *im_io_new_cb(pIMCTX, void *p, i_io_readl_t readcb, i_io_writel_t writecb, i_io_seekl_t seekcb, i_io_closel_t closecb, i_io_destroyl_t destroycb);
 size_t   io_slurp(io_glue *ig, unsigned char **c);
+size_t   io_bufchain_iovec(io_glue *ig, i_io_iovec *iov, size_t count);
 void     io_glue_destroy(io_glue *ig);
 
 void i_io_dump(io_glue *ig, int flags);
@@ -42,6 +44,10 @@ extern off_t i_io_seek(io_glue *ig, off_t offset, int whence);
 extern int i_io_flush(io_glue *ig);
 extern int i_io_close(io_glue *ig);
 extern int i_io_set_buffered(io_glue *ig, int buffered);
+extern int i_io_set_buffer_size(io_glue *ig, size_t size);
+extern int i_io_set_async(io_glue *ig, int async);
+extern void i_io_set_stats(io_glue *ig, int enable);
+extern int i_io_get_stats(io_glue *ig, i_io_stats *stats);
 extern ssize_t i_io_gets(io_glue *ig, char *, size_t, int);
 
 #endif /* _IOLAYER_H_ */
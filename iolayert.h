@@ -8,7 +8,7 @@
 #include <stddef.h>
 #include <stdio.h>
 
-typedef enum { FDSEEK, FDNOSEEK, BUFFER, CBSEEK, CBNOSEEK, BUFCHAIN } io_type;
+typedef enum { FDSEEK, FDNOSEEK, BUFFER, CBSEEK, CBNOSEEK, BUFCHAIN, MMAP } io_type;
 
 #ifdef _MSC_VER
 typedef int ssize_t;
@@ -42,6 +42,26 @@ typedef ssize_t(*i_io_sizel_t) (void *p);
 
 extern char *io_type_names[];
 
+/* counters from i_io_get_stats() */
+typedef struct {
+  off_t bytes_read;		/* returned by the read callback */
+  off_t bytes_written;		/* accepted by the write callback */
+  unsigned long reads;		/* calls to the read callback */
+  unsigned long writes;		/* calls to the write callback */
+  unsigned long seeks;		/* calls to the seek callback */
+  unsigned long fills;		/* read buffer fills */
+  unsigned long peek_fills;	/* i_io_peekn() calls that had to read */
+  double read_time;		/* seconds in the read callback */
+  double write_time;		/* seconds in the write callback */
+  double seek_time;		/* seconds in the seek callback */
+} i_io_stats;
+
+/* a block of data from io_bufchain_iovec() */
+typedef struct {
+  const unsigned char *base;
+  size_t len;
+} i_io_iovec;
+
 
 
 /* Structures to describe data sources */
@@ -72,12 +92,22 @@ struct i_io_glue_t {
   int buffered;
 
   im_context_t context;
+
+  /* non-zero if buf_size was set by i_io_set_buffer_size() */
+  int buf_size_set;
+
+  /* fills or flushes since the last seek, for growing the buffer */
+  int seq_count;
+
+  /* counters, NULL unless enabled by i_io_set_stats() */
+  i_io_stats *stats;
 };
 
 #define I_IO_DUMP_CALLBACKS 1
 #define I_IO_DUMP_BUFFER 2
 #define I_IO_DUMP_STATUS 4
-#define I_IO_DUMP_DEFAULT (I_IO_DUMP_BUFFER | I_IO_DUMP_STATUS)
+#define I_IO_DUMP_STATS 8
+#define I_IO_DUMP_DEFAULT (I_IO_DUMP_BUFFER | I_IO_DUMP_STATUS | I_IO_DUMP_STATS)
 
 #define i_io_type(ig) ((ig)->source.ig_type)
 #define i_io_raw_read(ig, buf, size) ((ig)->readcb((ig), (buf), (size)))
@@ -85,6 +115,7 @@ struct i_io_glue_t {
 #define i_io_raw_seek(ig, offset, whence) ((ig)->seekcb((ig), (offset), (whence)))
 #define i_io_raw_close(ig) ((ig)->closecb(ig))
 #define i_io_is_buffered(ig) ((int)((ig)->buffered))
+#define i_io_buffer_size(ig) ((ig)->buf_size)
 
 #define i_io_getc(ig) \
   ((ig)->read_ptr < (ig)->read_end ? \
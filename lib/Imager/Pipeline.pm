@@ -0,0 +1,214 @@
+package Imager::Pipeline;
+use strict;
+use Imager;
+use vars qw($VERSION);
+
+$VERSION = "1.000";
+
+sub new {
+  my ($class) = @_;
+
+  return bless
+    {
+     stages => [],
+     written => 0,
+     ERRSTR => undef,
+    }, $class;
+}
+
+sub read {
+  my ($self, %opts) = @_;
+
+  my $im = Imager->new;
+  unless ($im->_read_rows(%opts)) {
+    $self->_set_error($im->errstr);
+    return;
+  }
+
+  $self->{stages} = [ $im ];
+  $self->{written} = 0;
+
+  return $self;
+}
+
+sub scale {
+  my ($self, %opts) = @_;
+
+  my $src = $self->_last
+    or return;
+
+  if (defined $opts{qtype} && $opts{qtype} ne "mixing") {
+    $self->_set_error("scale: only qtype mixing is supported by a pipeline");
+    return;
+  }
+
+  my (undef, undef, $new_width, $new_height) =
+    $src->scale_calculate(%opts)
+      or return $self->_set_error($src->errstr);
+
+  my $img = Imager::i_scale_mixing_rows($src->{IMG}, $new_width, $new_height);
+  unless ($img) {
+    $self->_set_error(Imager->_error_as_msg);
+    return;
+  }
+  my $im = Imager->new;
+  $im->{IMG} = $img;
+  push @{$self->{stages}}, $im;
+
+  return $self;
+}
+
+sub write {
+  my ($self, %opts) = @_;
+
+  my $im = $self->_last
+    or return;
+
+  if ($self->{written}) {
+    $self->_set_error("write: a pipeline can only be written once");
+    return;
+  }
+  $self->{written} = 1;
+
+  my $ok = $im->write(%opts);
+
+  # writers don't always check every row they read, so look for a
+  # failure in each stage, earliest first
+  for my $stage (@{$self->{stages}}) {
+    my $error = Imager::i_img_rows_error($stage->{IMG});
+    if (defined $error) {
+      $self->_set_error("write: $error");
+      return;
+    }
+  }
+
+  unless ($ok) {
+    $self->_set_error($im->errstr);
+    return;
+  }
+
+  return $self;
+}
+
+sub errstr {
+  $_[0]{ERRSTR};
+}
+
+sub _set_error {
+  my ($self, $msg) = @_;
+
+  $self->{ERRSTR} = $msg;
+
+  return;
+}
+
+sub _last {
+  my ($self) = @_;
+
+  unless (@{$self->{stages}}) {
+    my $method = (caller(1))[3];
+    $method =~ s/.*:://;
+    $self->_set_error("$method: no image has been read");
+    return;
+  }
+
+  return $self->{stages}[-1];
+}
+
+1;
+
+__END__
+
+=head1 NAME
+
+Imager::Pipeline - scale an image from file to file a few rows at a time
+
+=head1 SYNOPSIS
+
+  use Imager::Pipeline;
+
+  my $pipe = Imager::Pipeline->new;
+  $pipe->read(file => "big.jpg", jpeg_max_width => 200)
+    && $pipe->scale(xpixels => 200)
+    && $pipe->write(file => "thumb.jpg")
+    or die "Cannot make thumbnail: ", $pipe->errstr, "\n";
+
+  # or step by step
+  $pipe = Imager::Pipeline->new;
+  $pipe->read(file => "big.ppm")
+    or die $pipe->errstr;
+  $pipe->scale(xpixels => 200, ypixels => 200, type => "min")
+    or die $pipe->errstr;
+  $pipe->write(file => "small.ppm")
+    or die $pipe->errstr;
+
+=head1 DESCRIPTION
+
+An Imager::Pipeline reads, scales and writes an image without the
+full image ever being in memory.  Each row is decoded, scaled and
+encoded as the writer asks for it, so memory use depends on the width
+of the image rather than its size.
+
+This is useful for making thumbnails of large images, where the full
+size image may not fit in memory.
+
+Each method returns the pipeline object on success or an empty list
+on failure, with the message available from errstr().
+
+=over
+
+=item new()
+
+Create a new empty pipeline.
+
+=item read(...)
+
+Start the pipeline with the image in a file.  Accepts the same
+parameters as Imager's read() method.
+
+JPEG, PNG and binary PNM (P4, P5 and P6) files are decoded a row at a
+time, always with 8-bit samples.  The C<jpeg_scale> and
+C<jpeg_max_width> options are especially useful here, since libjpeg
+can then skip most of the work of decoding the full size image.
+
+Interlaced PNG files, ASCII PNM files and other formats are read
+completely, as read() would, and then handled a row at a time.
+
+=item scale(...)
+
+Add a scaling step, accepting the size parameters of Imager's
+scale() method.  Only the C<mixing> C<qtype> is supported, and it's
+used by default.
+
+The result is the same as Imager's scale() would produce with C<<
+qtype => "mixing" >> from an image with 8-bit samples.
+
+=item write(...)
+
+Write the result of the pipeline, accepting the same parameters as
+Imager's write() method.  This is when the work is done.
+
+A pipeline can only be written once.
+
+Since each row can only be read once, and in order, the format must be
+written from top to bottom without examining the image first.  PNM,
+JPEG and PNG work, BMP files, which are written from the bottom up,
+and GIF files, where the palette is generated from the whole image,
+don't, and write() fails with a message that the rows must be read in
+order.
+
+=item errstr()
+
+The message from the last failure.
+
+=back
+
+=head1 AUTHOR
+
+Tony Cook <tony@develop-help.com>
+
+=head1 SEE ALSO
+
+Imager(3), Imager::Files(3), Imager::Transformations(3)
+
+=cut
@@ -7,18 +7,47 @@
 
   i_map(srcimage, coeffs, outchans, inchans)
 
+  i_level_op ops[2];
+  ops[0].type = i_lo_contrast;
+  ops[0].param[0] = 1.2;
+  ops[1].type = i_lo_postlevels;
+  ops[1].param[0] = 8;
+  if (!i_apply_levels(im, ops, 2)) { ... error ... }
+
 =head1 DESCRIPTION
 
 Converts images from one format to another, typically in this case for
 converting from RGBA to greyscale and back.
 
+i_apply_levels() combines a chain of point operations, where each
+output sample depends only on the same input sample, into a single
+256 entry map per channel, and applies that to the image in one pass.
+The contrast, hardinvert, postlevels and autolevels filters and
+i_map() are implemented with it.
+
 =over
 
 =cut
 */
 
+#define IMAGER_NO_CONTEXT
+
 #include "imager.h"
+#include "imageri.h"
+
+/* shared with the row band workers */
+struct levels_rows {
+  i_img *im;
+  int chans[MAXCHANNELS];
+  int chan_count;
+  unsigned char (*luts)[256];
+};
 
+static void levels_rows(void *p, i_img_dim start, i_img_dim end);
+static int levels_palette(i_img *im, unsigned char (*luts)[256]);
+static int levels_hist(i_img *im, i_img_dim (*hist)[256]);
+static void levels_auto(unsigned char *lut, const i_img_dim *hist,
+			double lsat, double usat);
 
 /*
 =item i_map(im, mapcount, maps, chmasks)
@@ -36,36 +65,340 @@ maps im inplace into another image.
 
 void
 i_map(i_img *im, unsigned char (*maps)[256], unsigned int mask) {
-  i_color *vals;
-  i_img_dim x, y;
-  int i, ch;
-  int minset = -1, maxset = 0;
+  i_level_op op;
+  dIMCTXim(im);
 
-  mm_log((1,"i_map(im %p, maps %p, chmask %u)\n", im, maps, mask));
+  im_log((aIMCTX, 1,"i_map(im %p, maps %p, chmask %u)\n", im, maps, mask));
 
   if (!mask) return; /* nothing to do here */
 
-  for(i=0; i<im->channels; i++)
-    if (mask & (1<<i)) {
-      if (minset == -1) minset = i;
-      maxset = i;
+  op.type = i_lo_map;
+  op.maps = maps;
+  op.mask = mask;
+  i_apply_levels(im, &op, 1);
+}
+
+/*
+=item i_apply_levels(im, ops, count)
+=category Filters
+=synopsis if (!i_apply_levels(im, ops, op_count)) { ... error ... }
+
+Applies the I<count> point operations in I<ops> to I<im> in order,
+described by C<i_level_op> in F<imdatatypes.h>.
+
+The operations are combined into a 256 entry map for each channel,
+and the image is updated in a single pass, reading and writing only
+the channels the operations change.  Like the filters they replace,
+the operations work on 8-bit samples.
+
+C<i_lo_autolevels> needs a histogram of the image as it is at that
+point in the chain, which is calculated in a pass over the image
+before the update, and then passed through the maps for the earlier
+operations.
+
+For a paletted image only the palette is updated.  Otherwise the
+update is split across worker threads when they're enabled.
+
+Returns non-zero on success.  On failure, for a bad operation, returns
+zero without changing the image.
+
+=cut
+*/
+
+int
+i_apply_levels(i_img *im, const i_level_op *ops, int count) {
+  unsigned char luts[MAXCHANNELS][256];
+  i_img_dim hist[3][256];
+  int hist_chans = im->channels < 3 ? im->channels : 3;
+  int need_hist = 0;
+  int color_chans = i_img_color_channels(im);
+  struct levels_rows rows;
+  int i, ch, v;
+  dIMCTXim(im);
+
+  im_log((aIMCTX, 1, "i_apply_levels(im %p, ops %p, count %d)\n",
+	  im, ops, count));
+
+  im_clear_error(aIMCTX);
+
+  for (i = 0; i < count; ++i) {
+    const i_level_op *op = ops + i;
+    switch (op->type) {
+    case i_lo_contrast:
+      if (op->param[0] < 0) {
+	im_push_error(aIMCTX, 0, "contrast intensity must be non-negative");
+	return 0;
+      }
+      break;
+
+    case i_lo_postlevels:
+      if (op->param[0] < 1) {
+	im_push_error(aIMCTX, 0, "postlevels levels must be at least 1");
+	return 0;
+      }
+      break;
+
+    case i_lo_autolevels:
+      need_hist = 1;
+      break;
+
+    case i_lo_hardinvert:
+    case i_lo_hardinvertall:
+      break;
+
+    case i_lo_map:
+      if (op->mask && !op->maps) {
+	im_push_error(aIMCTX, 0, "map operation without maps");
+	return 0;
+      }
+      break;
+
+    default:
+      im_push_errorf(aIMCTX, 0, "unknown levels operation %d", (int)op->type);
+      return 0;
     }
+  }
 
-  mm_log((1, "minset=%d maxset=%d\n", minset, maxset));
+  for (ch = 0; ch < im->channels; ++ch)
+    for (v = 0; v < 256; ++v)
+      luts[ch][v] = v;
 
-  vals = mymalloc(sizeof(i_color) * im->xsize);
+  if (need_hist && !levels_hist(im, hist))
+    return 0;
 
-  for (y = 0; y < im->ysize; ++y) {
-    i_glin(im, 0, im->xsize, y, vals);
-    for (x = 0; x < im->xsize; ++x) {
-      for(ch = minset; ch<=maxset; ch++) {
-	if (!maps[ch]) continue;
-	vals[x].channel[ch] = maps[ch][vals[x].channel[ch]];
+  for (i = 0; i < count; ++i) {
+    const i_level_op *op = ops + i;
+
+    switch (op->type) {
+    case i_lo_contrast:
+      {
+	float intensity = op->param[0];
+	for (ch = 0; ch < im->channels; ++ch) {
+	  for (v = 0; v < 256; ++v) {
+	    unsigned int new_color = luts[ch][v];
+	    new_color *= intensity;
+	    luts[ch][v] = new_color > 255 ? 255 : new_color;
+	  }
+	}
+      }
+      break;
+
+    case i_lo_hardinvert:
+    case i_lo_hardinvertall:
+      {
+	int invert_chans = op->type == i_lo_hardinvertall ? im->channels
+	  : color_chans;
+	for (ch = 0; ch < invert_chans; ++ch)
+	  for (v = 0; v < 256; ++v)
+	    luts[ch][v] = 255 - luts[ch][v];
+      }
+      break;
+
+    case i_lo_postlevels:
+      {
+	int levels = op->param[0];
+	int rv = (int) ((float)(256 / levels));
+	float av = (float)levels;
+	for (ch = 0; ch < im->channels; ++ch) {
+	  for (v = 0; v < 256; ++v) {
+	    float pv = (((float)luts[ch][v] / 255)) * av;
+	    pv = (int) ((int)pv * rv);
+	    if (pv < 0) pv = 0;
+	    else if (pv > 255) pv = 255;
+	    luts[ch][v] = (unsigned char) pv;
+	  }
+	}
+      }
+      break;
+
+    case i_lo_autolevels:
+      for (ch = 0; ch < hist_chans; ++ch) {
+	/* the histogram of the samples as they are at this point */
+	i_img_dim work[256];
+	for (v = 0; v < 256; ++v)
+	  work[v] = 0;
+	for (v = 0; v < 256; ++v)
+	  work[luts[ch][v]] += hist[ch][v];
+	levels_auto(luts[ch], work, op->param[0], op->param[1]);
+      }
+      break;
+
+    case i_lo_map:
+      for (ch = 0; ch < im->channels; ++ch) {
+	if (op->mask & (1 << ch)) {
+	  for (v = 0; v < 256; ++v)
+	    luts[ch][v] = op->maps[ch][luts[ch][v]];
+	}
       }
+      break;
+    }
+  }
+
+  /* only touch the channels that change */
+  rows.chan_count = 0;
+  for (ch = 0; ch < im->channels; ++ch) {
+    for (v = 0; v < 256; ++v) {
+      if (luts[ch][v] != v) {
+	rows.chans[rows.chan_count++] = ch;
+	break;
+      }
+    }
+  }
+  if (!rows.chan_count)
+    return 1;
+
+  /* every pixel of a paletted image is a palette entry, but a
+     virtual image like a masked view shares its target's palette
+     with pixels it doesn't cover */
+  if (i_img_type(im) == i_palette_type && !im->virtual)
+    return levels_palette(im, luts);
+
+  rows.im = im;
+  rows.luts = luts;
+  if (im_context_get_threads(aIMCTX) > 1 && im_img_parallel_write_ok(im))
+    im_parallel_for(aIMCTX, 0, im->ysize, 16, levels_rows, &rows);
+  else
+    levels_rows(&rows, 0, im->ysize);
+
+  return 1;
+}
+
+/*
+=back
+
+=head1 INTERNAL FUNCTIONS
+
+=over
+
+=item levels_rows(p, start, end)
+
+Apply the maps to rows I<start> to I<end>-1, reading only the
+channels that change.
+
+=cut
+*/
+
+static void
+levels_rows(void *p, i_img_dim start, i_img_dim end) {
+  struct levels_rows *rows = p;
+  i_img *im = rows->im;
+  int chan_count = rows->chan_count;
+  i_img_dim count = im->xsize * chan_count;
+  i_sample_t *samps = im_parallel_malloc(sizeof(i_sample_t) * count);
+  i_img_dim y, i;
+  int ch;
+
+  for (y = start; y < end; ++y) {
+    i_gsamp(im, 0, im->xsize, y, samps, rows->chans, chan_count);
+    for (ch = 0; ch < chan_count; ++ch) {
+      const unsigned char *lut = rows->luts[rows->chans[ch]];
+      for (i = ch; i < count; i += chan_count)
+	samps[i] = lut[samps[i]];
     }
-    i_plin(im, 0, im->xsize, y, vals);
+    i_psamp(im, 0, im->xsize, y, samps, rows->chans, chan_count);
+  }
+
+  im_parallel_free(samps);
+}
+
+/*
+=item levels_palette(im, luts)
+
+Apply the maps to the palette of a paletted image, rather than to
+each pixel.
+
+=cut
+*/
+
+static int
+levels_palette(i_img *im, unsigned char (*luts)[256]) {
+  int count = i_colorcount(im);
+  i_color *colors;
+  int i, ch;
+
+  if (count <= 0)
+    return 1;
+
+  colors = mymalloc(sizeof(i_color) * count);
+  if (!i_getcolors(im, 0, colors, count)) {
+    myfree(colors);
+    return 0;
+  }
+  for (i = 0; i < count; ++i)
+    for (ch = 0; ch < im->channels; ++ch)
+      colors[i].channel[ch] = luts[ch][colors[i].channel[ch]];
+  i_setcolors(im, 0, colors, count);
+  myfree(colors);
+
+  return 1;
+}
+
+/*
+=item levels_hist(im, hist)
+
+Count the 8-bit samples in each of the first 3 channels of I<im>.
+
+=cut
+*/
+
+static int
+levels_hist(i_img *im, i_img_dim (*hist)[256]) {
+  int chan_count = im->channels < 3 ? im->channels : 3;
+  i_img_dim count = im->xsize * chan_count;
+  i_sample_t *samps = mymalloc(sizeof(i_sample_t) * count);
+  i_img_dim x, y;
+  int ch, v;
+
+  for (ch = 0; ch < chan_count; ++ch)
+    for (v = 0; v < 256; ++v)
+      hist[ch][v] = 0;
+
+  for (y = 0; y < im->ysize; ++y) {
+    const i_sample_t *s = samps;
+    i_gsamp(im, 0, im->xsize, y, samps, NULL, chan_count);
+    for (x = 0; x < im->xsize; ++x)
+      for (ch = 0; ch < chan_count; ++ch)
+	hist[ch][*s++]++;
+  }
+
+  myfree(samps);
+
+  return 1;
+}
+
+/*
+=item levels_auto(lut, hist, lsat, usat)
+
+Stretch the map I<lut> so the samples counted in I<hist> cover the
+whole range, less the I<lsat> and I<usat> fractions at each end.
+
+=cut
+*/
+
+static void
+levels_auto(unsigned char *lut, const i_img_dim *hist, double lsat,
+	    double usat) {
+  i_img_dim sum = 0, cl = 0, cu = 0;
+  i_img_dim min = 0, max = 255;
+  float flsat = lsat, fusat = usat;
+  int i;
+
+  for (i = 0; i < 256; ++i)
+    sum += hist[i];
+
+  for (i = 0; i < 256; ++i) {
+    cl += hist[i];     if (cl < sum * flsat) min = i;
+    cu += hist[255-i]; if (cu < sum * fusat) max = 255 - i;
+  }
+
+  /* nothing to stretch */
+  if (max == min)
+    return;
+
+  for (i = 0; i < 256; ++i) {
+    i_img_dim v = (lut[i] - min) * 255 / (max - min);
+    lut[i] = v < 0 ? 0 : v > 255 ? 255 : v;
   }
-  myfree(vals);
 }
 
 /*
@@ -0,0 +1,279 @@
+/*
+=head1 NAME
+
+mmapimg.c - direct images with samples stored in a memory mapped file
+
+=head1 SYNOPSIS
+
+  // samples in an unlinked temporary file
+  i_img *im = i_img_mmap_new(xsize, ysize, channels, i_8_bits, NULL);
+
+  // samples in a named file, kept after the image is destroyed
+  i_img *im = i_img_mmap_new(xsize, ysize, channels, i_16_bits, "big.raw");
+
+=head1 DESCRIPTION
+
+A memory mapped image is a normal direct image, 8-bit, 16-bit or
+double per sample, except that the sample buffer is a shared mapping
+of a file rather than memory from mymalloc().
+
+Since only the buffer is different, the image uses the vtable of the
+matching in-memory image type, so every filter, drawing function and
+file reader works with it unchanged, and it isn't a virtual image.
+The operating system pages the samples in and out of the file as
+they're used, so the image can be much larger than physical memory.
+
+=over
+
+=cut
+*/
+
+#define IMAGER_NO_CONTEXT
+
+#include "imager.h"
+#include "imageri.h"
+
+#ifdef IMAGER_MMAP
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void i_destroy_mmap(i_img *im);
+static int mmap_open(pIMCTX, const char *path);
+
+#endif
+
+/*
+=item im_img_mmap_new(ctx, x, y, ch, bits, path)
+X<im_img_mmap_new API>X<i_img_mmap_new API>
+=category Image creation/destruction
+=synopsis i_img *img = im_img_mmap_new(aIMCTX, width, height, channels, i_8_bits, NULL);
+=synopsis i_img *img = i_img_mmap_new(width, height, channels, i_16_bits, "big.raw");
+
+Creates a new direct image I<x> pixels wide and I<y> pixels high with
+I<ch> channels and I<bits> per sample, one of C<i_8_bits>,
+C<i_16_bits> or C<i_double_bits>, with the samples stored in a memory
+mapped file.
+
+If I<path> is NULL the samples are stored in a temporary file in the
+directory named by C<TMPDIR>, or F</tmp>, which is removed
+immediately, so the space is released when the image is destroyed.
+
+Otherwise the file named by I<path> is created, or truncated, and left
+behind when the image is destroyed, holding the samples in native
+order for the sample type, row by row from the top of the image.
+
+The samples are initially zero.
+
+Returns NULL on failure, including on platforms without mmap().
+
+Also callable as C<i_img_mmap_new(x, y, ch, bits, path)>.
+
+=cut
+*/
+
+i_img *
+im_img_mmap_new(pIMCTX, i_img_dim x, i_img_dim y, int ch, int bits,
+		const char *path) {
+#ifdef IMAGER_MMAP
+  i_img *im;
+  size_t bytes, line_bytes, sample_size;
+  int fd;
+  void *data;
+
+  im_log((aIMCTX, 1,"im_img_mmap_new(x %" i_DF ", y %" i_DF ", ch %d, bits %d, path %s)\n",
+	  i_DFc(x), i_DFc(y), ch, bits, path ? path : "(temp)"));
+
+  im_clear_error(aIMCTX);
+
+  switch (bits) {
+  case i_8_bits:
+    sample_size = 1;
+    break;
+
+  case i_16_bits:
+    sample_size = 2;
+    break;
+
+  case i_double_bits:
+    sample_size = sizeof(double);
+    break;
+
+  default:
+    im_push_error(aIMCTX, 0, "bits must be 8, 16 or double");
+    return NULL;
+  }
+
+  if (x < 1 || y < 1) {
+    im_push_error(aIMCTX, 0, "Image sizes must be positive");
+    return NULL;
+  }
+  if (ch < 1 || ch > MAXCHANNELS) {
+    im_push_errorf(aIMCTX, 0, "channels must be between 1 and %d", MAXCHANNELS);
+    return NULL;
+  }
+  bytes = x * y * ch * sample_size;
+  if (bytes / y / ch / sample_size != x
+      || (off_t)bytes < 0 || (size_t)(off_t)bytes != bytes) {
+    im_push_errorf(aIMCTX, 0, "integer overflow calculating image allocation");
+    return NULL;
+  }
+  line_bytes = sizeof(i_fcolor) * x;
+  if (line_bytes / x != sizeof(i_fcolor)) {
+    im_push_error(aIMCTX, 0, "integer overflow calculating scanline allocation");
+    return NULL;
+  }
+
+  fd = mmap_open(aIMCTX, path);
+  if (fd < 0)
+    return NULL;
+
+  /* the new pages read as zero, so there's no need to clear them */
+  if (ftruncate(fd, (off_t)bytes) < 0) {
+    int err = errno;
+    im_push_errorf(aIMCTX, err, "cannot size mmap file: %s (%d)",
+		   strerror(err), err);
+    close(fd);
+    return NULL;
+  }
+
+  data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    int err = errno;
+    im_push_errorf(aIMCTX, err, "cannot mmap image file: %s (%d)",
+		   strerror(err), err);
+    close(fd);
+    return NULL;
+  }
+  /* the mapping keeps the file open */
+  close(fd);
+
+#ifdef IMAGER_MADVISE
+  /* most processing works through the image a row at a time from the
+     top, so ask for read-ahead and early release of pages behind us */
+  madvise(data, bytes, MADV_SEQUENTIAL);
+#endif
+
+  /* create a small image of the right type and swap in the mapping */
+  if (bits == i_8_bits)
+    im = im_img_8_new(aIMCTX, 1, 1, ch);
+  else if (bits == i_16_bits)
+    im = im_img_16_new(aIMCTX, 1, 1, ch);
+  else
+    im = im_img_double_new(aIMCTX, 1, 1, ch);
+  if (!im) {
+    munmap(data, bytes);
+    return NULL;
+  }
+
+  myfree(im->idata);
+  im->idata = data;
+  im->xsize = x;
+  im->ysize = y;
+  im->bytes = bytes;
+  im->i_f_destroy = i_destroy_mmap;
+
+  im_log((aIMCTX, 1, "(%p) <- im_img_mmap_new\n", im));
+
+  return im;
+#else
+  im_clear_error(aIMCTX);
+  im_push_error(aIMCTX, 0, "mmap storage is not supported on this platform");
+  return NULL;
+#endif
+}
+
+#ifdef IMAGER_MMAP
+
+/*
+=back
+
+=head1 INTERNAL FUNCTIONS
+
+=over
+
+=item mmap_open(ctx, path)
+
+Create the file that will hold the samples and return a file
+descriptor for it, or -1 on failure.
+
+With a NULL I<path> a temporary file is created and unlinked.
+
+=cut
+*/
+
+static int
+mmap_open(pIMCTX, const char *path) {
+  int fd;
+
+  if (path) {
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+      int err = errno;
+      im_push_errorf(aIMCTX, err, "cannot create mmap file %s: %s (%d)",
+		     path, strerror(err), err);
+      return -1;
+    }
+  }
+  else {
+    const char *dir = getenv("TMPDIR");
+    char *name;
+
+    if (!dir || !*dir)
+      dir = "/tmp";
+    name = mymalloc(strlen(dir) + 20);
+    sprintf(name, "%s/imagerXXXXXX", dir);
+    fd = mkstemp(name);
+    if (fd < 0) {
+      int err = errno;
+      im_push_errorf(aIMCTX, err, "cannot create temporary file in %s: %s (%d)",
+		     dir, strerror(err), err);
+      myfree(name);
+      return -1;
+    }
+    /* the space is released when the mapping goes away */
+    unlink(name);
+    myfree(name);
+  }
+
+  return fd;
+}
+
+/*
+=item i_destroy_mmap(im)
+
+Unmap the samples, the mapping isn't memory from mymalloc() so it
+mustn't be left for i_img_exorcise() to release.
+
+=cut
+*/
+
+static void
+i_destroy_mmap(i_img *im) {
+  if (im->idata) {
+    munmap(im->idata, im->bytes);
+    im->idata = NULL;
+  }
+}
+
+#endif
+
+/*
+=back
+
+=head1 AUTHOR
+
+Tony Cook <tony@develop-help.com>
+
+=head1 SEE ALSO
+
+Imager(3), img8.c, img16.c, imgdouble.c
+
+=cut
+*/
@@ -143,6 +143,8 @@ im_img_pal_new(pIMCTX, i_img_dim x, i_img_dim y, int channels, int maxpal) {
   palext->count = 0;
   palext->alloc = maxpal;
   palext->last_found = -1;
+  memset(palext->hash, 0, sizeof(palext->hash));
+  palext->hash_count = 0;
   im->ext_data = palext;
   i_tags_new(&im->tags);
   im->bytes = bytes;
@@ -247,6 +249,49 @@ i_img *i_img_to_pal(i_img *src, i_quantize *quant) {
   }
 }
 
+/*
+=item i_img_to_pal_multi(quant, imgs, count, results)
+
+Converts the C<count> images in C<imgs> to paletted images sharing a
+palette built from all of them, storing the new images in
+C<results>.  The images are translated concurrently when threads are
+enabled.
+
+Returns non-zero on success.
+
+=cut
+*/
+int
+i_img_to_pal_multi(i_quantize *quant, i_img **imgs, int count,
+		   i_img **results) {
+  i_palidx **indexes;
+  int i;
+  dIMCTXim(imgs[0]);
+
+  i_clear_error();
+
+  i_quant_makemap(quant, imgs, count);
+  indexes = mymalloc(sizeof(i_palidx *) * count);
+  if (!i_quant_translate_multi(quant, imgs, count, indexes)) {
+    myfree(indexes);
+    return 0;
+  }
+
+  for (i = 0; i < count; ++i) {
+    i_img *im = i_img_pal_new(imgs[i]->xsize, imgs[i]->ysize,
+			      imgs[i]->channels, quant->mc_size);
+
+    memcpy(im->idata, indexes[i], im->bytes);
+    PALEXT(im)->count = quant->mc_count;
+    memcpy(PALEXT(im)->pal, quant->mc_colors, sizeof(i_color) * quant->mc_count);
+    myfree(indexes[i]);
+    results[i] = im;
+  }
+  myfree(indexes);
+
+  return 1;
+}
+
 /*
 =item i_img_to_rgb(i_img *src)
 
@@ -598,34 +643,94 @@ static int i_setcolors_p(i_img *im, int index, const i_color *colors, int count)
       PALEXT(im)->pal[index++] = *colors++;
       --count;
     }
+    /* entries may have moved anywhere, so rebuild the hash on the
+       next search */
+    memset(PALEXT(im)->hash, 0, sizeof(PALEXT(im)->hash));
+    PALEXT(im)->hash_count = 0;
     return 1;
   }
 
   return 0;
 }
 
+/*
+=item pal_hash_slot(im, color)
+
+Returns the hash slot to start probing from for C<color>, from the
+image's channels packed together.
+
+=cut
+*/
+static int
+pal_hash_slot(i_img *im, const i_color *color) {
+  unsigned long key = 0;
+  int ch;
+
+  for (ch = 0; ch < im->channels; ++ch)
+    key = (key << 8) | color->channel[ch];
+
+  return (int)(((key * 2654435761UL) & 0xFFFFFFFFUL) >> 16)
+    & (IM_PAL_HASH_SIZE - 1);
+}
+
+/*
+=item pal_hash_sync(im)
+
+Add any palette entries not in the hash yet.  An entry with the same
+color as an earlier entry isn't added, so searches find the first.
+
+=cut
+*/
+static void
+pal_hash_sync(i_img *im) {
+  i_img_pal_ext *palext = PALEXT(im);
+
+  while (palext->hash_count < palext->count) {
+    int index = palext->hash_count++;
+    const i_color *color = palext->pal + index;
+    int slot = pal_hash_slot(im, color);
+
+    while (palext->hash[slot]) {
+      if (color_eq(im, color, palext->pal + palext->hash[slot] - 1))
+	break;
+      slot = (slot + 1) & (IM_PAL_HASH_SIZE - 1);
+    }
+    if (!palext->hash[slot])
+      palext->hash[slot] = index + 1;
+  }
+}
+
 /*
 =item i_findcolor_p(i_img *im)
 
+Find the first palette entry with the given color through the hash.
+
 =cut
 */
 static int i_findcolor_p(i_img *im, const i_color *color, i_palidx *entry) {
-  if (PALEXT(im)->count) {
-    int i;
-    /* often the same color comes up several times in a row */
-    if (PALEXT(im)->last_found >= 0) {
-      if (color_eq(im, color, PALEXT(im)->pal + PALEXT(im)->last_found)) {
-        *entry = PALEXT(im)->last_found;
-        return 1;
-      }
-    }
-    for (i = 0; i < PALEXT(im)->count; ++i) {
-      if (color_eq(im, color, PALEXT(im)->pal + i)) {
-        PALEXT(im)->last_found = *entry = i;
-        return 1;
-      }
+  i_img_pal_ext *palext = PALEXT(im);
+  int slot;
+
+  /* often the same color comes up several times in a row */
+  if (palext->last_found >= 0 && palext->last_found < palext->count
+      && color_eq(im, color, palext->pal + palext->last_found)) {
+    *entry = palext->last_found;
+    return 1;
+  }
+
+  if (palext->hash_count < palext->count)
+    pal_hash_sync(im);
+
+  slot = pal_hash_slot(im, color);
+  while (palext->hash[slot]) {
+    int index = palext->hash[slot] - 1;
+    if (color_eq(im, color, palext->pal + index)) {
+      palext->last_found = *entry = index;
+      return 1;
     }
+    slot = (slot + 1) & (IM_PAL_HASH_SIZE - 1);
   }
+
   return 0;
 }
 
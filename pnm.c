@@ -421,59 +421,54 @@ read_pgm_ppm_ascii_16(io_glue *ig, i_img *im, int width, int height,
 }
 
 /*
-=item i_readpnm_wiol(ig, allow_incomplete)
+=item read_pnm_header(ig, type, width, height, maxval, channels)
 
-Retrieve an image and stores in the iolayer object. Returns NULL on fatal error.
+Read the header of a PNM file, leaving C<ig> positioned at the start
+of the image data.
 
-   ig     - io_glue object
-   allow_incomplete - allows a partial file to be read successfully
+Returns 0 on failure.
 
 =cut
 */
 
-i_img *
-i_readpnm_wiol( io_glue *ig, int allow_incomplete) {
-  i_img* im;
-  int type;
-  int width, height, maxval, channels;
+static int
+read_pnm_header(io_glue *ig, int *type, int *width, int *height, int *maxval,
+		int *channels) {
   int c;
 
-  i_clear_error();
-  mm_log((1,"i_readpnm(ig %p, allow_incomplete %d)\n", ig, allow_incomplete));
-
   c = i_io_getc(ig);
 
   if (c != 'P') {
     i_push_error(0, "bad header magic, not a PNM file");
     mm_log((1, "i_readpnm: Could not read header of file\n"));
-    return NULL;
+    return 0;
   }
 
   if ((c = i_io_getc(ig)) == EOF ) {
     mm_log((1, "i_readpnm: Could not read header of file\n"));
-    return NULL;
+    return 0;
   }
   
-  type = c - '0';
+  *type = c - '0';
 
-  if (type < 1 || type > 6) {
+  if (*type < 1 || *type > 6) {
     i_push_error(0, "unknown PNM file type, not a PNM file");
     mm_log((1, "i_readpnm: Not a pnm file\n"));
-    return NULL;
+    return 0;
   }
 
   if ( (c = i_io_getc(ig)) == EOF ) {
     mm_log((1, "i_readpnm: Could not read header of file\n"));
-    return NULL;
+    return 0;
   }
   
   if ( !misspace(c) ) {
     i_push_error(0, "unexpected character, not a PNM file");
     mm_log((1, "i_readpnm: Not a pnm file\n"));
-    return NULL;
+    return 0;
   }
   
-  mm_log((1, "i_readpnm: image is a %s\n", typenames[type-1] ));
+  mm_log((1, "i_readpnm: image is a %s\n", typenames[*type-1] ));
 
   
   /* Read sizes and such */
@@ -481,66 +476,82 @@ i_readpnm_wiol( io_glue *ig, int allow_incomplete) {
   if (!skip_comment(ig)) {
     i_push_error(0, "while skipping to width");
     mm_log((1, "i_readpnm: error reading before width\n"));
-    return NULL;
+    return 0;
   }
   
-  if (!gnum(ig, &width)) {
+  if (!gnum(ig, width)) {
     i_push_error(0, "could not read image width");
     mm_log((1, "i_readpnm: error reading width\n"));
-    return NULL;
+    return 0;
   }
 
   if (!skip_comment(ig)) {
     i_push_error(0, "while skipping to height");
     mm_log((1, "i_readpnm: error reading before height\n"));
-    return NULL;
+    return 0;
   }
 
-  if (!gnum(ig, &height)) {
+  if (!gnum(ig, height)) {
     i_push_error(0, "could not read image height");
     mm_log((1, "i_readpnm: error reading height\n"));
-    return NULL;
+    return 0;
   }
   
-  if (!(type == 1 || type == 4)) {
+  if (!(*type == 1 || *type == 4)) {
     if (!skip_comment(ig)) {
       i_push_error(0, "while skipping to maxval");
       mm_log((1, "i_readpnm: error reading before maxval\n"));
-      return NULL;
+      return 0;
     }
 
-    if (!gnum(ig, &maxval)) {
+    if (!gnum(ig, maxval)) {
       i_push_error(0, "could not read maxval");
       mm_log((1, "i_readpnm: error reading maxval\n"));
-      return NULL;
+      return 0;
     }
 
-    if (maxval == 0) {
+    if (*maxval == 0) {
       i_push_error(0, "maxval is zero - invalid pnm file");
       mm_log((1, "i_readpnm: maxval is zero, invalid pnm file\n"));
-      return NULL;
+      return 0;
     }
-    else if (maxval > 65535) {
+    else if (*maxval > 65535) {
       i_push_errorf(0, "maxval of %d is over 65535 - invalid pnm file", 
-		    maxval);
-      mm_log((1, "i_readpnm: maxval of %d is over 65535 - invalid pnm file\n", maxval));
-      return NULL;
+		    *maxval);
+      mm_log((1, "i_readpnm: maxval of %d is over 65535 - invalid pnm file\n", *maxval));
+      return 0;
     }
-  } else maxval=1;
+  } else *maxval=1;
 
   if ((c = i_io_getc(ig)) == EOF || !misspace(c)) {
     i_push_error(0, "garbage in header, invalid PNM file");
     mm_log((1, "i_readpnm: garbage in header\n"));
-    return NULL;
+    return 0;
   }
 
-  channels = (type == 3 || type == 6) ? 3:1;
+  *channels = (*type == 3 || *type == 6) ? 3:1;
 
-  if (!i_int_check_image_file_limits(width, height, channels, sizeof(i_sample_t))) {
+  if (!i_int_check_image_file_limits(*width, *height, *channels, sizeof(i_sample_t))) {
     mm_log((1, "i_readpnm: image size exceeds limits\n"));
-    return NULL;
+    return 0;
   }
 
+  return 1;
+}
+
+/*
+=item read_pnm_body(ig, type, width, height, maxval, channels, allow_incomplete)
+
+Read the image data following a header read by read_pnm_header().
+
+=cut
+*/
+
+static i_img *
+read_pnm_body(io_glue *ig, int type, int width, int height, int maxval,
+	      int channels, int allow_incomplete) {
+  i_img *im;
+
   mm_log((1, "i_readpnm: (%d x %d), channels = %d, maxval = %d\n", width, height, channels, maxval));
 
   if (type == 1 || type == 4) {
@@ -598,6 +609,159 @@ i_readpnm_wiol( io_glue *ig, int allow_incomplete) {
   return im;
 }
 
+/*
+=item i_readpnm_wiol(ig, allow_incomplete)
+
+Retrieve an image and stores in the iolayer object. Returns NULL on fatal error.
+
+   ig     - io_glue object
+   allow_incomplete - allows a partial file to be read successfully
+
+=cut
+*/
+
+i_img *
+i_readpnm_wiol( io_glue *ig, int allow_incomplete) {
+  int type;
+  int width, height, maxval, channels;
+
+  i_clear_error();
+  mm_log((1,"i_readpnm(ig %p, allow_incomplete %d)\n", ig, allow_incomplete));
+
+  if (!read_pnm_header(ig, &type, &width, &height, &maxval, &channels))
+    return NULL;
+
+  return read_pnm_body(ig, type, width, height, maxval, channels,
+		       allow_incomplete);
+}
+
+/* state for a i_readpnm_rows_wiol() image */
+typedef struct {
+  io_glue *ig;
+  int type;
+  int width;
+  int channels;
+  int maxval;
+  size_t read_size;
+  unsigned char *read_buf;
+} pnm_rows;
+
+static int
+pnm_rows_read(void *data, i_img_dim y, i_sample_t *samps) {
+  pnm_rows *rows = data;
+  unsigned char *readp = rows->read_buf;
+  size_t count = (size_t)rows->width * rows->channels;
+  size_t i;
+
+  if (i_io_read(rows->ig, rows->read_buf, rows->read_size)
+      != rows->read_size) {
+    i_push_error(0, "short read - file truncated?");
+    return 0;
+  }
+
+  if (rows->type == 4) {
+    unsigned mask = 0x80;
+    for (i = 0; i < count; ++i) {
+      samps[i] = *readp & mask ? 0 : 255;
+      mask >>= 1;
+      if (mask == 0) {
+	++readp;
+	mask = 0x80;
+      }
+    }
+  }
+  else if (rows->maxval > 255) {
+    unsigned maxval = rows->maxval;
+    for (i = 0; i < count; ++i) {
+      unsigned sample = (readp[0] << 8) + readp[1];
+      if (sample > maxval)
+	sample = maxval;
+      readp += 2;
+      samps[i] = (sample * 255 + maxval / 2) / maxval;
+    }
+  }
+  else if (rows->maxval == 255) {
+    memcpy(samps, readp, count);
+  }
+  else {
+    unsigned maxval = rows->maxval;
+    for (i = 0; i < count; ++i) {
+      /* we just clamp samples to the correct range */
+      unsigned sample = readp[i];
+      if (sample > maxval)
+	sample = maxval;
+      samps[i] = (sample * 255 + maxval / 2) / maxval;
+    }
+  }
+
+  return 1;
+}
+
+static void
+pnm_rows_destroy(void *data) {
+  pnm_rows *rows = data;
+
+  myfree(rows->read_buf);
+  myfree(rows);
+}
+
+/*
+=item i_readpnm_rows_wiol(ig)
+
+Read the header of a PNM file and return a read-only row image (see
+im_img_rows_new()) that reads each row of the image data from C<ig>
+as it is requested.
+
+Only the binary formats can be read a row at a time, the image is
+produced with 8-bit gray or RGB samples whatever the maxval of the
+file.  The ASCII formats are read completely, as i_readpnm_wiol()
+does.
+
+C<ig> must stay open until the image is destroyed.
+
+=cut
+*/
+
+i_img *
+i_readpnm_rows_wiol(io_glue *ig) {
+  int type;
+  int width, height, maxval, channels;
+  pnm_rows *rows;
+  i_img *im;
+
+  i_clear_error();
+  mm_log((1,"i_readpnm_rows_wiol(ig %p)\n", ig));
+
+  if (!read_pnm_header(ig, &type, &width, &height, &maxval, &channels))
+    return NULL;
+
+  if (type < 4)
+    return read_pnm_body(ig, type, width, height, maxval, channels, 0);
+
+  rows = mymalloc(sizeof(pnm_rows));
+  rows->ig = ig;
+  rows->type = type;
+  rows->width = width;
+  rows->channels = channels;
+  rows->maxval = maxval;
+  if (type == 4)
+    rows->read_size = (width + 7) / 8;
+  else
+    rows->read_size = (size_t)width * channels * (maxval > 255 ? 2 : 1);
+  rows->read_buf = mymalloc(rows->read_size);
+
+  im = i_img_rows_new(width, height, channels, 1, pnm_rows_read,
+		      pnm_rows_destroy, rows);
+  if (!im)
+    return NULL;
+
+  i_tags_add(&im->tags, "i_format", 0, "pnm", -1, 0);
+  i_tags_setn(&im->tags, "pnm_maxval", maxval);
+  i_tags_setn(&im->tags, "pnm_type", type);
+
+  return im;
+}
+
 static void free_images(i_img **imgs, int count) {
   int i;
 
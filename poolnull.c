@@ -0,0 +1,53 @@
+/*
+  dummy worker pool, for non-threaded builds
+*/
+
+#include "imageri.h"
+
+/* documented in poolwin.c */
+
+im_thread_pool_t
+im_thread_pool_new(im_context_t ctx, int workers) {
+  (void)workers;
+
+  im_push_error(ctx, 0, "this build of Imager doesn't support threads");
+
+  return NULL;
+}
+
+void
+im_thread_pool_destroy(im_thread_pool_t pool) {
+  (void)pool;
+}
+
+void
+im_thread_pool_run(im_thread_pool_t pool, im_parallel_band_f f, void *data,
+		   i_img_dim start, i_img_dim end, int bands) {
+  (void)pool;
+  (void)bands;
+
+  f(data, start, end);
+}
+
+im_thread_worker_t
+im_thread_worker_new(void) {
+  return NULL;
+}
+
+void
+im_thread_worker_start(im_thread_worker_t worker, im_thread_job_f f,
+		       void *data) {
+  (void)worker;
+
+  f(data);
+}
+
+void
+im_thread_worker_wait(im_thread_worker_t worker) {
+  (void)worker;
+}
+
+void
+im_thread_worker_destroy(im_thread_worker_t worker) {
+  (void)worker;
+}
@@ -0,0 +1,254 @@
+/*
+  pthreads worker pool for im_parallel_for()
+*/
+
+#include "imageri.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+
+/* documented in poolwin.c */
+
+struct im_thread_pool_tag {
+  int count;
+  pthread_t *threads;
+  pthread_mutex_t mutex;
+  pthread_cond_t start_cond;
+  pthread_cond_t done_cond;
+  unsigned long generation;
+  int quit;
+
+  /* the current job */
+  im_parallel_band_f f;
+  void *data;
+  i_img_dim start, end;
+  int bands;
+  int next_band;
+  int bands_done;
+};
+
+/* run bands of the current job until there are none left, called
+   and returns with the mutex held */
+static void
+run_bands(im_thread_pool_t pool) {
+  while (pool->next_band < pool->bands) {
+    int band = pool->next_band++;
+    i_img_dim band_start =
+      im_band_start(pool->start, pool->end, pool->bands, band);
+    i_img_dim band_end =
+      im_band_start(pool->start, pool->end, pool->bands, band + 1);
+
+    pthread_mutex_unlock(&pool->mutex);
+    pool->f(pool->data, band_start, band_end);
+    pthread_mutex_lock(&pool->mutex);
+
+    if (++pool->bands_done == pool->bands)
+      pthread_cond_broadcast(&pool->done_cond);
+  }
+}
+
+static void *
+worker(void *p) {
+  im_thread_pool_t pool = p;
+  unsigned long seen = 0;
+
+  pthread_mutex_lock(&pool->mutex);
+  for (;;) {
+    while (!pool->quit && pool->generation == seen)
+      pthread_cond_wait(&pool->start_cond, &pool->mutex);
+    if (pool->quit)
+      break;
+    seen = pool->generation;
+    run_bands(pool);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  return NULL;
+}
+
+im_thread_pool_t
+im_thread_pool_new(im_context_t ctx, int workers) {
+  im_thread_pool_t pool = malloc(sizeof(*pool));
+  sigset_t all, old;
+  int i;
+
+  if (!pool) {
+    im_push_error(ctx, 0, "cannot allocate thread pool");
+    return NULL;
+  }
+  pool->threads = malloc(sizeof(pthread_t) * workers);
+  if (!pool->threads) {
+    free(pool);
+    im_push_error(ctx, 0, "cannot allocate thread pool");
+    return NULL;
+  }
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->start_cond, NULL);
+  pthread_cond_init(&pool->done_cond, NULL);
+  pool->generation = 0;
+  pool->quit = 0;
+  pool->f = NULL;
+  pool->bands = pool->next_band = pool->bands_done = 0;
+
+  /* signals should be delivered to perl's threads, not ours */
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  for (i = 0; i < workers; ++i) {
+    int rc = pthread_create(pool->threads + i, NULL, worker, pool);
+    if (rc) {
+      pthread_sigmask(SIG_SETMASK, &old, NULL);
+      pool->count = i;
+      im_thread_pool_destroy(pool);
+      im_push_errorf(ctx, rc, "cannot create worker thread: %d", rc);
+      return NULL;
+    }
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  pool->count = workers;
+
+  return pool;
+}
+
+void
+im_thread_pool_destroy(im_thread_pool_t pool) {
+  int i;
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->quit = 1;
+  pthread_cond_broadcast(&pool->start_cond);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (i = 0; i < pool->count; ++i)
+    pthread_join(pool->threads[i], NULL);
+
+  pthread_cond_destroy(&pool->done_cond);
+  pthread_cond_destroy(&pool->start_cond);
+  pthread_mutex_destroy(&pool->mutex);
+  free(pool->threads);
+  free(pool);
+}
+
+void
+im_thread_pool_run(im_thread_pool_t pool, im_parallel_band_f f, void *data,
+		   i_img_dim start, i_img_dim end, int bands) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->f = f;
+  pool->data = data;
+  pool->start = start;
+  pool->end = end;
+  pool->bands = bands;
+  pool->next_band = 0;
+  pool->bands_done = 0;
+  ++pool->generation;
+  pthread_cond_broadcast(&pool->start_cond);
+
+  /* the calling thread works too */
+  run_bands(pool);
+  while (pool->bands_done < pool->bands)
+    pthread_cond_wait(&pool->done_cond, &pool->mutex);
+
+  pool->f = NULL;
+  pool->data = NULL;
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+struct im_thread_worker_tag {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t start_cond;
+  pthread_cond_t done_cond;
+  int quit;
+
+  /* the current job, NULL when idle */
+  im_thread_job_f f;
+  void *data;
+};
+
+static void *
+worker_main(void *p) {
+  im_thread_worker_t worker = p;
+
+  pthread_mutex_lock(&worker->mutex);
+  while (1) {
+    while (!worker->f && !worker->quit)
+      pthread_cond_wait(&worker->start_cond, &worker->mutex);
+    if (!worker->f)
+      break;
+
+    pthread_mutex_unlock(&worker->mutex);
+    worker->f(worker->data);
+    pthread_mutex_lock(&worker->mutex);
+
+    worker->f = NULL;
+    pthread_cond_signal(&worker->done_cond);
+  }
+  pthread_mutex_unlock(&worker->mutex);
+
+  return NULL;
+}
+
+im_thread_worker_t
+im_thread_worker_new(void) {
+  im_thread_worker_t worker = malloc(sizeof(*worker));
+  sigset_t all, old;
+  int rc;
+
+  if (!worker)
+    return NULL;
+  worker->quit = 0;
+  worker->f = NULL;
+  worker->data = NULL;
+  pthread_mutex_init(&worker->mutex, NULL);
+  pthread_cond_init(&worker->start_cond, NULL);
+  pthread_cond_init(&worker->done_cond, NULL);
+
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  rc = pthread_create(&worker->thread, NULL, worker_main, worker);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (rc) {
+    pthread_cond_destroy(&worker->done_cond);
+    pthread_cond_destroy(&worker->start_cond);
+    pthread_mutex_destroy(&worker->mutex);
+    free(worker);
+    return NULL;
+  }
+
+  return worker;
+}
+
+void
+im_thread_worker_start(im_thread_worker_t worker, im_thread_job_f f,
+		       void *data) {
+  pthread_mutex_lock(&worker->mutex);
+  worker->f = f;
+  worker->data = data;
+  pthread_cond_signal(&worker->start_cond);
+  pthread_mutex_unlock(&worker->mutex);
+}
+
+void
+im_thread_worker_wait(im_thread_worker_t worker) {
+  pthread_mutex_lock(&worker->mutex);
+  while (worker->f)
+    pthread_cond_wait(&worker->done_cond, &worker->mutex);
+  pthread_mutex_unlock(&worker->mutex);
+}
+
+void
+im_thread_worker_destroy(im_thread_worker_t worker) {
+  pthread_mutex_lock(&worker->mutex);
+  while (worker->f)
+    pthread_cond_wait(&worker->done_cond, &worker->mutex);
+  worker->quit = 1;
+  pthread_cond_signal(&worker->start_cond);
+  pthread_mutex_unlock(&worker->mutex);
+
+  pthread_join(worker->thread, NULL);
+
+  pthread_cond_destroy(&worker->done_cond);
+  pthread_cond_destroy(&worker->start_cond);
+  pthread_mutex_destroy(&worker->mutex);
+  free(worker);
+}
@@ -0,0 +1,355 @@
+/*
+=head1 NAME
+
+poolwin.c - Imager's worker thread pool
+
+=head1 DESCRIPTION
+
+A fixed set of worker threads used by im_parallel_for() to process
+bands of rows concurrently.  The thread calling
+im_thread_pool_run() processes bands too, so a context set to use N
+threads has a pool of N-1 workers.
+
+This file implements the pool for Win32, poolpthr.c for POSIX threads
+and poolnull.c for builds without thread support.
+
+=head1 FUNCTIONS
+
+=over
+
+=cut
+*/
+
+#include "imageri.h"
+
+#include <windows.h>
+
+struct im_thread_pool_tag {
+  int count;
+  HANDLE *threads;
+  CRITICAL_SECTION section;
+  HANDLE work_sem;
+  HANDLE done_event;
+  int quit;
+
+  /* the current job */
+  im_parallel_band_f f;
+  void *data;
+  i_img_dim start, end;
+  int bands;
+  int next_band;
+  int bands_done;
+};
+
+/* run bands of the current job until there are none left, called
+   and returns inside the critical section */
+static void
+run_bands(im_thread_pool_t pool) {
+  while (pool->next_band < pool->bands) {
+    int band = pool->next_band++;
+    i_img_dim band_start =
+      im_band_start(pool->start, pool->end, pool->bands, band);
+    i_img_dim band_end =
+      im_band_start(pool->start, pool->end, pool->bands, band + 1);
+
+    LeaveCriticalSection(&pool->section);
+    pool->f(pool->data, band_start, band_end);
+    EnterCriticalSection(&pool->section);
+
+    if (++pool->bands_done == pool->bands)
+      SetEvent(pool->done_event);
+  }
+}
+
+static DWORD WINAPI
+worker(LPVOID p) {
+  im_thread_pool_t pool = p;
+
+  for (;;) {
+    WaitForSingleObject(pool->work_sem, INFINITE);
+    EnterCriticalSection(&pool->section);
+    if (pool->quit) {
+      LeaveCriticalSection(&pool->section);
+      break;
+    }
+    run_bands(pool);
+    LeaveCriticalSection(&pool->section);
+  }
+
+  return 0;
+}
+
+/*
+=item im_thread_pool_new(ctx, workers)
+
+Create a pool of C<workers> threads.
+
+Returns NULL and pushes an error onto C<ctx>'s error stack if the
+threads can't be created.
+
+=cut
+*/
+
+im_thread_pool_t
+im_thread_pool_new(im_context_t ctx, int workers) {
+  im_thread_pool_t pool = malloc(sizeof(*pool));
+  int i;
+
+  if (!pool) {
+    im_push_error(ctx, 0, "cannot allocate thread pool");
+    return NULL;
+  }
+  pool->threads = malloc(sizeof(HANDLE) * workers);
+  if (!pool->threads) {
+    free(pool);
+    im_push_error(ctx, 0, "cannot allocate thread pool");
+    return NULL;
+  }
+  InitializeCriticalSection(&pool->section);
+  pool->work_sem = CreateSemaphore(NULL, 0, workers, NULL);
+  pool->done_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+  pool->quit = 0;
+  pool->f = NULL;
+  pool->bands = pool->next_band = pool->bands_done = 0;
+  pool->count = 0;
+  if (!pool->work_sem || !pool->done_event) {
+    im_push_errorf(ctx, GetLastError(), "cannot create pool events: %ld",
+		   (long)GetLastError());
+    im_thread_pool_destroy(pool);
+    return NULL;
+  }
+
+  for (i = 0; i < workers; ++i) {
+    pool->threads[i] = CreateThread(NULL, 0, worker, pool, 0, NULL);
+    if (!pool->threads[i]) {
+      im_push_errorf(ctx, GetLastError(), "cannot create worker thread: %ld",
+		     (long)GetLastError());
+      im_thread_pool_destroy(pool);
+      return NULL;
+    }
+    pool->count = i + 1;
+  }
+
+  return pool;
+}
+
+/*
+=item im_thread_pool_destroy(pool)
+
+Stop the pool's worker threads and release the pool.
+
+=cut
+*/
+
+void
+im_thread_pool_destroy(im_thread_pool_t pool) {
+  int i;
+
+  EnterCriticalSection(&pool->section);
+  pool->quit = 1;
+  LeaveCriticalSection(&pool->section);
+  if (pool->count)
+    ReleaseSemaphore(pool->work_sem, pool->count, NULL);
+
+  for (i = 0; i < pool->count; ++i) {
+    WaitForSingleObject(pool->threads[i], INFINITE);
+    CloseHandle(pool->threads[i]);
+  }
+
+  if (pool->done_event)
+    CloseHandle(pool->done_event);
+  if (pool->work_sem)
+    CloseHandle(pool->work_sem);
+  DeleteCriticalSection(&pool->section);
+  free(pool->threads);
+  free(pool);
+}
+
+/*
+=item im_thread_pool_run(pool, f, data, start, end, bands)
+
+Split C<start> to C<end> into C<bands> bands and call C<f> for each
+band, spread across the pool's workers and the calling thread.
+
+Returns once every band has been processed.
+
+=cut
+*/
+
+void
+im_thread_pool_run(im_thread_pool_t pool, im_parallel_band_f f, void *data,
+		   i_img_dim start, i_img_dim end, int bands) {
+  int wake;
+
+  EnterCriticalSection(&pool->section);
+  pool->f = f;
+  pool->data = data;
+  pool->start = start;
+  pool->end = end;
+  pool->bands = bands;
+  pool->next_band = 0;
+  pool->bands_done = 0;
+  ResetEvent(pool->done_event);
+
+  /* tokens left over from a previous job only cause a worker to find
+     there's nothing to do, so the semaphore may already be full */
+  wake = bands - 1 < pool->count ? bands - 1 : pool->count;
+  if (wake > 0)
+    ReleaseSemaphore(pool->work_sem, wake, NULL);
+
+  /* the calling thread works too */
+  run_bands(pool);
+  while (pool->bands_done < pool->bands) {
+    LeaveCriticalSection(&pool->section);
+    WaitForSingleObject(pool->done_event, INFINITE);
+    EnterCriticalSection(&pool->section);
+  }
+
+  pool->f = NULL;
+  pool->data = NULL;
+  LeaveCriticalSection(&pool->section);
+}
+
+struct im_thread_worker_tag {
+  HANDLE thread;
+  HANDLE start_event;
+  HANDLE done_event;
+  int quit;
+
+  /* the current job, only touched by the owning thread while the
+     worker is idle */
+  im_thread_job_f f;
+  void *data;
+  int busy;
+};
+
+static DWORD WINAPI
+worker_main(LPVOID p) {
+  im_thread_worker_t worker = p;
+
+  while (1) {
+    WaitForSingleObject(worker->start_event, INFINITE);
+    if (worker->quit)
+      break;
+    worker->f(worker->data);
+    SetEvent(worker->done_event);
+  }
+
+  return 0;
+}
+
+/*
+=item im_thread_worker_new()
+
+Create a single background thread that runs one job at a time, for
+I/O that should overlap with processing in the calling thread.  The
+thread is kept until im_thread_worker_destroy(), rather than started
+for each job.
+
+Returns NULL if the thread can't be created, or for builds without
+thread support, in which case the caller should call the job
+functions itself.
+
+=cut
+*/
+
+im_thread_worker_t
+im_thread_worker_new(void) {
+  im_thread_worker_t worker = malloc(sizeof(*worker));
+
+  if (!worker)
+    return NULL;
+  worker->quit = 0;
+  worker->f = NULL;
+  worker->data = NULL;
+  worker->busy = 0;
+  worker->start_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+  worker->done_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (!worker->start_event || !worker->done_event) {
+    if (worker->start_event)
+      CloseHandle(worker->start_event);
+    if (worker->done_event)
+      CloseHandle(worker->done_event);
+    free(worker);
+    return NULL;
+  }
+
+  worker->thread = CreateThread(NULL, 0, worker_main, worker, 0, NULL);
+  if (!worker->thread) {
+    CloseHandle(worker->start_event);
+    CloseHandle(worker->done_event);
+    free(worker);
+    return NULL;
+  }
+
+  return worker;
+}
+
+/*
+=item im_thread_worker_start(worker, f, data)
+
+Call C<f> with C<data> on the worker's thread.  The worker must be
+idle, call im_thread_worker_wait() first if a job may be running.
+
+=cut
+*/
+
+void
+im_thread_worker_start(im_thread_worker_t worker, im_thread_job_f f,
+		       void *data) {
+  worker->f = f;
+  worker->data = data;
+  worker->busy = 1;
+  SetEvent(worker->start_event);
+}
+
+/*
+=item im_thread_worker_wait(worker)
+
+Wait for the current job, if any, to finish.
+
+=cut
+*/
+
+void
+im_thread_worker_wait(im_thread_worker_t worker) {
+  if (worker->busy) {
+    WaitForSingleObject(worker->done_event, INFINITE);
+    worker->busy = 0;
+  }
+}
+
+/*
+=item im_thread_worker_destroy(worker)
+
+Wait for the current job, if any, then end the worker's thread and
+release the worker.
+
+=cut
+*/
+
+void
+im_thread_worker_destroy(im_thread_worker_t worker) {
+  im_thread_worker_wait(worker);
+  worker->quit = 1;
+  SetEvent(worker->start_event);
+  WaitForSingleObject(worker->thread, INFINITE);
+  CloseHandle(worker->thread);
+  CloseHandle(worker->start_event);
+  CloseHandle(worker->done_event);
+  free(worker);
+}
+
+/*
+=back
+
+=head1 AUTHOR
+
+Tony Cook <tony@develop-help.com>
+
+=head1 SEE ALSO
+
+Imager(3)
+
+=cut
+*/
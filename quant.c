@@ -8,6 +8,7 @@
 static void makemap_webmap(i_quantize *);
 static void makemap_addi(i_quantize *, i_img **imgs, int count);
 static void makemap_mediancut(i_quantize *, i_img **imgs, int count);
+static void makemap_wu(i_quantize *, i_img **imgs, int count);
 static void makemap_mono(i_quantize *);
 static void makemap_gray(i_quantize *, int step);
 
@@ -69,6 +70,10 @@ i_quant_makemap(i_quantize *quant, i_img **imgs, int count) {
     makemap_mediancut(quant, imgs, count);
     break;
 
+  case mc_wu:
+    makemap_wu(quant, imgs, count);
+    break;
+
   case mc_mono:
     makemap_mono(quant);
     break;
@@ -92,9 +97,49 @@ i_quant_makemap(i_quantize *quant, i_img **imgs, int count) {
   }
 }
 
-static void translate_closest(i_quantize *, i_img *, i_palidx *);
-static void translate_errdiff(i_quantize *, i_img *, i_palidx *);
-static void translate_addi(i_quantize *, i_img *, i_palidx *);
+static void translate_image(i_quantize *, struct i_quant_lookup_tag *,
+			    int is_gray, unsigned long seed, i_img *,
+			    i_palidx *);
+static void translate_errdiff(i_quantize *, struct i_quant_lookup_tag *,
+			      int is_gray, i_img *, i_palidx *);
+static void translate_addi(i_quantize *, struct i_quant_lookup_tag *,
+			   int pixdev, unsigned long seed, i_img *,
+			   i_palidx *);
+static int is_gray_map(const i_quantize *quant);
+static void lookup_setup(i_quantize *);
+static struct i_quant_lookup_tag *lookup_new(i_quantize *);
+static void lookup_free(struct i_quant_lookup_tag *);
+
+/* check the palette and options are usable for translation */
+static int
+translate_check(i_quantize *quant) {
+  /* there must be at least one color in the paletted (though even that
+     isn't very useful */
+  if (quant->mc_count == 0) {
+    i_push_error(0, "no colors available for translation");
+    return 0;
+  }
+  if (quant->version >= 2 && quant->lookup_bits != 0
+      && quant->lookup_bits != 5 && quant->lookup_bits != 6) {
+    i_push_error(0, "lookup_bits must be 0, 5 or 6");
+    return 0;
+  }
+
+  return 1;
+}
+
+/* number of bytes of indexes for img, or 0 on overflow */
+static size_t
+translate_bytes(i_img *img) {
+  size_t bytes = img->xsize * img->ysize;
+
+  if (bytes / img->ysize != img->xsize) {
+    i_push_error(0, "integer overflow calculating memory allocation");
+    return 0;
+  }
+
+  return bytes;
+}
 
 /*
 =item i_quant_translate(C<quant>, C<img>)
@@ -122,42 +167,163 @@ i_quant_translate(i_quantize *quant, i_img *img) {
 
   mm_log((1, "quant_translate(quant %p, img %p)\n", quant, img));
 
-  /* there must be at least one color in the paletted (though even that
-     isn't very useful */
-  if (quant->mc_count == 0) {
-    i_push_error(0, "no colors available for translation");
+  if (!translate_check(quant))
     return NULL;
-  }
 
-  bytes = img->xsize * img->ysize;
-  if (bytes / img->ysize != img->xsize) {
-    i_push_error(0, "integer overflow calculating memory allocation");
+  bytes = translate_bytes(img);
+  if (!bytes)
     return NULL;
-  }
   result = mymalloc(bytes);
 
+  lookup_setup(quant);
+
+  translate_image(quant, quant->version >= 2 ? quant->lookup : NULL,
+		  quant->translate == pt_errdiff && is_gray_map(quant),
+		  im_context_next_seed(img->context), img, result);
+  
+  return result;
+}
+
+typedef struct {
+  i_quantize *quant;
+  i_img **imgs;
+  i_palidx **results;
+  int is_gray;
+  unsigned long seed;
+} quant_trans_info;
+
+/* translate the images from start to end - 1, the inverse color map
+   is filled in as it's used, so only the first band uses the one
+   kept in quant, the others build their own */
+static void
+quant_trans_bands(void *p, i_img_dim start, i_img_dim end) {
+  quant_trans_info *info = p;
+  struct i_quant_lookup_tag *lk =
+    start == 0 ? info->quant->lookup : lookup_new(info->quant);
+  i_img_dim i;
+
+  /* each image gets its own seed for perturb */
+  for (i = start; i < end; ++i)
+    translate_image(info->quant, lk, info->is_gray, info->seed + i,
+		    info->imgs[i], info->results[i]);
+
+  if (start != 0)
+    lookup_free(lk);
+}
+
+/*
+=item i_quant_translate_multi(C<quant>, C<imgs>, C<count>, C<results>)
+
+=category Image quantization
+
+Quantize each of the C<count> images in C<imgs> given the palette in
+C<quant>, storing a block of C<< xsize * ysize >> C<i_palidx> entries
+for each image in C<results>, as i_quant_translate() would return.
+
+Since the images are independent once the palette is fixed, they're
+translated concurrently when threads have been set with
+im_context_set_threads(), with identical results.  This needs the
+inverse color map, so C<lookup_bits> must be non-zero.
+
+Returns non-zero on success, and you should call myfree() on each
+block in C<results>.  On failure returns zero and C<results> is left
+untouched.
+
+=cut
+*/
+
+int
+i_quant_translate_multi(i_quantize *quant, i_img **imgs, int count,
+			i_palidx **results) {
+  quant_trans_info info;
+  im_context_t ctx;
+  int threads, i;
+
+  mm_log((1, "i_quant_translate_multi(quant %p, imgs %p, count %d, results %p)\n",
+	  quant, imgs, count, results));
+
+  if (count <= 0) {
+    i_push_error(0, "no images to translate");
+    return 0;
+  }
+  if (!translate_check(quant))
+    return 0;
+  for (i = 0; i < count; ++i) {
+    if (!translate_bytes(imgs[i]))
+      return 0;
+  }
+
+  ctx = imgs[0]->context;
+  threads = im_context_get_threads(ctx);
+  lookup_setup(quant);
+  if (quant->version < 2 || !quant->lookup
+      || (quant->translate != pt_closest && quant->translate != pt_giflib
+	  && quant->translate != pt_errdiff
+	  && quant->translate != pt_perturb))
+    threads = 1;
+  for (i = 0; i < count; ++i) {
+    results[i] = mymalloc(translate_bytes(imgs[i]));
+    if (!im_img_parallel_read_ok(imgs[i]))
+      threads = 1;
+  }
+
+  info.quant = quant;
+  info.imgs = imgs;
+  info.results = results;
+  info.is_gray = quant->translate == pt_errdiff && is_gray_map(quant);
+  info.seed = im_context_next_seed(ctx);
+
+  if (threads > 1 && count > 1)
+    im_parallel_for(ctx, 0, count, 1, quant_trans_bands, &info);
+  else
+    quant_trans_bands(&info, 0, count);
+
+  return 1;
+}
+
+/*
+=item i_quant_cleanup(C<quant>)
+
+=category Image quantization
+
+Release any data i_quant_translate() has cached in C<quant>, such as
+the inverse color map.  Call this when you're done translating images
+with C<quant>.
+
+This doesn't release C<< quant->mc_colors >> or C<< quant->ed_map >>,
+which belong to the caller.
+
+=cut
+*/
+
+void
+i_quant_cleanup(i_quantize *quant) {
+  if (quant->version >= 2 && quant->lookup) {
+    lookup_free(quant->lookup);
+    quant->lookup = NULL;
+  }
+}
+
+/* translate one image, lk is the inverse color map to use, if any,
+   seed is used for the random numbers perturb needs */
+static void
+translate_image(i_quantize *quant, struct i_quant_lookup_tag *lk,
+		int is_gray, unsigned long seed, i_img *img, i_palidx *out) {
   switch (quant->translate) {
   case pt_closest:
   case pt_giflib:
-    translate_closest(quant, img, result);
+    translate_addi(quant, lk, 0, seed, img, out);
     break;
     
   case pt_errdiff:
-    translate_errdiff(quant, img, result);
+    translate_errdiff(quant, lk, is_gray, img, out);
     break;
     
   case pt_perturb:
   default:
-    translate_addi(quant, img, result);
+    translate_addi(quant, lk, quant->perturb, seed, img, out);
     break;
   }
-  
-  return result;
-}
-
-static void translate_closest(i_quantize *quant, i_img *img, i_palidx *out) {
-  quant->perturb = 0;
-  translate_addi(quant, img, out);
 }
 
 #define PWR2(x) ((x)*(x))
@@ -185,12 +351,12 @@ typedef struct {
   int pdc;
 } pbox;
 
-static void prescan(i_img **im,int count, int cnum, cvec *clr, i_sample_t *line);
+static void prescan(i_quantize *quant, i_img **im, int count, int cnum, cvec *clr, i_rand_state *rs);
 static void reorder(pbox prescan[512]);
 static int pboxcmp(const pbox *a,const pbox *b);
 static void boxcenter(int box,cvec *cv);
-static float frandn(void);
-static void boxrand(int box,cvec *cv);
+static float frandn(i_rand_state *rs);
+static void boxrand(int box,cvec *cv,i_rand_state *rs);
 static void bbox(int box,int *r0,int *r1,int *g0,int *g1,int *b0,int *b1);
 static void cr_hashindex(cvec clr[256],int cnum,hashbox hb[512]);
 static int mindist(int boxnum,cvec *cv);
@@ -214,8 +380,8 @@ g_sat(int in) {
 
 static
 float
-frand(void) {
-  return rand()/(RAND_MAX+1.0);
+frand(i_rand_state *rs) {
+  return i_rand_double(rs);
 }
 
 #ifdef NOTEF
@@ -241,6 +407,240 @@ return PWR2(c1->channel[0]-c2->channel[0])
 static const int
 gray_samples[] = { 0, 0, 0 };
 
+/*
+=item quant_histogram(quant, imgs, count, kind, hist)
+
+Count the pixels of the C<count> images in C<imgs> into C<hist>, a
+histogram of the given C<kind>:
+
+=over
+
+=item *
+
+C<qh_medcut> - an array of C<MEDIAN_CUT_COLORS> unsigned long
+counts, indexed by the top 5 bits of each channel.
+
+=item *
+
+C<qh_prescan> - an array of 512 unsigned long counts, indexed by the
+top 3 bits of each channel, as pixbox() does.
+
+=item *
+
+C<qh_wu> - an array of C<WU_CELLS> wu_moment, indexed by WU_INDEX()
+of the top 5 bits of each channel plus 1.
+
+=back
+
+C<hist> must be zeroed by the caller.
+
+If C<< quant->sample >> is more than 1 only every that many pixels of
+every that many rows are counted.
+
+The rows of all of the images are split into bands, one per thread
+set by im_context_set_threads(), each counted into a private
+histogram by im_parallel_for(), and the band histograms are then
+added together.  The counts are integers, so the result doesn't
+depend on the thread count.
+
+=cut
+*/
+
+/* the pixel and row step when building a color map */
+#define QUANT_SAMPLE_STEP(quant) \
+  ((quant)->version >= 2 && (quant)->sample > 1 ? (quant)->sample : 1)
+
+enum {
+  qh_medcut,
+  qh_prescan,
+  qh_wu
+};
+
+#define MEDIAN_CUT_COLORS 32768
+
+#define WU_SIDE 33
+#define WU_INDEX(r, g, b) (((r) * WU_SIDE + (g)) * WU_SIDE + (b))
+#define WU_CELLS (WU_SIDE * WU_SIDE * WU_SIDE)
+
+typedef struct {
+  double wt, mr, mg, mb, m2;
+} wu_moment;
+
+typedef struct {
+  i_img **imgs;
+  int count;
+  int kind;
+  int step;
+  /* sampled rows over all of the images */
+  i_img_dim rows;
+  i_img_dim maxwidth;
+  int bands;
+  /* one histogram per band */
+  void **hists;
+} quant_hist_info;
+
+static size_t
+quant_hist_size(int kind) {
+  switch (kind) {
+  case qh_medcut:
+    return sizeof(unsigned long) * MEDIAN_CUT_COLORS;
+
+  case qh_prescan:
+    return sizeof(unsigned long) * 512;
+
+  default:
+    return sizeof(wu_moment) * WU_CELLS;
+  }
+}
+
+static void
+quant_hist_row(const quant_hist_info *info, void *hist,
+	       const i_sample_t *val, i_img_dim width) {
+  size_t step = 3 * info->step;
+  i_img_dim x;
+
+  switch (info->kind) {
+  case qh_medcut:
+    {
+      unsigned long *counts = hist;
+      for (x = 0; x < width; x += info->step) {
+	++counts[((val[0] & 0xF8) << 7) | ((val[1] & 0xF8) << 2)
+		 | (val[2] >> 3)];
+	val += step;
+      }
+    }
+    break;
+
+  case qh_prescan:
+    {
+      unsigned long *counts = hist;
+      for (x = 0; x < width; x += info->step) {
+	++counts[pixbox_ch((i_sample_t *)val)];
+	val += step;
+      }
+    }
+    break;
+
+  default:
+    {
+      wu_moment *cells = hist;
+      for (x = 0; x < width; x += info->step) {
+	wu_moment *cell = cells + WU_INDEX((val[0] >> 3) + 1, (val[1] >> 3) + 1,
+					   (val[2] >> 3) + 1);
+	cell->wt += 1;
+	cell->mr += val[0];
+	cell->mg += val[1];
+	cell->mb += val[2];
+	cell->m2 += val[0] * val[0] + val[1] * val[1] + val[2] * val[2];
+	val += step;
+      }
+    }
+    break;
+  }
+}
+
+static void
+quant_hist_bands(void *p, i_img_dim start, i_img_dim end) {
+  const quant_hist_info *info = p;
+  i_sample_t *line = im_parallel_malloc(sizeof(i_sample_t) * 3 * info->maxwidth);
+  i_img_dim band;
+
+  for (band = start; band < end; ++band) {
+    i_img_dim row = info->rows * band / info->bands;
+    i_img_dim last = info->rows * (band + 1) / info->bands;
+    int imgn = 0;
+    i_img_dim img_rows;
+
+    /* find the image and row the band starts at */
+    img_rows = (info->imgs[0]->ysize + info->step - 1) / info->step;
+    while (row >= img_rows) {
+      row -= img_rows;
+      last -= img_rows;
+      ++imgn;
+      img_rows = (info->imgs[imgn]->ysize + info->step - 1) / info->step;
+    }
+
+    while (last > 0) {
+      i_img *im = info->imgs[imgn];
+      const int *chans = im->channels >= 3 ? NULL : gray_samples;
+
+      for (; row < img_rows && row < last; ++row) {
+	i_gsamp(im, 0, im->xsize, row * info->step, line, chans, 3);
+	quant_hist_row(info, info->hists[band], line, im->xsize);
+      }
+      last -= img_rows;
+      row = 0;
+      if (++imgn < info->count)
+	img_rows = (info->imgs[imgn]->ysize + info->step - 1) / info->step;
+    }
+  }
+
+  im_parallel_free(line);
+}
+
+static void
+quant_histogram(i_quantize *quant, i_img **imgs, int count, int kind,
+		void *hist) {
+  im_context_t ctx = imgs[0]->context;
+  quant_hist_info info;
+  int imgn, band;
+  int threads = im_context_get_threads(ctx);
+  size_t size = quant_hist_size(kind);
+
+  info.imgs = imgs;
+  info.count = count;
+  info.kind = kind;
+  info.step = QUANT_SAMPLE_STEP(quant);
+  info.rows = 0;
+  info.maxwidth = 0;
+  for (imgn = 0; imgn < count; ++imgn) {
+    info.rows += (imgs[imgn]->ysize + info.step - 1) / info.step;
+    if (imgs[imgn]->xsize > info.maxwidth)
+      info.maxwidth = imgs[imgn]->xsize;
+    if (!im_img_parallel_read_ok(imgs[imgn]))
+      threads = 1;
+  }
+
+  /* at least 16 rows a band, so the merge doesn't cost more than
+     the counting */
+  info.bands = threads;
+  if (info.bands > info.rows / 16)
+    info.bands = info.rows / 16;
+  if (info.bands < 1)
+    info.bands = 1;
+
+  info.hists = mymalloc(sizeof(void *) * info.bands);
+  info.hists[0] = hist;
+  for (band = 1; band < info.bands; ++band) {
+    info.hists[band] = mymalloc(size);
+    memset(info.hists[band], 0, size);
+  }
+
+  if (info.bands > 1)
+    im_parallel_for(ctx, 0, info.bands, 1, quant_hist_bands, &info);
+  else
+    quant_hist_bands(&info, 0, 1);
+
+  for (band = 1; band < info.bands; ++band) {
+    if (kind == qh_wu) {
+      double *out = hist;
+      const double *in = info.hists[band];
+      size_t i, n = size / sizeof(double);
+      for (i = 0; i < n; ++i)
+	out[i] += in[i];
+    }
+    else {
+      unsigned long *out = hist;
+      const unsigned long *in = info.hists[band];
+      size_t i, n = size / sizeof(unsigned long);
+      for (i = 0; i < n; ++i)
+	out[i] += in[i];
+    }
+    myfree(info.hists[band]);
+  }
+  myfree(info.hists);
+}
+
 /* 
 
 This quantization algorithm and implementation routines are by Arnar
@@ -305,6 +705,8 @@ makemap_addi(i_quantize *quant, i_img **imgs, int count) {
   i_img_dim maxwidth = 0;
   i_sample_t *line;
   const int *sample_indices;
+  int step = QUANT_SAMPLE_STEP(quant);
+  i_rand_state rs;
 
   mm_log((1, "makemap_addi(quant %p { mc_count=%d, mc_colors=%p }, imgs %p, count %d)\n", 
           quant, quant->mc_count, quant->mc_colors, imgs, count));
@@ -341,7 +743,8 @@ makemap_addi(i_quantize *quant, i_img **imgs, int count) {
   }
   line = i_mempool_alloc(&mp, 3 * maxwidth * sizeof(*line));
 
-  prescan(imgs, count, cnum, clr, line);
+  i_rand_seed(&rs, im_context_next_seed(imgs[0]->context), 0);
+  prescan(quant, imgs, count, cnum, clr, &rs);
   cr_hashindex(clr, cnum, hb);
 
   for(iter=0;iter<3;iter++) {
@@ -350,10 +753,10 @@ makemap_addi(i_quantize *quant, i_img **imgs, int count) {
     for (img_num = 0; img_num < count; ++img_num) {
       i_img *im = imgs[img_num];
       sample_indices = im->channels >= 3 ? NULL : gray_samples;
-      for(y=0;y<im->ysize;y++) {
+      for(y=0;y<im->ysize;y+=step) {
         i_gsamp(im, 0, im->xsize, y, line, sample_indices, 3);
         val = line;
-        for(x=0;x<im->xsize;x++) {
+        for(x=0;x<im->xsize;x+=step) {
           ld=196608;
           /*i_gpix(im,x,y,&val);*/
           currhb=pixbox_ch(val);
@@ -374,7 +777,7 @@ makemap_addi(i_quantize *quant, i_img **imgs, int count) {
           clr[bst_idx].dg+=val[1];
           clr[bst_idx].db+=val[2];
           
-          val += 3; /* next 3 samples (next pixel) */
+          val += 3 * step; /* next sampled pixel */
         }
       }
     }
@@ -402,9 +805,9 @@ makemap_addi(i_quantize *quant, i_img **imgs, int count) {
       } else {
         /* let's try something else */
         clr[i].used = 0;
-        clr[i].r=rand();
-        clr[i].g=rand();
-        clr[i].b=rand();
+        clr[i].r=i_rand_next(&rs);
+        clr[i].g=i_rand_next(&rs);
+        clr[i].b=i_rand_next(&rs);
       }
       
       clr[i].dr=0;
@@ -438,6 +841,7 @@ makemap_addi(i_quantize *quant, i_img **imgs, int count) {
       quant->mc_colors[quant->mc_count].rgb.r = clr[i].r;
       quant->mc_colors[quant->mc_count].rgb.g = clr[i].g;
       quant->mc_colors[quant->mc_count].rgb.b = clr[i].b;
+      quant->mc_colors[quant->mc_count].rgba.a = 255;
       ++quant->mc_count;
     }
   }
@@ -467,14 +871,6 @@ typedef struct {
   int count;
 } quant_color_entry;
 
-#define MEDIAN_CUT_COLORS 32768
-
-#define MED_CUT_INDEX(c) ((((c).rgb.r & 0xF8) << 7) | \
-        (((c).rgb.g & 0xF8) << 2) | (((c).rgb.b & 0xF8) >> 3))
-
-#define MED_CUT_GRAY_INDEX(c) ((((c).rgb.r & 0xF8) << 7) | \
-        (((c).rgb.r & 0xF8) << 2) | (((c).rgb.r & 0xF8) >> 3))
-
 /* scale these to cover the whole range */
 #define MED_CUT_RED(index) ((((index) & 0x7C00) >> 10) * 255 / 31)
 #define MED_CUT_GREEN(index) ((((index) & 0x3E0) >> 5) * 255 / 31)
@@ -552,8 +948,7 @@ makemap_mediancut(i_quantize *quant, i_img **imgs, int count) {
   quant_color_entry *colors;
   i_mempool mp;
   int imgn, i, ch;
-  i_img_dim x, y, max_width;
-  i_color *line;
+  unsigned long *counts;
   int color_count;
   i_img_dim total_pixels;
   medcut_partition *parts;
@@ -571,41 +966,26 @@ makemap_mediancut(i_quantize *quant, i_img **imgs, int count) {
 
   i_mempool_init(&mp);
 
-  colors = i_mempool_alloc(&mp, sizeof(*colors) * MEDIAN_CUT_COLORS);
-  for (i = 0; i < MEDIAN_CUT_COLORS; ++i) {
-    colors[i].rgb[0] = MED_CUT_RED(i);
-    colors[i].rgb[1] = MED_CUT_GREEN(i);
-    colors[i].rgb[2] = MED_CUT_BLUE(i);
-    colors[i].count = 0;
-  }
+  /* build the stats, gray images are counted with the gray sample
+     in each channel */
+  counts = i_mempool_alloc(&mp, sizeof(*counts) * MEDIAN_CUT_COLORS);
+  memset(counts, 0, sizeof(*counts) * MEDIAN_CUT_COLORS);
+  quant_histogram(quant, imgs, count, qh_medcut, counts);
 
-  max_width = -1;
+  chan_count = 1; /* assume we just have grayscale */
   for (imgn = 0; imgn < count; ++imgn) {
-    if (imgs[imgn]->xsize > max_width)
-      max_width = imgs[imgn]->xsize;
+    if (imgs[imgn]->channels > 2)
+      chan_count = 3;
   }
-  line = i_mempool_alloc(&mp, sizeof(i_color) * max_width);
 
-  /* build the stats */
   total_pixels = 0;
-  chan_count = 1; /* assume we just have grayscale */
-  for (imgn = 0; imgn < count; ++imgn) {
-    total_pixels += imgs[imgn]->xsize * imgs[imgn]->ysize;
-    for (y = 0; y < imgs[imgn]->ysize; ++y) {
-      i_glin(imgs[imgn], 0, imgs[imgn]->xsize, y, line);
-      if (imgs[imgn]->channels > 2) {
-        chan_count = 3;
-        for (x = 0; x < imgs[imgn]->xsize; ++x) {
-          ++colors[MED_CUT_INDEX(line[x])].count;
-        }
-      }
-      else {
-        /* a gray-scale image, just use the first channel */
-        for (x = 0; x < imgs[imgn]->xsize; ++x) {
-          ++colors[MED_CUT_GRAY_INDEX(line[x])].count;
-        }
-      }
-    }
+  colors = i_mempool_alloc(&mp, sizeof(*colors) * MEDIAN_CUT_COLORS);
+  for (i = 0; i < MEDIAN_CUT_COLORS; ++i) {
+    colors[i].rgb[0] = MED_CUT_RED(i);
+    colors[i].rgb[1] = MED_CUT_GREEN(i);
+    colors[i].rgb[2] = MED_CUT_BLUE(i);
+    colors[i].count = counts[i];
+    total_pixels += counts[i];
   }
 
   /* eliminate the empty colors */
@@ -630,6 +1010,7 @@ makemap_mediancut(i_quantize *quant, i_img **imgs, int count) {
       for (ch = 0; ch < 3; ++ch) {
         quant->mc_colors[i].channel[ch] = colors[i].rgb[ch];
       }
+      quant->mc_colors[i].rgba.a = 255;
     }
     quant->mc_count = out;
   }
@@ -717,6 +1098,7 @@ makemap_mediancut(i_quantize *quant, i_img **imgs, int count) {
       for (ch = 0; ch < 3; ++ch) {
         quant->mc_colors[part_num].channel[ch] = sums[ch] / workpart->pixels;
       }
+      quant->mc_colors[part_num].rgba.a = 255;
     }
     quant->mc_count = color_count;
   }
@@ -726,6 +1108,309 @@ makemap_mediancut(i_quantize *quant, i_img **imgs, int count) {
   mm_log((1, "makemap_mediancut() - %d colors\n", quant->mc_count));
 }
 
+/*
+=item makemap_wu(quant, imgs, count)
+
+Build a color map with Xiaolin Wu's variance minimization quantizer,
+from Graphics Gems II.
+
+The pixels of every image are counted into a 33 x 33 x 33 histogram
+of 5-bit per channel cells, along with the sum of each channel and of
+the squared channels, in one pass over the rows.  The histograms are
+then turned into cumulative moments, so the count, mean and variance
+of any box of cells can be found from 8 table entries.
+
+Starting with a box holding every color, the box with the largest
+variance is repeatedly cut on the channel and at the position that
+most reduces the total variance, until the palette is full or no box
+can be cut.  The cost of the cutting doesn't depend on the image
+size.
+
+Colors already in the map are kept and the new colors added after
+them.
+
+=cut
+*/
+
+typedef struct {
+  /* exclusive lower and inclusive upper bounds in cell co-ordinates */
+  int r0, r1, g0, g1, b0, b1;
+  int vol;
+} wu_box;
+
+static double
+wu_vol(const wu_box *box, const double *m) {
+  return m[WU_INDEX(box->r1, box->g1, box->b1)]
+    - m[WU_INDEX(box->r1, box->g1, box->b0)]
+    - m[WU_INDEX(box->r1, box->g0, box->b1)]
+    + m[WU_INDEX(box->r1, box->g0, box->b0)]
+    - m[WU_INDEX(box->r0, box->g1, box->b1)]
+    + m[WU_INDEX(box->r0, box->g1, box->b0)]
+    + m[WU_INDEX(box->r0, box->g0, box->b1)]
+    - m[WU_INDEX(box->r0, box->g0, box->b0)];
+}
+
+/* the part of wu_vol() that doesn't depend on the upper bound of the
+   box on channel dir */
+static double
+wu_bottom(const wu_box *box, int dir, const double *m) {
+  switch (dir) {
+  case 0:
+    return - m[WU_INDEX(box->r0, box->g1, box->b1)]
+      + m[WU_INDEX(box->r0, box->g1, box->b0)]
+      + m[WU_INDEX(box->r0, box->g0, box->b1)]
+      - m[WU_INDEX(box->r0, box->g0, box->b0)];
+  case 1:
+    return - m[WU_INDEX(box->r1, box->g0, box->b1)]
+      + m[WU_INDEX(box->r1, box->g0, box->b0)]
+      + m[WU_INDEX(box->r0, box->g0, box->b1)]
+      - m[WU_INDEX(box->r0, box->g0, box->b0)];
+  default:
+    return - m[WU_INDEX(box->r1, box->g1, box->b0)]
+      + m[WU_INDEX(box->r1, box->g0, box->b0)]
+      + m[WU_INDEX(box->r0, box->g1, box->b0)]
+      - m[WU_INDEX(box->r0, box->g0, box->b0)];
+  }
+}
+
+/* the rest of wu_vol() with the upper bound on channel dir at pos */
+static double
+wu_top(const wu_box *box, int dir, int pos, const double *m) {
+  switch (dir) {
+  case 0:
+    return m[WU_INDEX(pos, box->g1, box->b1)]
+      - m[WU_INDEX(pos, box->g1, box->b0)]
+      - m[WU_INDEX(pos, box->g0, box->b1)]
+      + m[WU_INDEX(pos, box->g0, box->b0)];
+  case 1:
+    return m[WU_INDEX(box->r1, pos, box->b1)]
+      - m[WU_INDEX(box->r1, pos, box->b0)]
+      - m[WU_INDEX(box->r0, pos, box->b1)]
+      + m[WU_INDEX(box->r0, pos, box->b0)];
+  default:
+    return m[WU_INDEX(box->r1, box->g1, pos)]
+      - m[WU_INDEX(box->r1, box->g0, pos)]
+      - m[WU_INDEX(box->r0, box->g1, pos)]
+      + m[WU_INDEX(box->r0, box->g0, pos)];
+  }
+}
+
+/* the moment arrays, each cumulative */
+typedef struct {
+  double *wt, *mr, *mg, *mb, *m2;
+} wu_hist;
+
+static double
+wu_var(const wu_box *box, const wu_hist *h) {
+  double dr = wu_vol(box, h->mr);
+  double dg = wu_vol(box, h->mg);
+  double db = wu_vol(box, h->mb);
+  double wt = wu_vol(box, h->wt);
+
+  if (wt <= 0)
+    return 0;
+
+  return wu_vol(box, h->m2) - (dr * dr + dg * dg + db * db) / wt;
+}
+
+/* find the best cut of box on channel dir, between first and last,
+   storing the position in *cut, returns the value to maximize, or
+   -1 if the box can't be cut there */
+static double
+wu_maximize(const wu_box *box, int dir, int first, int last, int *cut,
+	    double whole_r, double whole_g, double whole_b, double whole_w,
+	    const wu_hist *h) {
+  double base_r = wu_bottom(box, dir, h->mr);
+  double base_g = wu_bottom(box, dir, h->mg);
+  double base_b = wu_bottom(box, dir, h->mb);
+  double base_w = wu_bottom(box, dir, h->wt);
+  double max = 0;
+  int i;
+
+  *cut = -1;
+  for (i = first; i < last; ++i) {
+    double half_r = base_r + wu_top(box, dir, i, h->mr);
+    double half_g = base_g + wu_top(box, dir, i, h->mg);
+    double half_b = base_b + wu_top(box, dir, i, h->mb);
+    double half_w = base_w + wu_top(box, dir, i, h->wt);
+    double temp;
+
+    /* both halves must hold some pixels */
+    if (half_w <= 0)
+      continue;
+    temp = (half_r * half_r + half_g * half_g + half_b * half_b) / half_w;
+
+    half_r = whole_r - half_r;
+    half_g = whole_g - half_g;
+    half_b = whole_b - half_b;
+    half_w = whole_w - half_w;
+    if (half_w <= 0)
+      continue;
+    temp += (half_r * half_r + half_g * half_g + half_b * half_b) / half_w;
+
+    if (temp > max) {
+      max = temp;
+      *cut = i;
+    }
+  }
+
+  return *cut < 0 ? -1 : max;
+}
+
+/* cut set1 in two, putting the upper half in set2, returns 0 if the
+   box can't be cut */
+static int
+wu_cut(wu_box *set1, wu_box *set2, const wu_hist *h) {
+  double whole_r = wu_vol(set1, h->mr);
+  double whole_g = wu_vol(set1, h->mg);
+  double whole_b = wu_vol(set1, h->mb);
+  double whole_w = wu_vol(set1, h->wt);
+  double maxr, maxg, maxb;
+  int cutr, cutg, cutb;
+
+  maxr = wu_maximize(set1, 0, set1->r0 + 1, set1->r1, &cutr,
+		     whole_r, whole_g, whole_b, whole_w, h);
+  maxg = wu_maximize(set1, 1, set1->g0 + 1, set1->g1, &cutg,
+		     whole_r, whole_g, whole_b, whole_w, h);
+  maxb = wu_maximize(set1, 2, set1->b0 + 1, set1->b1, &cutb,
+		     whole_r, whole_g, whole_b, whole_w, h);
+
+  *set2 = *set1;
+  if (maxr >= maxg && maxr >= maxb) {
+    if (maxr < 0)
+      return 0;
+    set2->r0 = set1->r1 = cutr;
+  }
+  else if (maxg >= maxr && maxg >= maxb) {
+    set2->g0 = set1->g1 = cutg;
+  }
+  else {
+    set2->b0 = set1->b1 = cutb;
+  }
+  set1->vol = (set1->r1 - set1->r0) * (set1->g1 - set1->g0)
+    * (set1->b1 - set1->b0);
+  set2->vol = (set2->r1 - set2->r0) * (set2->g1 - set2->g0)
+    * (set2->b1 - set2->b0);
+
+  return 1;
+}
+
+static void
+makemap_wu(i_quantize *quant, i_img **imgs, int count) {
+  wu_moment *cells;
+  wu_hist h;
+  wu_box *boxes;
+  double *vv;
+  int want, nboxes, next, i;
+  int r, g, b;
+
+  mm_log((1, "makemap_wu(quant %p { mc_count=%d, mc_colors=%p }, imgs %p, count %d)\n", 
+          quant, quant->mc_count, quant->mc_colors, imgs, count));
+
+  if (makemap_palette(quant, imgs, count))
+    return;
+
+  want = quant->mc_size - quant->mc_count;
+  if (want <= 0)
+    return;
+
+  /* count the pixels, the cells are indexed from 1 so the cumulative
+     moments have a zero row and column at 0 */
+  cells = mymalloc(sizeof(wu_moment) * WU_CELLS);
+  memset(cells, 0, sizeof(wu_moment) * WU_CELLS);
+  quant_histogram(quant, imgs, count, qh_wu, cells);
+
+  /* split out into separate arrays of cumulative moments */
+  h.wt = mymalloc(sizeof(double) * WU_CELLS * 5);
+  h.mr = h.wt + WU_CELLS;
+  h.mg = h.mr + WU_CELLS;
+  h.mb = h.mg + WU_CELLS;
+  h.m2 = h.mb + WU_CELLS;
+  memset(h.wt, 0, sizeof(double) * WU_CELLS * 5);
+  for (r = 1; r < WU_SIDE; ++r) {
+    double area_w[WU_SIDE], area_r[WU_SIDE], area_g[WU_SIDE];
+    double area_b[WU_SIDE], area_2[WU_SIDE];
+
+    for (i = 0; i < WU_SIDE; ++i)
+      area_w[i] = area_r[i] = area_g[i] = area_b[i] = area_2[i] = 0;
+    for (g = 1; g < WU_SIDE; ++g) {
+      double line_w = 0, line_r = 0, line_g = 0, line_b = 0, line_2 = 0;
+      for (b = 1; b < WU_SIDE; ++b) {
+	int ind = WU_INDEX(r, g, b);
+	int prev = WU_INDEX(r - 1, g, b);
+	line_w += cells[ind].wt;
+	line_r += cells[ind].mr;
+	line_g += cells[ind].mg;
+	line_b += cells[ind].mb;
+	line_2 += cells[ind].m2;
+	area_w[b] += line_w;
+	area_r[b] += line_r;
+	area_g[b] += line_g;
+	area_b[b] += line_b;
+	area_2[b] += line_2;
+	h.wt[ind] = h.wt[prev] + area_w[b];
+	h.mr[ind] = h.mr[prev] + area_r[b];
+	h.mg[ind] = h.mg[prev] + area_g[b];
+	h.mb[ind] = h.mb[prev] + area_b[b];
+	h.m2[ind] = h.m2[prev] + area_2[b];
+      }
+    }
+  }
+  myfree(cells);
+
+  /* cut boxes until we have enough, or none can be cut */
+  boxes = mymalloc(sizeof(wu_box) * want);
+  vv = mymalloc(sizeof(double) * want);
+  boxes[0].r0 = boxes[0].g0 = boxes[0].b0 = 0;
+  boxes[0].r1 = boxes[0].g1 = boxes[0].b1 = WU_SIDE - 1;
+  boxes[0].vol = (WU_SIDE - 1) * (WU_SIDE - 1) * (WU_SIDE - 1);
+  vv[0] = 0;
+  nboxes = 1;
+  next = 0;
+  while (nboxes < want) {
+    double max;
+
+    if (wu_cut(boxes + next, boxes + nboxes, &h)) {
+      vv[next] = boxes[next].vol > 1 ? wu_var(boxes + next, &h) : 0;
+      vv[nboxes] = boxes[nboxes].vol > 1 ? wu_var(boxes + nboxes, &h) : 0;
+      ++nboxes;
+    }
+    else {
+      /* don't try this one again */
+      vv[next] = 0;
+    }
+
+    next = 0;
+    max = vv[0];
+    for (i = 1; i < nboxes; ++i) {
+      if (vv[i] > max) {
+	max = vv[i];
+	next = i;
+      }
+    }
+    if (max <= 0)
+      break;
+  }
+
+  /* each color is the mean of the pixels in its box */
+  for (i = 0; i < nboxes; ++i) {
+    double wt = wu_vol(boxes + i, h.wt);
+
+    if (wt <= 0)
+      continue;
+    setcol(quant->mc_colors + quant->mc_count++,
+	   (int)(wu_vol(boxes + i, h.mr) / wt + 0.5),
+	   (int)(wu_vol(boxes + i, h.mg) / wt + 0.5),
+	   (int)(wu_vol(boxes + i, h.mb) / wt + 0.5), 255);
+  }
+
+  myfree(vv);
+  myfree(boxes);
+  myfree(h.wt);
+
+  mm_log((1, "makemap_wu() - %d colors\n", quant->mc_count));
+}
+
 static void
 makemap_mono(i_quantize *quant) {
   quant->mc_colors[0].rgba.r = 0;
@@ -889,6 +1574,9 @@ makemap_palette(i_quantize *quant, i_img **imgs, int count) {
     CF_FIND - code that looks for the color in val and puts the best 
       matching index in bst_idx
     CF_CLEANUP - code to clean up, eg. releasing memory
+
+   CF_SETUP is skipped when there's an inverse color map, so CF_CLEANUP
+   must cope with that.
 */
 #ifndef IM_CF_COPTS
 /*#define IM_CFLINSEARCH*/
@@ -922,7 +1610,7 @@ is_gray_map(const i_quantize *quant) {
 #define HB_SORT
 
 /* assume i is available */
-#define CF_VARS hashbox *hb = mymalloc(sizeof(hashbox) * 512); \
+#define CF_VARS hashbox *hb = NULL; \
                int currhb;  \
                long ld, cd
 
@@ -1012,7 +1700,7 @@ static void hbsetup(i_quantize *quant, hashbox *hb) {
 #endif
   myfree(dists) ;
 }
-#define CF_SETUP hbsetup(quant, hb)
+#define CF_SETUP hb = mymalloc(sizeof(hashbox) * 512); hbsetup(quant, hb)
 
 #define CF_FIND \
   currhb = pixbox(&val); \
@@ -1022,7 +1710,7 @@ static void hbsetup(i_quantize *quant, hashbox *hb) {
     if (cd < ld) { ld = cd; bst_idx = hb[currhb].vec[i]; } \
   }
 
-#define CF_CLEANUP myfree(hb)
+#define CF_CLEANUP if (hb) myfree(hb)
   
 #endif
 
@@ -1046,7 +1734,7 @@ static int chansort(void const *a, void const *b) {
   return gquant->mc_colors[*(int const *)a].channel[gsortchan] -
     gquant->mc_colors[*(int const *)b].channel[gsortchan];
 }
-#define CF_VARS int *indices, sortchan, diff; \
+#define CF_VARS int *indices = NULL, sortchan, diff; \
                 long ld, cd; \
                 int vindex[256] /* where to find value i of chan */
 
@@ -1134,7 +1822,7 @@ int chanfind(i_color val, i_quantize *quant, int *indices, int *vindex,
   bst_idx = chanfind(val, quant, indices, vindex, sortchan)
   
 
-#define CF_CLEANUP myfree(indices)
+#define CF_CLEANUP if (indices) myfree(indices)
 
 #endif
 
@@ -1211,7 +1899,7 @@ typedef struct i_dists {
 } i_dists;
 
 #define CF_VARS \
-    i_dists *dists;
+    i_dists *dists = NULL;
 
 static int dists_sort(void const *a, void const *b) {
   return ((i_dists *)a)->dist - ((i_dists *)b)->dist;
@@ -1260,36 +1948,365 @@ static int rand2dist_find(i_color val, i_quantize *quant, i_dists *dists, int in
 
 #define CF_FIND bst_idx = rand2dist_find(val, quant, dists, bst_idx)
 
-#define CF_CLEANUP myfree(dists)
+#define CF_CLEANUP if (dists) myfree(dists)
 
 
 #endif
 
-static void translate_addi(i_quantize *quant, i_img *img, i_palidx *out) {
+/* The inverse color map
+
+   Rather than searching the palette for every pixel, translation
+   looks up the pixel in a table with 5 or 6 bits per channel,
+   recording the palette index for each cell of color space the first
+   time a pixel lands in that cell.
+
+   For each cell we find the color whose furthest distance from the
+   cell is smallest.  If every other color is further from every point
+   in the cell than that, it's the closest color for any pixel in the
+   cell and is stored directly.  Otherwise, with lookup_exact set, the
+   cell keeps a list of the colors that might be closest, and a
+   block with an entry for each color in the cell, filled in by
+   searching the list the first time the color is seen.  Without
+   lookup_exact the color closest to the center of the cell is used.
+
+   The same test is first done for the 512 boxes used by pixbox(), so
+   each cell only has to check the few colors that might be closest
+   to something in the box containing it.
+
+   The table is kept in the i_quantize object, so translating several
+   images or frames with the same palette only fills it once.
+*/
+
+typedef struct i_quant_lookup_tag {
+  int bits;
+  int exact;
+
+  /* the palette the table was built for */
+  int count;
+  i_color *colors;
+
+  /* 0 for cells not filled in yet, 1 to count for a color index + 1,
+     or count + 1 + the number of the cell's block */
+  unsigned *cells;
+
+  /* blocks for cells near more than one color, each with an entry
+     per color in the cell, 0 if not searched yet or color index + 1 */
+  unsigned short *blocks;
+  /* offset of the candidate list in pool for each block */
+  size_t *block_lists;
+  size_t block_count;
+  size_t block_alloc;
+
+  /* candidate lists, each a count followed by the color indexes */
+  int *pool;
+  size_t pool_used;
+  size_t pool_size;
+
+  /* for each pixbox() box, 0 if not filled in yet, or the offset of
+     the list of colors that might be closest to something in the box
+     plus 1 */
+  size_t boxes[512];
+
+  /* 0 .. count-1, the candidates for the boxes */
+  int *all;
+
+  /* minimum distance from the box to each candidate, used while
+     filling */
+  long *mins;
+} i_quant_lookup;
+
+#define LOOKUP_CELL(lk, c) \
+  ((((unsigned)(c)->channel[0] >> (8 - (lk)->bits)) << ((lk)->bits * 2)) \
+   | (((unsigned)(c)->channel[1] >> (8 - (lk)->bits)) << (lk)->bits) \
+   | ((unsigned)(c)->channel[2] >> (8 - (lk)->bits)))
+
+/* the table is allocated with im_parallel_malloc() since
+   i_quant_translate_multi() builds tables in worker threads */
+static void
+lookup_free(i_quant_lookup *lk) {
+  im_parallel_free(lk->colors);
+  im_parallel_free(lk->cells);
+  if (lk->pool)
+    im_parallel_free(lk->pool);
+  if (lk->blocks) {
+    im_parallel_free(lk->blocks);
+    im_parallel_free(lk->block_lists);
+  }
+  im_parallel_free(lk->all);
+  im_parallel_free(lk->mins);
+  im_parallel_free(lk);
+}
+
+/* make sure quant->lookup matches the current settings and palette */
+static void
+lookup_setup(i_quantize *quant) {
+  i_quant_lookup *lk;
+
+  if (quant->version < 2)
+    return;
+
+  lk = quant->lookup;
+  if (lk) {
+    if (quant->lookup_bits == lk->bits
+	&& !quant->lookup_exact == !lk->exact
+	&& quant->mc_count == lk->count
+	&& memcmp(quant->mc_colors, lk->colors,
+		  sizeof(i_color) * lk->count) == 0) {
+      return;
+    }
+    lookup_free(lk);
+    quant->lookup = NULL;
+  }
+  if (!quant->lookup_bits)
+    return;
+
+  mm_log((1, "lookup_setup: building %d bit inverse color map%s\n",
+	  quant->lookup_bits, quant->lookup_exact ? " (exact)" : ""));
+
+  quant->lookup = lookup_new(quant);
+}
+
+/* an empty table for the palette and settings in quant */
+static i_quant_lookup *
+lookup_new(i_quantize *quant) {
+  i_quant_lookup *lk;
+  size_t cell_count;
+  int i;
+
+  lk = im_parallel_malloc(sizeof(i_quant_lookup));
+  lk->bits = quant->lookup_bits;
+  lk->exact = quant->lookup_exact;
+  lk->count = quant->mc_count;
+  lk->colors = im_parallel_malloc(sizeof(i_color) * lk->count);
+  memcpy(lk->colors, quant->mc_colors, sizeof(i_color) * lk->count);
+  cell_count = (size_t)1 << (3 * lk->bits);
+  lk->cells = im_parallel_malloc(sizeof(unsigned) * cell_count);
+  memset(lk->cells, 0, sizeof(unsigned) * cell_count);
+  lk->pool = NULL;
+  lk->pool_used = lk->pool_size = 0;
+  lk->blocks = NULL;
+  lk->block_lists = NULL;
+  lk->block_count = lk->block_alloc = 0;
+  lk->mins = im_parallel_malloc(sizeof(long) * lk->count);
+  lk->all = im_parallel_malloc(sizeof(int) * lk->count);
+  for (i = 0; i < lk->count; ++i)
+    lk->all[i] = i;
+  memset(lk->boxes, 0, sizeof(lk->boxes));
+
+  return lk;
+}
+
+/* measure the n colors listed in cands against the box lo..hi,
+   setting mins[i] to the nearest any point in the box is to color
+   cands[i].  Returns the smallest furthest distance, with the color
+   it belongs to in *best, and the color nearest the center of the box
+   in *center */
+static long
+lookup_measure(i_quant_lookup *lk, const int *lo, const int *hi,
+	       const int *cands, int n, int *best, int *center) {
+  int i, ch;
+  long best_max = -1, center_dist = -1;
+
+  for (i = 0; i < n; ++i) {
+    const i_color *c = lk->colors + cands[i];
+    long mind = 0, maxd = 0, cd = 0;
+    for (ch = 0; ch < 3; ++ch) {
+      int v = c->channel[ch];
+      int near = v < lo[ch] ? lo[ch] - v : v > hi[ch] ? v - hi[ch] : 0;
+      int far = v - lo[ch] > hi[ch] - v ? v - lo[ch] : hi[ch] - v;
+      /* doubled distance to the center, to stay in integers */
+      int mid = 2 * v - lo[ch] - hi[ch];
+      mind += near * near;
+      maxd += far * far;
+      cd += mid * mid;
+    }
+    lk->mins[i] = mind;
+    if (best_max < 0 || maxd < best_max) {
+      best_max = maxd;
+      *best = cands[i];
+    }
+    if (center_dist < 0 || cd < center_dist) {
+      center_dist = cd;
+      *center = cands[i];
+    }
+  }
+
+  return best_max;
+}
+
+/* make room for a list of up to n colors in the pool, this may move
+   the pool */
+static void
+lookup_reserve(i_quant_lookup *lk, int n) {
+  if (lk->pool_used + n + 1 > lk->pool_size) {
+    size_t new_size = lk->pool_size ? lk->pool_size * 2 : 1024;
+    while (lk->pool_used + n + 1 > new_size)
+      new_size *= 2;
+    lk->pool = im_parallel_realloc(lk->pool, sizeof(int) * new_size);
+    lk->pool_size = new_size;
+  }
+}
+
+/* add the colors from cands that might be closest to some point in
+   the box just measured to the pool, returning the offset of the new
+   list.  Room must have been made with lookup_reserve() */
+static size_t
+lookup_add_list(i_quant_lookup *lk, const int *cands, int n, long best_max) {
+  size_t offset = lk->pool_used;
+  int *list = lk->pool + offset + 1;
+  int i, count = 0;
+
+  for (i = 0; i < n; ++i) {
+    if (lk->mins[i] <= best_max)
+      list[count++] = cands[i];
+  }
+  lk->pool[offset] = count;
+  lk->pool_used += count + 1;
+
+  return offset;
+}
+
+/* work out the entry for the cell containing val */
+static unsigned
+lookup_fill(i_quant_lookup *lk, const i_color *val) {
+  int shift = 8 - lk->bits;
+  int lo[3], hi[3];
+  int ch, box, best, center;
+  const int *box_list;
+  long best_max;
+  size_t offset, block_size;
+
+  /* colors that might be closest to something in the pixbox() box
+     around the cell, so each cell only looks at a few colors */
+  box = pixbox((i_color *)val);
+  if (!lk->boxes[box]) {
+    for (ch = 0; ch < 3; ++ch) {
+      lo[ch] = val->channel[ch] & 224;
+      hi[ch] = lo[ch] + 31;
+    }
+    best_max = lookup_measure(lk, lo, hi, lk->all, lk->count, &best, &center);
+    lookup_reserve(lk, lk->count);
+    lk->boxes[box] = lookup_add_list(lk, lk->all, lk->count, best_max) + 1;
+  }
+
+  for (ch = 0; ch < 3; ++ch) {
+    lo[ch] = (val->channel[ch] >> shift) << shift;
+    hi[ch] = lo[ch] + (1 << shift) - 1;
+  }
+  lookup_reserve(lk, lk->pool[lk->boxes[box] - 1]);
+  box_list = lk->pool + lk->boxes[box] - 1;
+  best_max = lookup_measure(lk, lo, hi, box_list + 1, *box_list,
+			    &best, &center);
+
+  if (!lk->exact)
+    return center + 1;
+
+  offset = lookup_add_list(lk, box_list + 1, *box_list, best_max);
+  if (lk->pool[offset] == 1) {
+    /* only one color can be closest, no need to keep the list */
+    lk->pool_used = offset;
+    return best + 1;
+  }
+
+  /* more than one, give the cell a block */
+  block_size = (size_t)1 << (3 * shift);
+  if (lk->block_count == lk->block_alloc) {
+    lk->block_alloc = lk->block_alloc ? lk->block_alloc * 2 : 64;
+    lk->blocks = im_parallel_realloc(lk->blocks,
+		  sizeof(unsigned short) * block_size * lk->block_alloc);
+    lk->block_lists = im_parallel_realloc(lk->block_lists,
+		  sizeof(size_t) * lk->block_alloc);
+  }
+  memset(lk->blocks + lk->block_count * block_size, 0,
+	 sizeof(unsigned short) * block_size);
+  lk->block_lists[lk->block_count] = offset;
+
+  return lk->count + 1 + lk->block_count++;
+}
+
+/* find the color closest to val in a cell with a block */
+static int
+lookup_search(i_quant_lookup *lk, unsigned entry, const i_color *val) {
+  int shift = 8 - lk->bits;
+  unsigned mask = (1 << shift) - 1;
+  size_t block = entry - lk->count - 1;
+  unsigned short *slot = lk->blocks + (block << (3 * shift))
+    + (((val->channel[0] & mask) << (2 * shift))
+       | ((val->channel[1] & mask) << shift)
+       | (val->channel[2] & mask));
+
+  if (!*slot) {
+    const int *list = lk->pool + lk->block_lists[block];
+    int cands = *list++;
+    int best = list[0];
+    int best_dist = 196608;
+    int i;
+
+    for (i = 0; i < cands; ++i) {
+      const i_color *c = lk->colors + list[i];
+      int dr = c->channel[0] - val->channel[0];
+      int dg = c->channel[1] - val->channel[1];
+      int db = c->channel[2] - val->channel[2];
+      int dist = dr * dr + dg * dg + db * db;
+      if (dist < best_dist) {
+	best_dist = dist;
+	best = list[i];
+      }
+    }
+    *slot = best + 1;
+  }
+
+  return *slot - 1;
+}
+
+/* find the palette index for val, in bst_idx, using the inverse
+   color map if there is one */
+#define FIND_COLOR \
+  if (lk) { \
+    unsigned *cell = lk->cells + LOOKUP_CELL(lk, &val); \
+    if (!*cell) \
+      *cell = lookup_fill(lk, &val); \
+    bst_idx = *cell <= (unsigned)lk->count ? (int)*cell - 1 \
+      : lookup_search(lk, *cell, &val); \
+  } \
+  else { \
+    CF_FIND; \
+  }
+
+static void
+translate_addi(i_quantize *quant, i_quant_lookup *lk, int pixdev,
+	       unsigned long seed, i_img *img, i_palidx *out) {
   i_img_dim x, y, k;
   int i, bst_idx = 0;
   i_color val;
-  int pixdev = quant->perturb;
+  i_rand_state rs;
   CF_VARS;
 
-  CF_SETUP;
+  /* the search setup isn't needed with an inverse color map, and
+     isn't safe from worker threads */
+  if (!lk) {
+    CF_SETUP;
+  }
 
   if (img->channels >= 3) {
     if (pixdev) {
       k=0;
-      for(y=0;y<img->ysize;y++) for(x=0;x<img->xsize;x++) {
-        i_gpix(img,x,y,&val);
-        val.channel[0]=g_sat(val.channel[0]+(int)(pixdev*frandn()));
-        val.channel[1]=g_sat(val.channel[1]+(int)(pixdev*frandn()));
-        val.channel[2]=g_sat(val.channel[2]+(int)(pixdev*frandn()));
-        CF_FIND;
-        out[k++]=bst_idx;
+      for(y=0;y<img->ysize;y++) {
+        i_rand_seed(&rs, seed, y);
+        for(x=0;x<img->xsize;x++) {
+          i_gpix(img,x,y,&val);
+          val.channel[0]=g_sat(val.channel[0]+(int)(pixdev*frandn(&rs)));
+          val.channel[1]=g_sat(val.channel[1]+(int)(pixdev*frandn(&rs)));
+          val.channel[2]=g_sat(val.channel[2]+(int)(pixdev*frandn(&rs)));
+          FIND_COLOR;
+          out[k++]=bst_idx;
+        }
       }
     } else {
       k=0;
       for(y=0;y<img->ysize;y++) for(x=0;x<img->xsize;x++) {
         i_gpix(img,x,y,&val);
-        CF_FIND;
+        FIND_COLOR;
         out[k++]=bst_idx;
       }
     }
@@ -1297,19 +2314,22 @@ static void translate_addi(i_quantize *quant, i_img *img, i_palidx *out) {
   else {
     if (pixdev) {
       k=0;
-      for(y=0;y<img->ysize;y++) for(x=0;x<img->xsize;x++) {
-        i_gpix(img,x,y,&val);
-        val.channel[1] = val.channel[2] =
-          val.channel[0]=g_sat(val.channel[0]+(int)(pixdev*frandn()));
-        CF_FIND;
-        out[k++]=bst_idx;
+      for(y=0;y<img->ysize;y++) {
+        i_rand_seed(&rs, seed, y);
+        for(x=0;x<img->xsize;x++) {
+          i_gpix(img,x,y,&val);
+          val.channel[1] = val.channel[2] =
+            val.channel[0]=g_sat(val.channel[0]+(int)(pixdev*frandn(&rs)));
+          FIND_COLOR;
+          out[k++]=bst_idx;
+        }
       }
     } else {
       k=0;
       for(y=0;y<img->ysize;y++) for(x=0;x<img->xsize;x++) {
         i_gpix(img,x,y,&val);
         val.channel[1] = val.channel[2] = val.channel[0];
-        CF_FIND;
+        FIND_COLOR;
         out[k++]=bst_idx;
       }
     }
@@ -1349,132 +2369,300 @@ static struct errdiff_map maps[] =
   { stucki_map, 5, 3, 2 },
 };
 
-typedef struct errdiff_tag {
-  int r, g, b;
-} errdiff_t;
+/* one non-zero entry of an error diffusion map, relative to the
+   current pixel */
+typedef struct errdiff_tap_tag {
+  int dx, dy, weight;
+  /* offset in ints from the current pixel in row dy, for each
+     direction */
+  int offset[2];
+} errdiff_tap;
+
+/* bits of the fixed point reciprocal used to divide accumulated error
+   by the map total */
+#define ERRDIFF_RECIP_BITS 20
+
+/* divide v by the map total, rounding towards zero, with a multiply
+   and shift if recip is non-zero, otherwise a divide.  The sign is
+   applied without branching, since it's unpredictable.
+
+   A custom map can have a negative total, so the divide is signed */
+static int
+errdiff_div(int v, unsigned long recip, int difftotal) {
+  int sign = -(v < 0);
+  int mag = (v ^ sign) - sign;
+  int q = recip ? (int)(((unsigned long)mag * recip) >> ERRDIFF_RECIP_BITS)
+    : mag / difftotal;
+
+  return (q ^ sign) - sign;
+}
 
-/* perform an error diffusion dither */
+/* clamp a corrected sample through the table if we have one */
+#define ERRDIFF_SAT(v) (sat ? sat[v] : g_sat(v))
+
+/* add a share of the error to the pixel dx pixels further on in scan
+   order in row */
+#define ERRDIFF_TAP(row, dx, weight) \
+  do { \
+    int *p_ = (row) + (dx) * step3; \
+    p_[0] += er * (weight); \
+    p_[1] += eg * (weight); \
+    p_[2] += eb * (weight); \
+  } while (0)
+
+/* perform an error diffusion dither
+
+   Rows are read with i_gsamp(), the error for the next maph rows is
+   kept in a ring of rows, and only the non-zero entries of the map
+   are applied.  The built-in maps have the entries written out, so
+   the weights are constants.
+
+   Dividing the accumulated error by the map total is done with a
+   fixed point reciprocal when that's exact for every error that can
+   accumulate, which it is for the built-in maps.
+
+   Corrected samples are clamped through a table when the map has no
+   negative weights, since they then stay within -255 to 510.  Other
+   custom maps can push samples well outside that, so those use
+   g_sat().
+
+   With ed_bidir in quant->errdiff odd rows are processed right to
+   left with the map mirrored.
+*/
 static
 void
-translate_errdiff(i_quantize *quant, i_img *img, i_palidx *out) {
+translate_errdiff(i_quantize *quant, i_quant_lookup *lk, int is_gray,
+		  i_img *img, i_palidx *out) {
   int *map;
   int mapw, maph, mapo;
   int i;
-  errdiff_t *err;
+  int difftotal, weight_total;
+  unsigned long recip;
+  errdiff_tap *taps;
+  int tap_count;
+  int **rows;
+  int *err;
   i_img_dim errw;
-  int difftotal;
-  i_img_dim x, y, dx, dy;
+  i_img_dim x, y;
+  int dx, dy;
+  i_sample_t *line;
+  const int *chans = img->channels >= 3 ? NULL : gray_samples;
+  int serpentine = (quant->errdiff & ed_bidir) != 0;
+  int kernel = quant->errdiff & ed_mask;
+  unsigned char sat_table[766];
+  const unsigned char *sat;
   int bst_idx = 0;
-  int is_gray = is_gray_map(quant);
   CF_VARS;
 
-  if ((quant->errdiff & ed_mask) == ed_custom) {
+  /* the perl interface already replaces a map with a zero total,
+     but don't divide by zero for C callers */
+  difftotal = 0;
+  if (kernel == ed_custom && quant->ed_map) {
+    for (i = 0; i < quant->ed_width * quant->ed_height; ++i)
+      difftotal += quant->ed_map[i];
+  }
+  if (kernel == ed_custom && quant->ed_map && difftotal) {
     map = quant->ed_map;
     mapw = quant->ed_width;
     maph = quant->ed_height;
     mapo = quant->ed_orig;
   }
   else {
-    int index = quant->errdiff & ed_mask;
-    if (index >= ed_custom) index = ed_floyd;
+    int index = kernel;
+    if (index >= ed_custom) index = kernel = ed_floyd;
     map = maps[index].map;
     mapw = maps[index].width;
     maph = maps[index].height;
     mapo = maps[index].orig;
   }
-  
-  errw = img->xsize+mapw;
-  err = mymalloc(sizeof(*err) * maph * errw);
-  /*errp = err+mapo;*/
-  memset(err, 0, sizeof(*err) * maph * errw);
-  
-  difftotal = 0;
-  for (i = 0; i < maph * mapw; ++i)
-    difftotal += map[i];
-  /*printf("map:\n");
- for (dy = 0; dy < maph; ++dy) {
-   for (dx = 0; dx < mapw; ++dx) {
-     printf("%2d", map[dx+dy*mapw]);
-   }
-   putchar('\n');
-   }*/
 
-  CF_SETUP;
+  /* entries at or before the current pixel on the top row only affect
+     pixels already done */
+  taps = im_parallel_malloc(sizeof(errdiff_tap) * mapw * maph);
+  tap_count = 0;
+  difftotal = weight_total = 0;
+  for (dy = 0; dy < maph; ++dy) {
+    for (dx = 0; dx < mapw; ++dx) {
+      int weight = map[dx + mapw * dy];
+      difftotal += weight;
+      weight_total += weight < 0 ? -weight : weight;
+      if (weight && (dy > 0 || dx > mapo)) {
+	taps[tap_count].dx = dx - mapo;
+	taps[tap_count].dy = dy;
+	taps[tap_count].weight = weight;
+	taps[tap_count].offset[0] = 3 * (dx - mapo);
+	taps[tap_count].offset[1] = -3 * (dx - mapo);
+	++tap_count;
+      }
+    }
+  }
+
+  /* use a reciprocal if it gives the same result as dividing for any
+     error that can accumulate */
+  recip = 0;
+  if (difftotal > 0
+      && 255.0 * weight_total * ((1UL << ERRDIFF_RECIP_BITS) / difftotal + 1)
+         < 4294967296.0) {
+    int max_err = 255 * weight_total;
+    int v;
+    recip = (1UL << ERRDIFF_RECIP_BITS) / difftotal + 1;
+    for (v = 0; v <= max_err; ++v) {
+      if ((int)((v * recip) >> ERRDIFF_RECIP_BITS) != v / difftotal) {
+	recip = 0;
+	break;
+      }
+    }
+  }
+
+  /* a margin of mapw each side so mirrored maps stay in the rows */
+  errw = img->xsize + 2 * mapw;
+  err = im_parallel_malloc(sizeof(int) * 3 * errw * maph);
+  memset(err, 0, sizeof(int) * 3 * errw * maph);
+  rows = im_parallel_malloc(sizeof(int *) * maph);
+  for (dy = 0; dy < maph; ++dy)
+    rows[dy] = err + 3 * errw * dy;
+  line = im_parallel_malloc(sizeof(i_sample_t) * 3 * img->xsize);
+
+  /* with no negative weights the corrected samples are from -255 to
+     510, clamp them through a table rather than with unpredictable
+     branches */
+  if (difftotal > 0 && weight_total <= difftotal) {
+    for (i = 0; i < 766; ++i)
+      sat_table[i] = i < 255 ? 0 : i > 510 ? 255 : i - 255;
+    sat = sat_table + 255;
+  }
+  else {
+    sat = NULL;
+  }
+
+  if (!lk) {
+    CF_SETUP;
+  }
 
   for (y = 0; y < img->ysize; ++y) {
-    for (x = 0; x < img->xsize; ++x) {
+    int reverse = serpentine && (y & 1);
+    int step = reverse ? -1 : 1;
+    /* the distance in ints to the next pixel in scan order */
+    int step3 = 3 * step;
+    i_img_dim x_end = reverse ? -1 : img->xsize;
+
+    i_gsamp(img, 0, img->xsize, y, line, chans, 3);
+    for (x = reverse ? img->xsize - 1 : 0; x != x_end; x += step) {
       i_color val;
-      errdiff_t perr;
-      i_gpix(img, x, y, &val);
-      if (img->channels < 3) {
-        val.channel[1] = val.channel[2] = val.channel[0];
-      }
-      else if (is_gray) {
-	int gray = 0.5 + color_to_grey(&val);
+      const i_sample_t *samp = line + 3 * x;
+      int *cur = rows[0] + 3 * (x + mapw);
+      int *next1 = maph > 1 ? rows[1] + 3 * (x + mapw) : NULL;
+      int *next2 = maph > 2 ? rows[2] + 3 * (x + mapw) : NULL;
+      int er, eg, eb;
+
+      if (is_gray && img->channels >= 3) {
+	int gray;
+	val.channel[0] = samp[0];
+	val.channel[1] = samp[1];
+	val.channel[2] = samp[2];
+	gray = 0.5 + color_to_grey(&val);
 	val.channel[0] = val.channel[1] = val.channel[2] = gray;
       }
-      perr = err[x+mapo];
-      perr.r = perr.r < 0 ? -((-perr.r)/difftotal) : perr.r/difftotal;
-      perr.g = perr.g < 0 ? -((-perr.g)/difftotal) : perr.g/difftotal;
-      perr.b = perr.b < 0 ? -((-perr.b)/difftotal) : perr.b/difftotal;
-      /*printf("x %3d y %3d in(%3d, %3d, %3d) di(%4d,%4d,%4d)\n", x, y, val.channel[0], val.channel[1], val.channel[2], perr.r, perr.g, perr.b);*/
-      val.channel[0] = g_sat(val.channel[0]-perr.r);
-      val.channel[1] = g_sat(val.channel[1]-perr.g);
-      val.channel[2] = g_sat(val.channel[2]-perr.b);
-      CF_FIND;
+      else {
+	val.channel[0] = samp[0];
+	val.channel[1] = samp[1];
+	val.channel[2] = samp[2];
+      }
+      val.channel[0] = ERRDIFF_SAT(val.channel[0] - errdiff_div(cur[0], recip, difftotal));
+      val.channel[1] = ERRDIFF_SAT(val.channel[1] - errdiff_div(cur[1], recip, difftotal));
+      val.channel[2] = ERRDIFF_SAT(val.channel[2] - errdiff_div(cur[2], recip, difftotal));
+      FIND_COLOR;
       /* save error */
-      perr.r = quant->mc_colors[bst_idx].channel[0] - val.channel[0];
-      perr.g = quant->mc_colors[bst_idx].channel[1] - val.channel[1];
-      perr.b = quant->mc_colors[bst_idx].channel[2] - val.channel[2];
-      /*printf("           out(%3d, %3d, %3d) er(%4d, %4d, %4d)\n", quant->mc_colors[bst_idx].channel[0], quant->mc_colors[bst_idx].channel[1], quant->mc_colors[bst_idx].channel[2], perr.r, perr.g, perr.b);*/
-      for (dx = 0; dx < mapw; ++dx) {
-	for (dy = 0; dy < maph; ++dy) {
-	  err[x+dx+dy*errw].r += perr.r * map[dx+mapw*dy];
-	  err[x+dx+dy*errw].g += perr.g * map[dx+mapw*dy];
-	  err[x+dx+dy*errw].b += perr.b * map[dx+mapw*dy];
+      er = quant->mc_colors[bst_idx].channel[0] - val.channel[0];
+      eg = quant->mc_colors[bst_idx].channel[1] - val.channel[1];
+      eb = quant->mc_colors[bst_idx].channel[2] - val.channel[2];
+      switch (kernel) {
+      case ed_floyd:
+	ERRDIFF_TAP(cur, 1, 7);
+	ERRDIFF_TAP(next1, -1, 3);
+	ERRDIFF_TAP(next1, 0, 5);
+	ERRDIFF_TAP(next1, 1, 1);
+	break;
+
+      case ed_jarvis:
+	ERRDIFF_TAP(cur, 1, 7);
+	ERRDIFF_TAP(cur, 2, 5);
+	ERRDIFF_TAP(next1, -2, 3);
+	ERRDIFF_TAP(next1, -1, 5);
+	ERRDIFF_TAP(next1, 0, 7);
+	ERRDIFF_TAP(next1, 1, 5);
+	ERRDIFF_TAP(next1, 2, 3);
+	ERRDIFF_TAP(next2, -2, 1);
+	ERRDIFF_TAP(next2, -1, 3);
+	ERRDIFF_TAP(next2, 0, 5);
+	ERRDIFF_TAP(next2, 1, 3);
+	ERRDIFF_TAP(next2, 2, 1);
+	break;
+
+      case ed_stucki:
+	ERRDIFF_TAP(cur, 1, 8);
+	ERRDIFF_TAP(cur, 2, 4);
+	ERRDIFF_TAP(next1, -2, 2);
+	ERRDIFF_TAP(next1, -1, 4);
+	ERRDIFF_TAP(next1, 0, 8);
+	ERRDIFF_TAP(next1, 1, 4);
+	ERRDIFF_TAP(next1, 2, 2);
+	ERRDIFF_TAP(next2, -2, 1);
+	ERRDIFF_TAP(next2, -1, 2);
+	ERRDIFF_TAP(next2, 0, 4);
+	ERRDIFF_TAP(next2, 1, 2);
+	ERRDIFF_TAP(next2, 2, 1);
+	break;
+
+      default:
+	for (i = 0; i < tap_count; ++i) {
+	  int *p = rows[taps[i].dy] + 3 * (x + mapw) + taps[i].offset[reverse];
+	  int weight = taps[i].weight;
+	  p[0] += er * weight;
+	  p[1] += eg * weight;
+	  p[2] += eb * weight;
 	}
+	break;
       }
-      *out++ = bst_idx;
+      out[x] = bst_idx;
     }
-    /* shift up the error matrix */
-    for (dy = 0; dy < maph-1; ++dy) {
-      memcpy(err+dy*errw, err+(dy+1)*errw, sizeof(*err)*errw);
+    out += img->xsize;
+
+    /* the top row is done, reuse it as the new bottom row */
+    {
+      int *done = rows[0];
+      for (dy = 0; dy < maph - 1; ++dy)
+	rows[dy] = rows[dy + 1];
+      rows[maph - 1] = done;
+      memset(done, 0, sizeof(int) * 3 * errw);
     }
-    memset(err+(maph-1)*errw, 0, sizeof(*err)*errw);
   }
   CF_CLEANUP;
-  myfree(err);
+  im_parallel_free(line);
+  im_parallel_free(rows);
+  im_parallel_free(err);
+  im_parallel_free(taps);
 }
 /* Prescan finds the boxes in the image that have the highest number of colors 
    and that result is used as the initial value for the vectores */
 
 
-static void prescan(i_img **imgs,int count, int cnum, cvec *clr, i_sample_t *line) {
+static void prescan(i_quantize *quant, i_img **imgs, int count, int cnum, cvec *clr, i_rand_state *rs) {
   int i,k,j;
-  i_img_dim x,y;
-  i_sample_t *val;
-  const int *chans;
+  unsigned long counts[512];
 
   pbox prebox[512];
+
+  /* process each image */
+  memset(counts, 0, sizeof(counts));
+  quant_histogram(quant, imgs, count, qh_prescan, counts);
+
   for(i=0;i<512;i++) {
     prebox[i].boxnum=i;
-    prebox[i].pixcnt=0;
+    prebox[i].pixcnt=counts[i];
     prebox[i].cand=1;
   }
 
-  /* process each image */
-  for (i = 0; i < count; ++i) {
-    i_img *im = imgs[i];
-    chans = im->channels >= 3 ? NULL : gray_samples;
-    for(y=0;y<im->ysize;y++) {
-      i_gsamp(im, 0, im->xsize, y, line, chans, 3);
-      val = line;
-      for(x=0;x<im->xsize;x++) {
-        prebox[pixbox_ch(val)].pixcnt++;
-      }
-    }
-  }
-
   for(i=0;i<512;i++) prebox[i].pdc=prebox[i].pixcnt;
   qsort(prebox,512,sizeof(pbox),(cmpfunc)pboxcmp);
 
@@ -1495,7 +2683,7 @@ static void prescan(i_img **imgs,int count, int cnum, cvec *clr, i_sample_t *lin
     if (clr[i].fixed) { i++; continue; } /* reserved go to next */
     if (j>=prebox[k].cand) { k++; j=1; } else {
       if (prebox[k].cand == 2) boxcenter(prebox[k].boxnum,&(clr[i]));
-      else boxrand(prebox[k].boxnum,&(clr[i]));
+      else boxrand(prebox[k].boxnum,&(clr[i]),rs);
       /*      printf("(%d,%d) %d %d -> (%d,%d,%d)\n",k,j,prebox[k].boxnum,prebox[k].pixcnt,clr[i].r,clr[i].g,clr[i].b); */
       j++;
       i++;
@@ -1546,22 +2734,22 @@ bbox(int box,int *r0,int *r1,int *g0,int *g1,int *b0,int *b1) {
 }
 
 static void
-boxrand(int box,cvec *cv) {
-  cv->r=6+(rand()%25)+((box&448)>>1);
-  cv->g=6+(rand()%25)+((box&56)<<2);
-  cv->b=6+(rand()%25)+((box&7)<<5);
+boxrand(int box,cvec *cv,i_rand_state *rs) {
+  cv->r=6+(i_rand_next(rs)%25)+((box&448)>>1);
+  cv->g=6+(i_rand_next(rs)%25)+((box&56)<<2);
+  cv->b=6+(i_rand_next(rs)%25)+((box&7)<<5);
 }
 
 static float
-frandn(void) {
+frandn(i_rand_state *rs) {
 
   float u1,u2,w;
   
   w=1;
   
   while (w >= 1 || w == 0) {
-    u1 = 2 * frand() - 1;
-    u2 = 2 * frand() - 1;
+    u1 = 2 * frand(rs) - 1;
+    u2 = 2 * frand(rs) - 1;
     w = u1*u1 + u2*u2;
   }
   
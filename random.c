@@ -0,0 +1,172 @@
+/*
+=head1 NAME
+
+random.c - Imager's pseudo-random number generator
+
+=head1 SYNOPSIS
+
+  // a stream per row, so rows can be processed in any order
+  unsigned long seed = im_context_next_seed(aIMCTX);
+  i_rand_state rs;
+  i_rand_seed(&rs, seed, y);
+  double d = i_rand_double(&rs);
+
+  // make results reproducible
+  im_context_set_seed(aIMCTX, 42);
+
+=head1 DESCRIPTION
+
+Filters, quantization and fills that need random numbers use this
+generator rather than the C library rand(), which is shared by the
+whole process, gives different numbers on different platforms and
+serializes threads calling it.
+
+The generator is xoshiro128**, with 128 bits of state and 32-bit
+results, written with masked C<unsigned long> arithmetic so it gives
+the same numbers on every platform.
+
+Each context has a generator, which is only used to produce a seed
+for each operation.  The operation then seeds its own generators
+from that, typically one stream per row, so the result doesn't depend
+on how the rows are split between threads.
+
+=over
+
+=cut
+*/
+
+#include "imageri.h"
+
+#define RAND_MASK 0xFFFFFFFFUL
+
+#define RAND_ROTL(x, k) \
+  ((((x) << (k)) | ((x) >> (32 - (k)))) & RAND_MASK)
+
+/* splitmix32, used to spread a seed through the state */
+static unsigned long
+rand_mix(unsigned long *x) {
+  unsigned long z = *x = (*x + 0x9E3779B9UL) & RAND_MASK;
+
+  z = ((z ^ (z >> 16)) * 0x85EBCA6BUL) & RAND_MASK;
+  z = ((z ^ (z >> 13)) * 0xC2B2AE35UL) & RAND_MASK;
+
+  return z ^ (z >> 16);
+}
+
+/*
+=item i_rand_seed(rs, seed, stream)
+=category Random numbers
+=synopsis i_rand_seed(&rs, seed, y);
+
+Seed the generator I<rs>.  Different I<stream> values give
+independent sequences from the same I<seed>, so an operation can use
+a stream per row.
+
+=cut
+*/
+
+void
+i_rand_seed(i_rand_state *rs, unsigned long seed, unsigned long stream) {
+  unsigned long x = seed & RAND_MASK;
+  int i;
+
+  x = rand_mix(&x) ^ (stream & RAND_MASK);
+  for (i = 0; i < 4; ++i)
+    rs->s[i] = rand_mix(&x);
+
+  /* the all zero state never leaves zero */
+  if (!(rs->s[0] | rs->s[1] | rs->s[2] | rs->s[3]))
+    rs->s[0] = 1;
+}
+
+/*
+=item i_rand_next(rs)
+=category Random numbers
+=synopsis unsigned long r = i_rand_next(&rs);
+
+Return the next 32-bit number from I<rs>.
+
+=cut
+*/
+
+unsigned long
+i_rand_next(i_rand_state *rs) {
+  unsigned long *s = rs->s;
+  unsigned long result = (RAND_ROTL((s[1] * 5) & RAND_MASK, 7) * 9) & RAND_MASK;
+  unsigned long t = (s[1] << 9) & RAND_MASK;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = RAND_ROTL(s[3], 11);
+
+  return result;
+}
+
+/*
+=item i_rand_double(rs)
+=category Random numbers
+=synopsis double d = i_rand_double(&rs);
+
+Return a number from 0 up to, but not including, 1 from I<rs>.
+
+=cut
+*/
+
+double
+i_rand_double(i_rand_state *rs) {
+  return i_rand_next(rs) / 4294967296.0;
+}
+
+/*
+=item im_context_set_seed(ctx, seed)
+=category Random numbers
+=synopsis im_context_set_seed(aIMCTX, 42);
+
+Seed the context's generator, so the operations after this that use
+random numbers give the same results every time.
+
+The generator is seeded with 0 when the context is created.
+
+Also callable as C<i_set_seed(seed)>.
+
+=cut
+*/
+
+void
+im_context_set_seed(im_context_t ctx, unsigned long seed) {
+  i_rand_seed(&ctx->rand_state, seed, 0);
+}
+
+/*
+=item im_context_next_seed(ctx)
+=category Random numbers
+=synopsis unsigned long seed = im_context_next_seed(aIMCTX);
+
+Return a seed for an operation that needs random numbers, from the
+context's generator.  Call this from the thread that started the
+operation, not from im_parallel_for() callbacks.
+
+=cut
+*/
+
+unsigned long
+im_context_next_seed(im_context_t ctx) {
+  return i_rand_next(&ctx->rand_state);
+}
+
+/*
+=back
+
+=head1 AUTHOR
+
+Tony Cook <tony@develop-help.com>
+
+=head1 SEE ALSO
+
+Imager(3), context.c
+
+=cut
+*/
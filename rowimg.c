@@ -0,0 +1,515 @@
+/*
+=head1 NAME
+
+rowimg.c - images whose rows are produced on demand, in order
+
+=head1 SYNOPSIS
+
+  static int
+  read_row(void *data, i_img_dim y, i_sample_t *samps) {
+    ... fill in xsize * channels samples for row y ...
+    return 1;
+  }
+
+  i_img *im = i_img_rows_new(xsize, ysize, channels, 1,
+                             read_row, destroy, data);
+
+=head1 DESCRIPTION
+
+A row image is a read-only virtual image with 8-bit samples whose rows
+are produced by a callback as they are read, rather than being stored.
+Rows are produced from the top of the image down, and only the most
+recently produced rows are kept, so a chain of row images, for
+example a decoder feeding a scaler, can be written out a row at a time
+without the whole image ever being in memory.
+
+The cost is that rows must be read in order: reading a row that has
+been discarded fails, and so does every read after a callback fails.
+
+=over
+
+=cut
+*/
+
+#define IMAGER_NO_CONTEXT
+
+#include "imager.h"
+#include "imageri.h"
+
+typedef struct {
+  i_img_rows_read_f read_row;
+  i_img_rows_destroy_f destroy;
+  void *data;
+
+  /* the last window rows produced, row y is at y % window */
+  int window;
+  i_sample_t *rows;
+
+  /* the next row to produce */
+  i_img_dim next_row;
+
+  /* the first failure, after which all reads fail */
+  char *error;
+} i_img_rows_ext;
+
+#define ROWSEXT(im) ((i_img_rows_ext *)((im)->ext_data))
+
+static void i_destroy_rows(i_img *im);
+static int i_ppix_rows(i_img *im, i_img_dim x, i_img_dim y, const i_color *pix);
+static int i_ppixf_rows(i_img *im, i_img_dim x, i_img_dim y, const i_fcolor *pix);
+static i_img_dim i_plin_rows(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y, const i_color *vals);
+static i_img_dim i_plinf_rows(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y, const i_fcolor *vals);
+static int i_gpix_rows(i_img *im, i_img_dim x, i_img_dim y, i_color *pix);
+static int i_gpixf_rows(i_img *im, i_img_dim x, i_img_dim y, i_fcolor *pix);
+static i_img_dim i_glin_rows(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y, i_color *vals);
+static i_img_dim i_glinf_rows(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y, i_fcolor *vals);
+static i_img_dim i_gsamp_rows(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y, i_sample_t *samps,
+			      int const *chans, int chan_count);
+static i_img_dim i_gsampf_rows(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y, i_fsample_t *samps,
+			       int const *chans, int chan_count);
+static i_img_dim
+psamp_rows(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y,
+	   const i_sample_t *samples, const int *chans, int chan_count);
+static i_img_dim
+psampf_rows(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y,
+	    const i_fsample_t *samples, const int *chans, int chan_count);
+
+static i_img IIM_base_rows =
+{
+  0, /* channels set */
+  0, 0, 0, /* xsize, ysize, bytes */
+  ~0U, /* ch_mask */
+  i_8_bits, /* bits */
+  i_direct_type, /* type */
+  1, /* virtual */
+  NULL, /* idata */
+  { 0, 0, NULL }, /* tags */
+  NULL, /* ext_data */
+
+  i_ppix_rows, /* i_f_ppix */
+  i_ppixf_rows, /* i_f_ppixf */
+  i_plin_rows, /* i_f_plin */
+  i_plinf_rows, /* i_f_plinf */
+  i_gpix_rows, /* i_f_gpix */
+  i_gpixf_rows, /* i_f_gpixf */
+  i_glin_rows, /* i_f_glin */
+  i_glinf_rows, /* i_f_glinf */
+  i_gsamp_rows, /* i_f_gsamp */
+  i_gsampf_rows, /* i_f_gsampf */
+
+  NULL, /* i_f_gpal */
+  NULL, /* i_f_ppal */
+  NULL, /* i_f_addcolors */
+  NULL, /* i_f_getcolors */
+  NULL, /* i_f_colorcount */
+  NULL, /* i_f_maxcolors */
+  NULL, /* i_f_findcolor */
+  NULL, /* i_f_setcolors */
+
+  i_destroy_rows, /* i_f_destroy */
+
+  i_gsamp_bits_fb, /* i_f_gsamp_bits */
+  NULL, /* i_f_psamp_bits */
+
+  psamp_rows, /* i_f_psamp */
+  psampf_rows /* i_f_psampf */
+};
+
+/*
+=item im_img_rows_new(ctx, xsize, ysize, channels, window, read_row, destroy, data)
+X<im_img_rows_new API>X<i_img_rows_new API>
+=category Image creation/destruction
+=synopsis i_img *img = im_img_rows_new(aIMCTX, width, height, channels, 1, read_row, destroy, data);
+=synopsis i_img *img = i_img_rows_new(width, height, channels, 1, read_row, destroy, data);
+
+Create a read-only image with 8-bit samples whose rows are produced
+by calling C<read_row> as they are read.
+
+C<read_row> is called as C<read_row(data, y, samps)> for each row
+from the top of the image down, and should store C<width> *
+C<channels> samples in C<samps> and return true, or push an error
+message and return false on failure.
+
+The last C<window> rows produced are kept, reading an earlier row
+fails.  Once C<read_row> fails every read from the image fails.
+
+C<destroy>, if not NULL, is called with C<data> when the image is
+destroyed.  C<destroy> is also called if the image can't be created.
+
+=cut
+*/
+
+i_img *
+im_img_rows_new(pIMCTX, i_img_dim xsize, i_img_dim ysize, int channels,
+		int window, i_img_rows_read_f read_row,
+		i_img_rows_destroy_f destroy, void *data) {
+  i_img *im;
+  i_img_rows_ext *ext;
+  size_t row_size;
+
+  im_log((aIMCTX, 1, "im_img_rows_new(xsize %" i_DF ", ysize %" i_DF
+	  ", channels %d, window %d, read_row %p, destroy %p, data %p)\n",
+	  i_DFc(xsize), i_DFc(ysize), channels, window, read_row, destroy,
+	  data));
+
+  im_clear_error(aIMCTX);
+
+  if (xsize < 1 || ysize < 1) {
+    im_push_error(aIMCTX, 0, "Image sizes must be positive");
+    goto fail;
+  }
+  if (channels < 1 || channels > MAXCHANNELS) {
+    im_push_errorf(aIMCTX, 0, "channels must be between 1 and %d", MAXCHANNELS);
+    goto fail;
+  }
+  if (window < 1) {
+    im_push_error(aIMCTX, 0, "window must be at least 1 row");
+    goto fail;
+  }
+  row_size = xsize * channels;
+  if (row_size / xsize != channels
+      || row_size * window / window != row_size) {
+    im_push_error(aIMCTX, 0, "integer overflow calculating row buffer size");
+    goto fail;
+  }
+
+  im = im_img_alloc(aIMCTX);
+  memcpy(im, &IIM_base_rows, sizeof(i_img));
+  i_tags_new(&im->tags);
+  im->xsize = xsize;
+  im->ysize = ysize;
+  im->channels = channels;
+  ext = mymalloc(sizeof(*ext));
+  ext->read_row = read_row;
+  ext->destroy = destroy;
+  ext->data = data;
+  ext->window = window;
+  ext->rows = mymalloc(row_size * window);
+  ext->next_row = 0;
+  ext->error = NULL;
+  im->ext_data = ext;
+
+  im_img_init(aIMCTX, im);
+
+  return im;
+
+ fail:
+  if (destroy)
+    destroy(data);
+
+  return NULL;
+}
+
+/*
+=item i_img_rows_error(im)
+=category Image Information
+=synopsis const char *msg = i_img_rows_error(im);
+
+Returns the message from the first failure reading C<im>, or from
+reading any image it is produced from, if C<im> is a row image
+created by im_img_rows_new().
+
+Returns NULL if no reads have failed or C<im> isn't a row image.
+
+Use this after writing a row image, since file writers don't all
+check for errors reading the image.
+
+=cut
+*/
+
+const char *
+i_img_rows_error(i_img *im) {
+  if (im->i_f_destroy != i_destroy_rows)
+    return NULL;
+
+  return ROWSEXT(im)->error;
+}
+
+/*
+=item rows_failed(im, msg)
+
+Record the failure reading C<im>, after which all reads fail.
+
+=cut
+*/
+
+static void
+rows_failed(i_img *im, const char *msg) {
+  i_img_rows_ext *ext = ROWSEXT(im);
+
+  ext->error = mymalloc(strlen(msg) + 1);
+  strcpy(ext->error, msg);
+}
+
+/*
+=item rows_fetch(im, y)
+
+Returns a pointer to the samples for row C<y>, producing rows up to
+C<y> if needed.
+
+Returns NULL on failure.
+
+=cut
+*/
+
+static const i_sample_t *
+rows_fetch(i_img *im, i_img_dim y) {
+  i_img_rows_ext *ext = ROWSEXT(im);
+  size_t row_size = im->xsize * im->channels;
+
+  if (ext->error) {
+    dIMCTXim(im);
+    im_push_error(aIMCTX, 0, ext->error);
+    return NULL;
+  }
+
+  if (y < ext->next_row - ext->window) {
+    char buf[100];
+    dIMCTXim(im);
+    sprintf(buf, "row %" i_DF " of a row image is no longer available, "
+	    "rows must be read in order", i_DFc(y));
+    rows_failed(im, buf);
+    im_push_error(aIMCTX, 0, buf);
+    return NULL;
+  }
+
+  while (ext->next_row <= y) {
+    i_sample_t *row = ext->rows + (ext->next_row % ext->window) * row_size;
+    dIMCTXim(im);
+    i_errmsg *before = im_errors(aIMCTX);
+
+    if (!ext->read_row(ext->data, ext->next_row, row)) {
+      i_errmsg *errors = im_errors(aIMCTX);
+      char buf[100];
+
+      /* the callback should have pushed an error, but don't mistake
+	 an older error for it */
+      if (errors != before && errors[0].msg) {
+	rows_failed(im, errors[0].msg);
+      }
+      else {
+	sprintf(buf, "could not produce row %" i_DF, i_DFc(ext->next_row));
+	rows_failed(im, buf);
+	im_push_error(aIMCTX, 0, buf);
+      }
+      return NULL;
+    }
+    ++ext->next_row;
+  }
+
+  return ext->rows + (y % ext->window) * row_size;
+}
+
+static void
+i_destroy_rows(i_img *im) {
+  i_img_rows_ext *ext = ROWSEXT(im);
+
+  if (ext->destroy)
+    ext->destroy(ext->data);
+  if (ext->error)
+    myfree(ext->error);
+  myfree(ext->rows);
+  myfree(ext);
+}
+
+static int
+i_ppix_rows(i_img *im, i_img_dim x, i_img_dim y, const i_color *pix) {
+  return -1;
+}
+
+static int
+i_ppixf_rows(i_img *im, i_img_dim x, i_img_dim y, const i_fcolor *pix) {
+  return -1;
+}
+
+static i_img_dim
+i_plin_rows(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y,
+	    const i_color *vals) {
+  return 0;
+}
+
+static i_img_dim
+i_plinf_rows(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y,
+	     const i_fcolor *vals) {
+  return 0;
+}
+
+static i_img_dim
+i_glin_rows(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y, i_color *vals) {
+  const i_sample_t *row;
+  i_img_dim i;
+  int ch;
+
+  if (y < 0 || y >= im->ysize || l < 0 || l >= im->xsize)
+    return 0;
+  if (r > im->xsize)
+    r = im->xsize;
+
+  row = rows_fetch(im, y);
+  if (!row)
+    return 0;
+
+  row += l * im->channels;
+  for (i = l; i < r; ++i) {
+    for (ch = 0; ch < im->channels; ++ch)
+      vals->channel[ch] = *row++;
+    ++vals;
+  }
+
+  return r - l;
+}
+
+static i_img_dim
+i_glinf_rows(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y, i_fcolor *vals) {
+  const i_sample_t *row;
+  i_img_dim i;
+  int ch;
+
+  if (y < 0 || y >= im->ysize || l < 0 || l >= im->xsize)
+    return 0;
+  if (r > im->xsize)
+    r = im->xsize;
+
+  row = rows_fetch(im, y);
+  if (!row)
+    return 0;
+
+  row += l * im->channels;
+  for (i = l; i < r; ++i) {
+    for (ch = 0; ch < im->channels; ++ch)
+      vals->channel[ch] = Sample8ToF(*row++);
+    ++vals;
+  }
+
+  return r - l;
+}
+
+static int
+i_gpix_rows(i_img *im, i_img_dim x, i_img_dim y, i_color *pix) {
+  return i_glin_rows(im, x, x + 1, y, pix) ? 0 : -1;
+}
+
+static int
+i_gpixf_rows(i_img *im, i_img_dim x, i_img_dim y, i_fcolor *pix) {
+  return i_glinf_rows(im, x, x + 1, y, pix) ? 0 : -1;
+}
+
+static i_img_dim
+i_gsamp_rows(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y,
+	     i_sample_t *samps, int const *chans, int chan_count) {
+  const i_sample_t *row;
+  i_img_dim i, count = 0;
+  int ch;
+
+  if (y < 0 || y >= im->ysize || l < 0 || l >= im->xsize)
+    return 0;
+  if (r > im->xsize)
+    r = im->xsize;
+
+  if (chans) {
+    for (ch = 0; ch < chan_count; ++ch) {
+      if (chans[ch] < 0 || chans[ch] >= im->channels) {
+	dIMCTXim(im);
+	im_push_errorf(aIMCTX, 0, "No channel %d in this image", chans[ch]);
+	return 0;
+      }
+    }
+  }
+  else if (chan_count <= 0 || chan_count > im->channels) {
+    dIMCTXim(im);
+    im_push_errorf(aIMCTX, 0, "chan_count %d out of range, must be >0, <= channels",
+		   chan_count);
+    return 0;
+  }
+
+  row = rows_fetch(im, y);
+  if (!row)
+    return 0;
+
+  row += l * im->channels;
+  for (i = l; i < r; ++i) {
+    for (ch = 0; ch < chan_count; ++ch)
+      *samps++ = row[chans ? chans[ch] : ch];
+    count += chan_count;
+    row += im->channels;
+  }
+
+  return count;
+}
+
+static i_img_dim
+i_gsampf_rows(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y,
+	      i_fsample_t *samps, int const *chans, int chan_count) {
+  const i_sample_t *row;
+  i_img_dim i, count = 0;
+  int ch;
+
+  if (y < 0 || y >= im->ysize || l < 0 || l >= im->xsize)
+    return 0;
+  if (r > im->xsize)
+    r = im->xsize;
+
+  if (chans) {
+    for (ch = 0; ch < chan_count; ++ch) {
+      if (chans[ch] < 0 || chans[ch] >= im->channels) {
+	dIMCTXim(im);
+	im_push_errorf(aIMCTX, 0, "No channel %d in this image", chans[ch]);
+	return 0;
+      }
+    }
+  }
+  else if (chan_count <= 0 || chan_count > im->channels) {
+    dIMCTXim(im);
+    im_push_errorf(aIMCTX, 0, "chan_count %d out of range, must be >0, <= channels",
+		   chan_count);
+    return 0;
+  }
+
+  row = rows_fetch(im, y);
+  if (!row)
+    return 0;
+
+  row += l * im->channels;
+  for (i = l; i < r; ++i) {
+    for (ch = 0; ch < chan_count; ++ch)
+      *samps++ = Sample8ToF(row[chans ? chans[ch] : ch]);
+    count += chan_count;
+    row += im->channels;
+  }
+
+  return count;
+}
+
+static i_img_dim
+psamp_rows(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y,
+	   const i_sample_t *samples, const int *chans, int chan_count) {
+  dIMCTXim(im);
+
+  im_push_error(aIMCTX, 0, "row images are read-only");
+
+  return -1;
+}
+
+static i_img_dim
+psampf_rows(i_img *im, i_img_dim l, i_img_dim r, i_img_dim y,
+	    const i_fsample_t *samples, const int *chans, int chan_count) {
+  dIMCTXim(im);
+
+  im_push_error(aIMCTX, 0, "row images are read-only");
+
+  return -1;
+}
+
+/*
+=back
+
+=head1 AUTHOR
+
+Tony Cook <tony@develop-help.com>
+
+=head1 SEE ALSO
+
+Imager(3), Imager::Pipeline(3)
+
+=cut
+*/
@@ -1,10 +1,10 @@
 #!perl -w
 # some of this is tested in t01introvert.t too
 use strict;
-use Test::More tests => 226;
+use Test::More tests => 314;
 BEGIN { use_ok("Imager", ':handy'); }
 
-use Imager::Test qw(image_bounds_checks test_image is_color3 isnt_image is_color4 is_fcolor3);
+use Imager::Test qw(image_bounds_checks test_image is_color3 is_image isnt_image is_color4 is_fcolor3);
 
 Imager->open_log(log => "testout/t023palette.log");
 
@@ -592,6 +592,249 @@ my $psamp_outside_error = "Image position outside of image";
 	     0, 0, 1.0, "get a pixel in float form, make sure it's blue");
 }
 
+{ # inverse color map lookups
+  my $src = test_image()->scale(xpixels => 60);
+  $src->filter(type => "noise", amount => 40, subtype => 1);
+  my @pal = Imager->make_palette({ make_colors => "mediancut" }, $src);
+  my @pal_rgb = map [ ($_->rgba)[0 .. 2] ], @pal;
+
+  # the distance from each pixel to the nearest palette entry
+  my @nearest;
+  for my $y (0 .. $src->getheight - 1) {
+    my @samps = unpack "C*", $src->getsamples(y => $y);
+    while (my @p = splice @samps, 0, 3) {
+      my $min;
+      for my $c (@pal_rgb) {
+	my $d = ($p[0] - $c->[0]) ** 2 + ($p[1] - $c->[1]) ** 2
+	  + ($p[2] - $c->[2]) ** 2;
+	$min = $d if !defined $min || $d < $min;
+      }
+      push @nearest, $min;
+    }
+  }
+
+  for my $bits (5, 6) {
+    my $im = $src->to_paletted(make_colors => "none", colors => [ @pal ],
+			       lookup_bits => $bits);
+    ok($im, "translate with $bits bit lookup");
+    my $bad = 0;
+    my $i = 0;
+    for my $y (0 .. $im->getheight - 1) {
+      my @samps = unpack "C*", $src->getsamples(y => $y);
+      for my $index ($im->getscanline(y => $y, type => "index")) {
+	my @p = splice @samps, 0, 3;
+	my $c = $pal_rgb[$index];
+	my $d = ($p[0] - $c->[0]) ** 2 + ($p[1] - $c->[1]) ** 2
+	  + ($p[2] - $c->[2]) ** 2;
+	++$bad if $d != $nearest[$i++];
+      }
+    }
+    is($bad, 0, "$bits bits: every pixel gets a closest color");
+  }
+
+  my $rough = $src->to_paletted(make_colors => "none", colors => [ @pal ],
+				lookup_exact => 0);
+  ok($rough, "translate with an inexact lookup");
+  my $plain = $src->to_paletted(make_colors => "none", colors => [ @pal ],
+				lookup_bits => 0);
+  ok($plain, "translate without a lookup table");
+  my $rough_diff = Imager::i_img_diff($rough->{IMG}, $src->{IMG});
+  my $plain_diff = Imager::i_img_diff($plain->{IMG}, $src->{IMG});
+  cmp_ok($rough_diff, "<", $plain_diff * 1.25,
+	 "inexact isn't much worse than an exact search");
+
+  ok(!$src->to_paletted(lookup_bits => 7), "only 5 or 6 bits");
+  like($src->errstr, qr/lookup_bits must be 0, 5 or 6/, "check message");
+}
+
+{ # wu quantizer
+  my $src = test_image()->scale(xpixels => 60);
+  $src->filter(type => "noise", amount => 40, subtype => 1);
+  my %diff;
+  for my $mc (qw(addi mediancut wu)) {
+    my @pal = Imager->make_palette({ make_colors => $mc }, $src);
+    my $im = $src->to_paletted(make_colors => "none", colors => \@pal);
+    $diff{$mc} = Imager::i_img_diff($im->{IMG}, $src->{IMG});
+  }
+  my @wu = Imager->make_palette({ make_colors => "wu" }, $src);
+  is(@wu, 256, "wu: fills the palette");
+  cmp_ok($diff{wu}, "<", $diff{addi}, "wu: less error than addi");
+  cmp_ok($diff{wu}, "<", $diff{mediancut}, "wu: less error than mediancut");
+
+  my $few = Imager->new(xsize => 20, ysize => 20);
+  $few->box(filled => 1, color => "#102030", xmax => 9);
+  $few->box(filled => 1, color => "#F0E0D0", xmin => 10);
+  $few->box(filled => 1, color => "#00FF00", ymin => 15);
+  my @few = sort { ($a->rgba)[0] <=> ($b->rgba)[0] }
+    Imager->make_palette({ make_colors => "wu" }, $few);
+  is(@few, 3, "wu: only 3 colors for 3 color image");
+  is_color3($few[0], 0, 255, 0, "wu: check color 0");
+  is_color3($few[1], 0x10, 0x20, 0x30, "wu: check color 1");
+  is_color3($few[2], 0xF0, 0xE0, 0xD0, "wu: check color 2");
+
+  my $other = Imager->new(xsize => 10, ysize => 10);
+  $other->box(filled => 1, color => "#FF00FF");
+  my @multi = Imager->make_palette({ make_colors => "wu" }, $few, $other);
+  is(@multi, 4, "wu: colors from both images");
+  ok((grep { my @c = $_->rgba; "@c[0..2]" eq "255 0 255" } @multi),
+     "wu: includes the color from the second image");
+
+  my $fixed = $src->to_paletted(make_colors => "wu", max_colors => 16,
+				colors => [ NC(255, 255, 0) ]);
+  ok($fixed, "wu with a supplied color");
+  is($fixed->colorcount, 16, "wu: check color count");
+  is_color3($fixed->getcolors(start => 0), 255, 255, 0,
+	    "wu: supplied color is kept");
+
+  my @gray = Imager->make_palette({ make_colors => "wu" },
+				  $src->convert(preset => "gray"));
+  cmp_ok(scalar(@gray), ">=", 16, "wu: gray image");
+  is((grep { my ($r, $g, $b) = $_->rgba; $r != $g || $g != $b } @gray), 0,
+     "wu: gray image gives gray colors");
+}
+
+{ # findcolor through the palette hash
+  my $im = Imager->new(xsize => 10, ysize => 10, type => "paletted");
+  my @colors = map NC($_ * 37 % 256, $_, ($_ * 5) % 256), 0 .. 249;
+  is($im->addcolors(colors => \@colors), "0 but true", "add 250 colors");
+  my $bad = 0;
+  for my $i (0 .. $#colors) {
+    my $found = $im->findcolor(color => $colors[$i]);
+    ++$bad unless defined $found && $found == $i;
+  }
+  is($bad, 0, "each color found at its index");
+  is($im->findcolor(color => NC(1, 2, 3)), undef, "missing color not found");
+
+  is($im->addcolors(colors => [ $colors[20], NC(1, 2, 3) ]), 250,
+     "add a duplicate and a new color");
+  is($im->findcolor(color => $colors[20]), 20, "duplicate finds the first");
+  is($im->findcolor(color => NC(1, 2, 3)), 251, "new color found");
+
+  ok($im->setcolors(start => 20, colors => [ NC(4, 5, 6) ]),
+     "replace entry 20");
+  is($im->findcolor(color => NC(4, 5, 6)), 20, "replacement found");
+  is($im->findcolor(color => $colors[20]), 250,
+     "old color now found at the later duplicate");
+  ok($im->setcolors(start => 30, colors => [ $colors[10] ]),
+     "make 30 a copy of 10");
+  is($im->findcolor(color => $colors[10]), 10, "still finds the first");
+  is($im->findcolor(color => $colors[30]), undef, "old 30 is gone");
+
+  ok($im->setscanline(y => 3, pixels => [ @colors[0 .. 9] ]),
+     "write a line of palette colors");
+  is($im->type, "paletted", "still paletted");
+  is_deeply([ $im->getscanline(y => 3, type => "index") ],
+	    [ 0 .. 9 ], "check indexes written");
+
+  my $gray = Imager->new(xsize => 5, ysize => 5, channels => 1,
+			 type => "paletted");
+  $gray->addcolors(colors => [ map NC($_, $_, $_), 0, 128, 255 ]);
+  is($gray->findcolor(color => NC(128, 0, 7)), 1,
+     "only the image channels are compared");
+}
+
+{ # quant_sample
+  my $im = Imager->new(xsize => 8, ysize => 8);
+  $im->line(x1 => 1, y1 => 0, x2 => 1, y2 => 7, color => "#FFFFFF");
+  $im->line(x1 => 0, y1 => 3, x2 => 7, y2 => 3, color => "#FF0000");
+  for my $mc (qw(addi mediancut wu)) {
+    my @all = Imager->make_palette({ make_colors => $mc }, $im);
+    is(@all, 3, "$mc: all 3 colors without sampling");
+    my @some = Imager->make_palette({ make_colors => $mc, quant_sample => 2 },
+				    $im);
+    is(@some, 1, "$mc: only black with sampling");
+    is_color3($some[0], 0, 0, 0, "$mc: check sampled color");
+  }
+  my $big = test_image();
+  my @pal = Imager->make_palette({ make_colors => "wu", quant_sample => 1000 },
+				 $big);
+  is(@pal, 1, "sample larger than the image counts the first pixel");
+}
+
+{ # error diffusion
+  my $src = test_image()->scale(xpixels => 60);
+  my @pal = Imager->make_palette({ make_colors => "mediancut" }, $src);
+  my $plain = $src->to_paletted(make_colors => "none", colors => [ @pal ],
+				lookup_bits => 0);
+  my $plain_diff = Imager::i_img_diff($plain->{IMG}, $src->{IMG});
+  for my $errdiff (qw(floyd jarvis stucki)) {
+    my @ims;
+    for my $serpentine (0, 1) {
+      my $im = $src->to_paletted(make_colors => "none", colors => [ @pal ],
+				 translate => "errdiff", errdiff => $errdiff,
+				 errdiff_serpentine => $serpentine);
+      ok($im, "$errdiff, serpentine $serpentine: translate");
+      is($im->colorcount, scalar(@pal), "$errdiff, serpentine $serpentine: palette");
+      # the dithered image should average to about the source colors
+      my $dither = $im->scale(scalefactor => 0.25, qtype => "mixing");
+      my $close = $plain->scale(scalefactor => 0.25, qtype => "mixing");
+      my $small = $src->scale(scalefactor => 0.25, qtype => "mixing");
+      cmp_ok(Imager::i_img_diff($dither->{IMG}, $small->{IMG}), "<",
+	     Imager::i_img_diff($close->{IMG}, $small->{IMG}),
+	     "$errdiff, serpentine $serpentine: closer on average than no dither");
+      push @ims, $im;
+    }
+    isnt_image($ims[0], $ims[1], "$errdiff: serpentine makes a difference");
+  }
+
+  # gray palettes convert the source to gray first
+  my $gray = $src->to_paletted(make_colors => "mono", translate => "errdiff",
+			       errdiff => "floyd", errdiff_serpentine => 1);
+  ok($gray, "dither to mono, serpentine");
+  is($gray->colorcount, 2, "mono: check colors");
+
+  my $custom = $src->to_paletted(make_colors => "none", colors => [ @pal ],
+				 translate => "errdiff", errdiff => "custom",
+				 errdiff_width => 3, errdiff_height => 2,
+				 errdiff_orig => 1,
+				 errdiff_map => [ 0, 0, 2, 1, 1, 0 ],
+				 errdiff_serpentine => 1);
+  ok($custom, "custom map, serpentine");
+
+  # negative weights can push corrected samples well out of range
+  my $negative = $src->to_paletted(make_colors => "none", colors => [ @pal ],
+				   translate => "errdiff", errdiff => "custom",
+				   errdiff_width => 3, errdiff_height => 2,
+				   errdiff_orig => 1,
+				   errdiff_map => [ 0, 0, 1000, -999, 0, 0 ]);
+  ok($negative, "custom map with a negative weight");
+  my $neg_total = $src->to_paletted(make_colors => "none", colors => [ @pal ],
+				    translate => "errdiff", errdiff => "custom",
+				    errdiff_width => 3, errdiff_height => 2,
+				    errdiff_orig => 1,
+				    errdiff_map => [ 0, 0, -2, -1, -1, 0 ]);
+  ok($neg_total, "custom map with a negative total");
+}
+
+{ # to_paletted_multi
+  my $src = test_image();
+  my @frames = ($src, $src->rotate(degrees => 180),
+		$src->convert(preset => "gray")->scale(scalefactor => 0.5));
+  my @pal = Imager->make_palette({ make_colors => "mediancut" }, @frames);
+  my %opts = (make_colors => "mediancut", translate => "errdiff");
+  my @pals = Imager->to_paletted_multi({ %opts }, @frames);
+  is(@pals, 3, "to_paletted_multi: convert three images");
+  for my $i (0 .. $#frames) {
+    is_deeply([ map [ $_->rgba ], $pals[$i]->getcolors ],
+	      [ map [ $_->rgba ], @pal ], "image $i: shared palette");
+    my $one = $frames[$i]->to_paletted(make_colors => "none",
+				       colors => [ @pal ],
+				       translate => "errdiff");
+    is_image($pals[$i], $one, "image $i: same as to_paletted()");
+  }
+
+  ok(!Imager->to_paletted_multi({}), "need an image");
+  is(Imager->errstr, "to_paletted_multi: supply at least one image",
+     "check message");
+  ok(!Imager->to_paletted_multi({}, $src, Imager->new), "empty image");
+  is(Imager->errstr, "to_paletted_multi: image 2 is empty",
+     "check message");
+  ok(!Imager->to_paletted_multi({ make_colors => "none" }, $src),
+     "no colors");
+  is(Imager->errstr, "no colors available for translation",
+     "check message");
+}
+
 {
   my $empty = Imager->new;
   ok(!$empty->to_paletted, "can't convert an empty image");
@@ -0,0 +1,138 @@
+#!perl -w
+use strict;
+use Test::More;
+use Imager;
+use Imager::Test qw(test_image is_image image_bounds_checks mask_tests);
+
+-d "testout" or mkdir "testout";
+
+{
+  my $im = Imager->new(xsize => 1, ysize => 1, storage => "mmap");
+  $im
+    or plan skip_all => "no mmap storage: " . Imager->errstr;
+}
+
+plan tests => 88;
+
+Imager->open_log(log => "testout/t050mmap.log");
+
+my $src = test_image();
+
+for my $bits (8, 16, "double") {
+  my $im = Imager->new(xsize => 150, ysize => 150, storage => "mmap",
+		       bits => $bits);
+  ok($im, "make a $bits bit mmap image")
+    or diag(Imager->errstr);
+  is($im->bits, $bits, "$bits: check bits");
+  ok(!$im->virtual, "$bits: not virtual");
+  is($im->type, "direct", "$bits: direct");
+  is_image($im, Imager->new(xsize => 150, ysize => 150),
+	   "$bits: starts black");
+
+  my $mem = Imager->new(xsize => 150, ysize => 150, bits => $bits);
+  for my $work ($im, $mem) {
+    $work->paste(src => $src);
+    $work->box(filled => 1, color => "#0F0", xmin => 100, ymin => 5,
+	       xmax => 140, ymax => 145);
+    $work->filter(type => "gaussian", stddev => 2);
+    $work->filter(type => "contrast", intensity => 1.5);
+  }
+  is_image($im, $mem, "$bits: drawing and filters match a memory image");
+  is_image($im->scale(scalefactor => 0.5, qtype => "mixing"),
+	   $mem->scale(scalefactor => 0.5, qtype => "mixing"),
+	   "$bits: scaling matches");
+  is_image($im->rotate(degrees => 20), $mem->rotate(degrees => 20),
+	   "$bits: rotate matches");
+}
+
+{ # named file
+  my $file = "testout/t050mmap.raw";
+  my $im = Imager->new(xsize => 31, ysize => 17, channels => 4,
+		       storage => "mmap", storage_file => $file);
+  ok($im, "make an image in a named file")
+    or diag(Imager->errstr);
+  $im->paste(src => $src->convert(preset => "addalpha"));
+  $im->box(filled => 1, color => [ 255, 128, 0, 100 ],
+	   xmin => 10, ymin => 5, xmax => 20, ymax => 12);
+  my $samples = join "", map scalar($im->getsamples(y => $_)), 0 .. 16;
+  undef $im;
+  ok(-f $file, "file is kept");
+  is(-s $file, 31 * 17 * 4, "check file size");
+  is(_slurp($file), $samples, "file holds the samples");
+
+  my $im16 = Imager->new(xsize => 10, ysize => 3, bits => 16,
+			 storage => "mmap", storage_file => $file);
+  ok($im16, "re-use the file for a 16-bit image");
+  $im16->box(filled => 1, color => "#FFF");
+  undef $im16;
+  is(-s $file, 10 * 3 * 3 * 2, "file was truncated and resized");
+  is(_slurp($file), "\xFF" x (10 * 3 * 3 * 2), "check 16-bit samples");
+
+  unlink $file unless $ENV{IMAGER_KEEP_FILES};
+}
+
+{ # temporary files are removed
+  my $dir = "testout/t050mmap";
+  -d $dir or mkdir $dir or die "Cannot mkdir $dir: $!";
+  local $ENV{TMPDIR} = $dir;
+  my $im = Imager->new(xsize => 100, ysize => 100, storage => "mmap");
+  ok($im, "make an image in a temporary file");
+  opendir my $dh, $dir or die "Cannot opendir $dir: $!";
+  my @files = grep !/^\.\.?$/, readdir $dh;
+  closedir $dh;
+  is(@files, 0, "temporary file is already unlinked");
+  rmdir $dir;
+}
+
+{ # img_set
+  my $im = Imager->new;
+  ok($im->img_set(xsize => 20, ysize => 10, storage => "mmap",
+		  bits => 16), "img_set with mmap storage");
+  is($im->getwidth, 20, "check width");
+  is($im->bits, 16, "check bits");
+}
+
+{ # channel masks and bounds checks
+  my $im = Imager->new(xsize => 10, ysize => 10, storage => "mmap");
+  mask_tests($im, 0.005);
+  image_bounds_checks($im);
+}
+
+{ # failures
+  ok(!Imager->new(xsize => 10, ysize => 10, type => "paletted",
+		  storage => "mmap"), "no mmap paletted images");
+  is(Imager->errstr, "mmap storage is only available for direct images",
+     "check message");
+  ok(!Imager->new(xsize => 10, ysize => 10, storage => "disk"),
+     "unknown storage");
+  is(Imager->errstr, "storage must be 'memory' or 'mmap'", "check message");
+  ok(!Imager->new(xsize => 0, ysize => 10, storage => "mmap"),
+     "bad size");
+  is(Imager->errstr, "Image sizes must be positive", "check message");
+  ok(!Imager->new(xsize => 10, ysize => 10, channels => 5,
+		  storage => "mmap"), "bad channels");
+  is(Imager->errstr, "channels must be between 1 and 4", "check message");
+  ok(!Imager->new(xsize => 10, ysize => 10, storage => "mmap",
+		  storage_file => "testout/nosuchdir/t050mmap.raw"),
+     "can't create file");
+  like(Imager->errstr, qr/^cannot create mmap file testout\/nosuchdir/,
+       "check message");
+  ok(!Imager::i_img_mmap_new(10, 10, 3, 12), "bad bits");
+  is(Imager->_error_as_msg, "bits must be 8, 16 or double",
+     "check message");
+}
+
+Imager->close_log;
+
+unless ($ENV{IMAGER_KEEP_FILES}) {
+  unlink "testout/t050mmap.log";
+}
+
+sub _slurp {
+  my ($file) = @_;
+
+  open my $fh, "<", $file or die "Cannot open $file: $!";
+  binmode $fh;
+  local $/;
+  return scalar <$fh>;
+}
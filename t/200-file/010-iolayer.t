@@ -1,7 +1,7 @@
 #!perl -w
 use strict;
-use Test::More tests => 274;
-use Imager::Test qw(is_image);
+use Test::More tests => 368;
+use Imager::Test qw(is_image test_image);
 # for SEEK_SET etc, Fcntl doesn't provide these in 5.005_03
 use IO::Seekable;
 use Config;
@@ -888,6 +888,300 @@ SKIP:
   is(tied(*FOO)->[0], "temore", "tied: check it got to the output properly");
 }
 
+{ # mmap
+  my $file = "testout/t07mmap.txt";
+  open my $fh, "> $file" or die "Cannot create $file: $!";
+  binmode $fh;
+  print $fh "0123456789" x 100;
+  close $fh;
+
+  open my $fhr, "< $file" or die "Cannot open $file: $!";
+  binmode $fhr;
+  sysseek($fhr, 5, SEEK_SET);
+  my $io = Imager::IO->new_mmap(fileno($fhr));
+  ok($io, "mmap: make an I/O layer");
+  is($io->getc, ord "5", "mmap: reading starts at the fd position");
+  is($io->peekn(3), "678", "mmap: peekn");
+  my $buf;
+  is($io->read($buf, 7), 7, "mmap: read");
+  is($buf, "6789012", "mmap: check data read");
+  is($io->seek(-4, SEEK_END), 996, "mmap: seek from end");
+  is($io->read($buf, 10), 4, "mmap: short read at end");
+  is($buf, "6789", "mmap: check data read");
+  is($io->read($buf, 10), 0, "mmap: eof");
+  is($io->seek(0, SEEK_CUR), 1000, "mmap: position at eof");
+  is($io->seek(2000, SEEK_SET), 2000, "mmap: seek past end");
+  is($io->getc, -1, "mmap: getc past end is eof");
+  is($io->seek(-1, SEEK_SET), -1, "mmap: can't seek before start");
+  is($io->seek(-10, SEEK_CUR), 1990, "mmap: seek relative past end");
+  is($io->seek(10, SEEK_SET), 10, "mmap: seek back into the file");
+  is($io->peekn(4), "0123", "mmap: peekn after seek");
+  is($io->raw_write("x"), -1, "mmap: can't write");
+  is(sysseek($fhr, 0, SEEK_CUR), 5, "mmap: fd position unchanged");
+  undef $io;
+  close $fhr;
+
+  open my $fhe, "> $file" or die "Cannot create $file: $!";
+  close $fhe;
+  open $fhr, "< $file" or die "Cannot open $file: $!";
+  $io = Imager::IO->new_mmap(fileno($fhr));
+  ok($io, "mmap: empty file");
+  is($io->getc, -1, "mmap: empty file is eof");
+  undef $io;
+  close $fhr;
+  unlink $file;
+}
+
+SKIP:
+{ # mmap falls back for a pipe
+  $^O eq "MSWin32"
+    and skip("pipe() doesn't work on Win32", 3);
+  pipe(my $rfh, my $wfh) or skip("Can't make a pipe: $!", 3);
+  syswrite($wfh, "pipe data");
+  close $wfh;
+  my $io = Imager::IO->new_mmap(fileno($rfh));
+  ok($io, "mmap: make an I/O layer for a pipe");
+  my $buf;
+  is($io->read($buf, 20), 9, "mmap: read from the pipe");
+  is($buf, "pipe data", "mmap: check pipe data");
+  undef $io;
+  close $rfh;
+}
+
+{ # read with mmap
+  my $im = Imager->new(file => "testimg/penguin-base.ppm")
+    or print "# ", Imager->errstr, "\n";
+  my $mim = Imager->new(file => "testimg/penguin-base.ppm", mmap => 1);
+  ok($mim, "read file with mmap")
+    or print "# ", Imager->errstr, "\n";
+  is_image($mim, $im, "check it matches a normal read");
+}
+
+{ # buffer sizes
+  my $io = Imager::io_new_bufchain();
+  is($io->buffer_size, 8192, "bufsize: default size");
+  $io->write("x" x 8192) for 1 .. 20;
+  cmp_ok($io->buffer_size, '>', 8192, "bufsize: grows with sequential writes");
+  ok($io->set_buffer_size(100), "bufsize: set size");
+  is($io->buffer_size, 100, "bufsize: check size");
+  $io->write("y" x 1000) for 1 .. 20;
+  is($io->buffer_size, 100, "bufsize: set size doesn't grow");
+  is($io->close, 0, "bufsize: close");
+  is(Imager::io_slurp($io), ("x" x (8192 * 20)) . ("y" x 20000),
+     "bufsize: check data written");
+  Imager::i_clear_error();
+  ok(!$io->set_buffer_size(0), "bufsize: can't set zero");
+  is(Imager->_error_as_msg, "buffer size must be positive",
+     "bufsize: check message");
+}
+
+{ # shrinking the buffer keeps buffered input
+  my $io = Imager::io_new_buffer("abcdefghij" x 1000);
+  is($io->peekn(5), "abcde", "bufsize: peek to fill the buffer");
+  my $buf;
+  is($io->read($buf, 8187), 8187, "bufsize: read most of the buffer");
+  ok($io->set_buffer_size(16), "bufsize: shrink the buffer");
+  is($io->buffer_size, 16, "bufsize: check size");
+  is($io->read($buf, 20), 20, "bufsize: read across the old buffer end");
+  is($buf, "hijabcdefghijabcdefg", "bufsize: check data read");
+}
+
+SKIP:
+{ # a large file gets a large buffer
+  my $file = "testout/t07bufsize.dat";
+  open my $fh, "> $file" or skip("Cannot create $file: $!", 1);
+  binmode $fh;
+  print $fh "\0" x (1024 * 1024);
+  close $fh;
+  open my $fhr, "< $file" or skip("Cannot open $file: $!", 1);
+  my $io = Imager::io_new_fd(fileno($fhr));
+  $io->peekn(1);
+  cmp_ok($io->buffer_size, '>=', 65536, "bufsize: larger buffer for a large file");
+  undef $io;
+  close $fhr;
+  unlink $file;
+}
+
+{ # io_buffer_size option
+  my $im = Imager->new(xsize => 50, ysize => 30);
+  $im->box(filled => 1, color => "#F80", xmax => 20);
+  my $data;
+  ok($im->write(data => \$data, type => "pnm", io_buffer_size => 100),
+     "io_buffer_size: write");
+  my $im2 = Imager->new(data => $data, io_buffer_size => 64);
+  ok($im2, "io_buffer_size: read");
+  is_image($im2, $im, "io_buffer_size: check image");
+  ok(!$im->write(data => \$data, type => "pnm", io_buffer_size => 0),
+     "io_buffer_size: zero size fails");
+  is($im->errstr, "io_buffer_size must be a positive integer",
+     "io_buffer_size: check message");
+}
+
+{ # writing to a scalar across many bufchain links
+  my $im = Imager->new(xsize => 1000, ysize => 700);
+  $im->box(filled => 1, color => "#08F", xmin => 100, ymin => 50);
+  my $data;
+  ok($im->write(data => \$data, type => "pnm"), "slurp: write to scalar");
+  my $file = "testout/t07slurp.ppm";
+  $im->write(file => $file) or die "Cannot write $file: ", $im->errstr;
+  open my $fh, "< $file" or die "Cannot open $file: $!";
+  binmode $fh;
+  my $file_data = do { local $/; <$fh> };
+  close $fh;
+  ok($data eq $file_data, "slurp: same as writing to a file");
+  unlink $file;
+  my $im2 = Imager->new(data => $data);
+  is_image($im2, $im, "slurp: check image");
+}
+
+{ # read-ahead
+  my $file = "testout/t07async.dat";
+  my $content = join "", map sprintf("%07d\n", $_), 1 .. 20000;
+  open my $fh, "> $file" or die "Cannot create $file: $!";
+  binmode $fh;
+  print $fh $content;
+  close $fh;
+
+  open my $fhr, "< $file" or die "Cannot open $file: $!";
+  binmode $fhr;
+  my $io = Imager::io_new_fd(fileno($fhr));
+  ok($io->set_async(1), "async: enable read-ahead");
+  my $data = "";
+  my $buf;
+  while ($io->read($buf, 1000) > 0) {
+    $data .= $buf;
+  }
+  ok($data eq $content, "async: read everything");
+  ok($io->eof, "async: at eof");
+  is($io->read($buf, 10), 0, "async: still eof");
+  is($io->seek(16, SEEK_SET), 16, "async: seek back");
+  is($io->getc, ord "0", "async: getc after seek");
+  is($io->peekn(7), "000003\n", "async: peekn after seek");
+  is($io->seek(8, SEEK_CUR), 25, "async: relative seek");
+  is($io->read($buf, 7), 7, "async: read after relative seek");
+  is($buf, "000004\n", "async: check data");
+  ok($io->set_async(0), "async: disable read-ahead");
+  is(sysseek($fhr, 0, SEEK_CUR), 25 + $io->buffer_size,
+     "async: fd position excludes read-ahead");
+  undef $io;
+  close $fhr;
+  unlink $file;
+}
+
+{ # write-behind
+  my $file = "testout/t07async.dat";
+  open my $fh, "> $file" or die "Cannot create $file: $!";
+  binmode $fh;
+  my $io = Imager::io_new_fd(fileno($fh));
+  ok($io->set_async(1), "async: enable write-behind");
+  my $expect = "";
+  for my $i (1 .. 2000) {
+    my $line = "line $i\n" x 5;
+    # a write larger than the buffer is written directly, after the
+    # pending write
+    $line .= "big\n" x $io->buffer_size if $i == 1000;
+    $io->write($line);
+    $expect .= $line;
+  }
+  is($io->close, 0, "async: close after writes");
+  undef $io;
+  close $fh;
+  open my $fhr, "< $file" or die "Cannot open $file: $!";
+  binmode $fhr;
+  my $data = do { local $/; <$fhr> };
+  close $fhr;
+  ok($data eq $expect, "async: check data written");
+  unlink $file;
+}
+
+SKIP:
+{ # write-behind errors are reported
+  -c "/dev/full"
+    or skip("No /dev/full", 2);
+  open my $fh, "> /dev/full"
+    or skip("Can't open /dev/full: $!", 2);
+  my $io = Imager::io_new_fd(fileno($fh));
+  $io->set_async(1);
+  $io->write("x" x 1000);
+  Imager::i_clear_error();
+  is($io->close, -1, "async: close reports the write error");
+  like(Imager->_error_as_msg, qr/^write\(\) failure: /, "async: check message");
+}
+
+SKIP:
+{ # no read-ahead from a pipe, which would block with the writer open
+  $^O eq "MSWin32"
+    and skip("pipe() doesn't work on Win32", 6);
+  pipe(my $rfh, my $wfh) or skip("Can't make a pipe: $!", 6);
+  syswrite($wfh, "abcdef");
+  my $io = Imager::io_new_fd(fileno($rfh));
+  # a buffered read would wait to fill the buffer
+  $io->set_buffered(0);
+  ok($io->set_async(1), "async: enable on a pipe");
+  is($io->read(my $buf, 6), 6, "async: read from the pipe");
+  is($buf, "abcdef", "async: check pipe data");
+  syswrite($wfh, "ghi");
+  is($io->read($buf, 3), 3, "async: read more from the pipe");
+  is($buf, "ghi", "async: check more pipe data");
+  is($io->close, 0, "async: close the pipe source");
+  undef $io;
+  close $wfh;
+  close $rfh;
+}
+
+{ # only fd sources
+  my $io = Imager::io_new_bufchain();
+  ok(!$io->set_async(1), "async: not for a bufchain");
+}
+
+{ # io_async option
+  my $im = test_image();
+  my $file = "testout/t07async.ppm";
+  ok($im->write(file => $file, io_async => 1), "async: write an image");
+  my $im2 = Imager->new(file => $file, io_async => 1);
+  ok($im2, "async: read an image")
+    or print "# ", Imager->errstr, "\n";
+  is_image($im2, $im, "async: check image");
+  my $data;
+  ok($im->write(data => \$data, type => "pnm", io_async => 1),
+     "async: ignored for data");
+  unlink $file;
+}
+
+{ # stats
+  my $io = Imager::io_new_buffer("abcdefghij" x 2000);
+  is_deeply([ $io->stats ], [], "stats: none until enabled");
+  $io->set_stats(1);
+  is($io->peekn(4), "abcd", "stats: peekn");
+  my $buf;
+  is($io->read($buf, 100), 100, "stats: read");
+  is($io->seek(0, SEEK_SET), 0, "stats: seek");
+  1 while $io->read($buf, 5000) > 0;
+  my %stats = $io->stats;
+  is($stats{bytes_read}, 8192 + 20000, "stats: bytes read");
+  is($stats{peek_fills}, 1, "stats: peek fills");
+  cmp_ok($stats{fills}, '>=', 2, "stats: fills");
+  cmp_ok($stats{reads}, '>=', 3, "stats: read calls");
+  is($stats{seeks}, 1, "stats: seeks");
+  is($stats{writes}, 0, "stats: no writes");
+  cmp_ok($stats{read_time}, '>=', 0, "stats: read time");
+  $io->set_stats(1);
+  %stats = $io->stats;
+  is($stats{reads}, 0, "stats: reset");
+  $io->set_stats(0);
+  is_deeply([ $io->stats ], [], "stats: disabled");
+  is($io->seek(0, SEEK_SET), 0, "stats: seek after disabling");
+  is($io->read($buf, 3), 3, "stats: read after disabling");
+  is($buf, "abc", "stats: check data");
+
+  my $out = Imager::io_new_bufchain();
+  $out->set_stats(1);
+  $out->write("x" x 10000);
+  $out->close;
+  %stats = $out->stats;
+  is($stats{bytes_written}, 10000, "stats: bytes written");
+}
+
 Imager->close_log;
 
 unless ($ENV{IMAGER_KEEP_FILES}) {
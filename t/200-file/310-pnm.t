@@ -1,6 +1,6 @@
 #!perl -w
 use Imager ':all';
-use Test::More tests => 205;
+use Test::More tests => 214;
 use strict;
 use Imager::Test qw(test_image_raw test_image_16 is_color3 is_color1 is_image test_image_named);
 
@@ -468,6 +468,27 @@ print "# check error handling\n";
   is( $imgs[2]->getheight, 2, " ... width=2" );
 }
 
+{ # selected pages
+  my @imgs = Imager->read_multi(file => 'testimg/multiple.ppm',
+				pages => [ 2, 0, 2 ]);
+  is(@imgs, 2, "read pages 0 and 2");
+  is($imgs[0]->tags(name => 'pnm_type'), 1, "first is page 0");
+  is($imgs[1]->tags(name => 'pnm_type'), 5, "second is page 2");
+  ok(!Imager->read_multi(file => 'testimg/multiple.ppm', pages => [ 1, 3 ]),
+     "page 3 doesn't exist");
+  is(Imager->errstr, "page 3 not found (3 total)", "check message");
+  ok(!Imager->read_multi(file => 'testimg/multiple.ppm', pages => [ -1 ]),
+     "negative page");
+  is(Imager->errstr,
+     "read_multi: pages must be a reference to an array of page numbers",
+     "check message");
+  ok(!Imager->read_multi(file => 'testimg/multiple.ppm', pages => 1),
+     "pages must be an array ref");
+  @imgs = Imager->read_multi(file => 'testimg/penguin-base.ppm',
+			     pages => [ 0 ]);
+  is(@imgs, 1, "page 0 of a single image file");
+}
+
 {
   my $im = Imager->new;
   ok($im->read(file => 'testimg/bad_asc.ppm', type => 'pnm',
@@ -1,6 +1,6 @@
 #!perl -w
 use strict;
-use Test::More tests => 232;
+use Test::More tests => 284;
 
 BEGIN { use_ok(Imager=>':all') }
 use Imager::Test qw(is_image is_color4 is_image_similar);
@@ -217,6 +217,84 @@ SKIP:
 	    "check we set alpha=0 pixels to zero on scaling");
 }
 
+{ # filter kernel qtypes
+  my @kernels = qw(box triangle catmullrom mitchell lanczos2 lanczos3);
+  my $solid = Imager->new(xsize => 30, ysize => 20, channels => 3);
+  $solid->box(filled => 1, color => "#408020");
+  my $im = Imager->new(xsize => 40, ysize => 40, channels => 4);
+  $im->box(filled => 1, color => 'C0C0C0');
+  my $rot = $im->rotate(degrees => -4)
+    or die;
+  for my $qtype (@kernels) {
+    my $down = $solid->scale(xpixels => 13, ypixels => 7, type => "nonprop",
+			     qtype => $qtype);
+    ok($down, "$qtype: scale down")
+      or diag $solid->errstr;
+    my $cmp = Imager->new(xsize => 13, ysize => 7);
+    $cmp->box(filled => 1, color => "#408020");
+    is_image($down, $cmp, "$qtype: solid color stays solid");
+
+    my $up = $solid->scale(scalefactor => 2.5, qtype => $qtype);
+    is($up->getwidth, 75, "$qtype: scale up width");
+    is($up->getheight, 50, "$qtype: scale up height");
+
+    my $same = $rot->scale(scalefactor => 1, qtype => $qtype);
+    is_image($same, $rot, "$qtype: same size is a copy");
+
+    my $sc = $rot->scale(xpixels => 31, qtype => $qtype);
+    my $out = Imager->new(xsize => $sc->getwidth, ysize => $sc->getheight);
+    $out->box(filled => 1, color => 'C0C0C0');
+    my $back = $out->copy;
+    $out->rubthrough(src => $sc);
+    is_image_similar($out, $back, 100, "$qtype: alpha handled");
+  }
+
+  for my $bits (16, "double") {
+    my $deep = $rot->to_rgb16;
+    $bits eq "double" and $deep = $rot->to_rgb_double;
+    my $sc = $deep->scale(scalefactor => 0.6, qtype => "normal");
+    is($sc->bits, $bits, "normal scaling keeps $bits bits");
+  }
+  my $sc = $rot->scale(scalefactor => 0.6, qtype => "lanczos3");
+  is($sc->bits, 8, "8-bit stays 8-bit");
+
+  my $pal = $solid->to_paletted;
+  $sc = $pal->scale(scalefactor => 0.5, qtype => "mitchell");
+  is($sc->type, "direct", "paletted scales to direct");
+
+  ok(!Imager::i_scale_kernel($solid->{IMG}, 10, 10, 6), "bad kernel fails");
+  is(Imager->_error_as_msg, "unknown scaling kernel 6", "check message");
+  ok(!Imager::i_scale_kernel($solid->{IMG}, 0, 10, 1), "bad width fails");
+  is(Imager->_error_as_msg, "image sizes must be positive", "check message");
+}
+
+{ # 8-bit mixing uses fixed point, which should be within 1 of the
+  # floating point implementation
+  my $src = Imager->new(xsize => 301, ysize => 250);
+  $src->filter(type => "gradgen",
+	       xo => [ 0, 150, 300 ],
+	       yo => [ 0, 249, 60 ],
+	       colors => [ qw/red green blue/ ]);
+  $src->filter(type => "noise", amount => 40, subtype => 0);
+  my $srca = $src->convert(matrix => [ [ 1, 0, 0, 0 ], [ 0, 1, 0, 0 ],
+				       [ 0, 0, 1, 0 ], [ 0, 0, 0, 0, 160 ] ]);
+  for my $test ([ "rgb", $src ], [ "rgba", $srca ]) {
+    my ($name, $im) = @$test;
+    for my $size ([ 97, 61 ], [ 150, 250 ], [ 500, 430 ], [ 1, 1 ]) {
+      my $fixed = Imager->new;
+      $fixed->{IMG} = Imager::i_scale_mixing($im->{IMG}, $size->[0],
+					    $size->[1]);
+      my $float = Imager->new;
+      $float->{IMG} = Imager::i_scale_mixing_float($im->{IMG}, $size->[0],
+						  $size->[1]);
+      my $diff = $fixed->difference(other => $float, mindist => 1);
+      my $empty = Imager->new(xsize => $size->[0], ysize => $size->[1],
+			      channels => 4);
+      is_image($diff, $empty, "$name @$size: fixed point within 1 of float");
+    }
+  }
+}
+
 { # scale_calculate
   my $im = Imager->new(xsize => 100, ysize => 120);
   is_deeply([ $im->scale_calculate(scalefactor => 0.5) ],
@@ -1,7 +1,7 @@
 #!perl -w
 use strict;
-use Test::More tests => 10;
-use Imager::Test qw(is_image);
+use Test::More tests => 36;
+use Imager::Test qw(is_image is_color3 test_image test_image_16);
 
 -d "testout" or mkdir "testout";
 
@@ -61,3 +61,85 @@ SKIP: {
   ok($out, "map()");
   is_image($out, $cmp, "test map output");
 }
+
+{ # channels without a map are left alone
+  my $im = Imager->new(xsize => 10, ysize => 10);
+  $im->box(filled => 1, color => [ 200, 100, 50 ]);
+  my @half = map int $_/2, 0 .. 255;
+  ok($im->map(maps => [ \@half, [], \@half ]), "map red and blue");
+  is_deeply([ ($im->getpixel(x => 3, y => 3)->rgba)[0 .. 2] ], [ 100, 100, 25 ],
+	    "green is unchanged");
+}
+
+{ # apply_levels matches the filters applied in turn
+  my @gamma = map int(0.5 + 255 * ($_ / 255) ** 1.4), 0 .. 255;
+  my @chain =
+    (
+     [ contrast => intensity => 1.3 ],
+     [ autolevels => lsat => 0.05, usat => 0.1 ],
+     [ "hardinvert" ],
+     [ postlevels => levels => 12 ],
+    );
+  my $src = test_image();
+  for my $im ($src, $src->convert(preset => "addalpha"),
+	      $src->convert(preset => "gray"), test_image_16()) {
+    my $desc = $im->getchannels . " channels, " . $im->bits . " bits";
+    my $steps = $im->copy;
+    for my $op (@chain) {
+      my ($type, %opts) = @$op;
+      $steps->filter(type => $type, %opts) or die $steps->errstr;
+    }
+    $steps->map(red => \@gamma, blue => \@gamma);
+    my $levels = $im->copy;
+    ok($levels->apply_levels
+       ([ (map { my ($type, %opts) = @$_; { type => $type, %opts } } @chain),
+	  { type => "map", red => \@gamma, blue => \@gamma } ]),
+       "$desc: apply_levels")
+      or diag $levels->errstr;
+    is_image($levels, $steps, "$desc: same as each filter in turn");
+  }
+}
+
+{ # paletted images only have their palette changed
+  my $im = test_image()->to_paletted;
+  my $direct = $im->to_rgb8;
+  my @ops = ({ type => "contrast", intensity => 0.8 }, { type => "hardinvert" });
+  ok($im->apply_levels(\@ops), "apply_levels to a paletted image");
+  is($im->type, "paletted", "still paletted");
+  $direct->apply_levels(\@ops);
+  is_image($im, $direct, "same as a direct image");
+}
+
+{ # a masked paletted image only changes the pixels under the mask
+  my $im = Imager->new(xsize => 20, ysize => 20, type => "paletted");
+  $im->addcolors(colors => [ Imager::Color->new(100, 50, 25) ]);
+  my $masked = $im->masked(left => 0, top => 0, right => 5, bottom => 5);
+  ok($masked->filter(type => "contrast", intensity => 2),
+     "contrast on a masked paletted image");
+  is_color3($im->getpixel(x => 2, y => 2), 200, 100, 50, "inside the mask");
+  is_color3($im->getpixel(x => 10, y => 10), 100, 50, 25,
+	    "outside the mask is unchanged");
+}
+
+{ # nothing to do
+  my $im = test_image();
+  ok($im->apply_levels([ { type => "contrast", intensity => 1 } ]),
+     "identity operation");
+  is_image($im, test_image(), "image is unchanged");
+}
+
+{ # failures
+  my $im = test_image();
+  ok(!$im->apply_levels({ type => "hardinvert" }), "ops must be an array");
+  is($im->errstr, "apply_levels: ops must be an array reference",
+     "check message");
+  ok(!$im->apply_levels([ { type => "blur" } ]), "unknown type");
+  is($im->errstr, "apply_levels: unknown operation type 'blur'",
+     "check message");
+  ok(!$im->apply_levels([ { type => "contrast" } ]), "contrast needs intensity");
+  ok(!$im->apply_levels([ { type => "hardinvert" },
+			  { type => "postlevels", levels => 0 } ]),
+     "bad levels");
+  is($im->errstr, "postlevels levels must be at least 1", "check message");
+  is_image($im, test_image(), "failure leaves the image alone");
+}
@@ -0,0 +1,153 @@
+#!perl -w
+use strict;
+use Test::More tests => 61;
+use Imager;
+use Imager::Pipeline;
+use Imager::Test qw(is_image test_image);
+
+-d "testout" or mkdir "testout";
+
+Imager->open_log(log => "testout/t070pipeline.log");
+
+my $src = test_image();
+my $srca = $src->convert(preset => "addalpha");
+$srca->box(filled => 1, xmin => 20, ymin => 30, xmax => 70, ymax => 60,
+	   color => [ 255, 0, 0, 60 ]);
+
+{ # row scaling matches i_scale_mixing()
+  for my $im ($src, $srca, $src->convert(preset => "gray"),
+	      $srca->convert(preset => "gray")) {
+    my $channels = $im->getchannels;
+    for my $size ([ 37, 29 ], [ 150, 20 ], [ 150, 150 ], [ 231, 317 ]) {
+      my $rows = Imager->new;
+      $rows->{IMG} = Imager::i_scale_mixing_rows($im->{IMG}, $size->[0], $size->[1]);
+      my $scaled = $im->scale(xpixels => $size->[0], ypixels => $size->[1],
+			      type => "nonprop", qtype => "mixing");
+      is_image($rows, $scaled, "rows match i_scale_mixing: $channels channels, @$size");
+    }
+  }
+}
+
+{ # row images are read-only and read in order
+  my $rows = Imager->new;
+  $rows->{IMG} = Imager::i_scale_mixing_rows($src->{IMG}, 50, 50);
+  ok($rows->virtual, "row image is virtual");
+  ok($rows->getpixel(x => 0, y => 10), "read row 10");
+  ok($rows->getpixel(x => 49, y => 10), "read row 10 again");
+  is(Imager::i_img_rows_error($rows->{IMG}), undef, "no error yet");
+  ok(!$rows->getscanline(y => 9), "can't go back to row 9");
+  is(Imager::i_img_rows_error($rows->{IMG}),
+     "row 9 of a row image is no longer available, rows must be read in order",
+     "check error");
+  ok(!$rows->getpixel(x => 0, y => 11), "later rows fail too");
+  ok(!$rows->setpixel(x => 0, y => 20, color => "red"), "can't write");
+}
+
+{ # the row error is the one the reader pushed, not an older one
+  $src->write(data => \my $data, type => "pnm")
+    or die $src->errstr;
+  substr($data, -1000) = "";
+  my $rows = Imager->new;
+  ok($rows->_read_rows(data => $data), "read truncated pnm as rows");
+  Imager::i_push_error(0, "an unrelated error");
+  ok(!$rows->getscanline(y => $rows->getheight - 1),
+     "can't read the truncated row");
+  is(Imager::i_img_rows_error($rows->{IMG}), "short read - file truncated?",
+     "check error");
+}
+
+{ # PNM row reader
+  for my $file (qw(testimg/penguin-base.ppm testimg/pgm.pgm
+		   testimg/imager.pbm)) {
+    my $data = _slurp($file);
+    my $rows = Imager->new;
+    ok($rows->_read_rows(data => $data), "read $file as rows")
+      or diag $rows->errstr;
+    ok($rows->virtual, "$file: rows are read as needed");
+    my $full = Imager->new(data => $data);
+    is_image($rows, $full, "$file: same as normal read");
+  }
+
+  {
+    my $im16 = $src->to_rgb16;
+    $im16->write(data => \my $data, type => "pnm", pnm_write_wide_data => 1)
+      or die $im16->errstr;
+    my $rows = Imager->new;
+    ok($rows->_read_rows(data => $data), "read 16-bit ppm as rows");
+    is($rows->bits, 8, "samples are reduced to 8 bits");
+    is($rows->tags(name => "pnm_maxval"), 65535, "check maxval tag");
+    is_image($rows, $src, "16-bit: same samples as 8-bit source");
+  }
+
+  {
+    my $rows = Imager->new;
+    ok($rows->_read_rows(file => "testimg/maxval_asc.ppm"),
+       "read an ascii ppm");
+    ok(!$rows->virtual, "ascii files are read completely");
+  }
+}
+
+{ # pipeline
+  $src->write(data => \my $data, type => "pnm")
+    or die $src->errstr;
+  my $full = Imager->new(data => $data);
+
+  my $pipe = Imager::Pipeline->new;
+  ok($pipe->read(data => $data), "pipeline: read");
+  ok($pipe->scale(xpixels => 57), "pipeline: scale");
+  ok($pipe->write(data => \my $out, type => "pnm"), "pipeline: write")
+    or diag $pipe->errstr;
+  is_image(Imager->new(data => $out),
+	   $full->scale(xpixels => 57, qtype => "mixing"),
+	   "pipeline result matches scale()");
+  ok(!$pipe->write(data => \my $out2, type => "pnm"), "can't write twice");
+  is($pipe->errstr, "write: a pipeline can only be written once",
+     "check message");
+
+  $pipe = Imager::Pipeline->new;
+  ok($pipe->read(data => $data)
+     && $pipe->scale(xpixels => 80, ypixels => 40, type => "min")
+     && $pipe->scale(scalefactor => 3)
+     && $pipe->write(data => \$out, type => "pnm"),
+     "two scales");
+  is_image(Imager->new(data => $out),
+	   $full->scale(xpixels => 80, ypixels => 40, type => "min",
+			qtype => "mixing")
+	   ->scale(scalefactor => 3, qtype => "mixing"),
+	   "check two scales");
+
+  $pipe = Imager::Pipeline->new;
+  ok(!$pipe->scale(scalefactor => 0.5), "can't scale before reading");
+  is($pipe->errstr, "scale: no image has been read", "check message");
+  ok(!$pipe->write(data => \$out, type => "pnm"),
+     "can't write before reading");
+  ok($pipe->read(data => $data), "read for bad qtype");
+  ok(!$pipe->scale(scalefactor => 0.5, qtype => "normal"),
+     "only mixing scales");
+  ok($pipe->read(data => $data)
+     && $pipe->scale(scalefactor => 0.5), "read, scale for bmp");
+  ok(!$pipe->write(data => \$out, type => "bmp"),
+     "bmp is written bottom up, so fails");
+  like($pipe->errstr, qr/rows must be read in order/, "check message");
+
+  my $short = substr($data, 0, length($data) * 2 / 3);
+  ok($pipe->read(data => $short)
+     && $pipe->scale(scalefactor => 0.5), "read, scale truncated file");
+  ok(!$pipe->write(data => \$out, type => "pnm"), "fail to write it");
+  is($pipe->errstr, "write: short read - file truncated?", "check message");
+}
+
+Imager->close_log;
+
+unless ($ENV{IMAGER_KEEP_FILES}) {
+  unlink "testout/t070pipeline.log";
+}
+
+sub _slurp {
+  my ($file) = @_;
+
+  open my $fh, "<", $file or die "Cannot open $file: $!";
+  binmode $fh;
+  local $/;
+  return scalar <$fh>;
+}
@@ -1,12 +1,12 @@
 #!perl -w
 use strict;
 use Imager qw(:handy);
-use Test::More tests => 122;
+use Test::More tests => 170;
 
 -d "testout" or mkdir "testout";
 
 Imager::init_log("testout/t61filters.log", 1);
-use Imager::Test qw(is_image_similar test_image is_image is_color4 is_fcolor4);
+use Imager::Test qw(is_image_similar test_image is_image is_color3 is_color4 is_fcolor4);
 # meant for testing the filters themselves
 
 my $imbase = test_image();
@@ -55,6 +55,57 @@ test($imbase, {type=>'conv', coef=>[ 0.3, 1, 0.3, ], },
   is_image_similar($work8, $work16, 80000, "8 and 16 bit conv match");
 }
 
+{ # conv2d
+  my $work = $imbase->copy;
+  ok($work->filter(type => "conv2d", coef => [ [ 0, 0, 0 ], [ 0, 1, 0 ], [ 0, 0, 0 ] ]),
+     "conv2d with identity kernel");
+  is_image($work, $imbase, "identity kernel leaves image unchanged");
+
+  my $base16 = $imbase->to_rgb16;
+  my $work16 = $base16->copy;
+  ok($work16->filter(type => "conv2d", coef => [ [ 1 ] ]),
+     "conv2d 16-bit with 1x1 kernel");
+  is_image($work16, $base16, "1x1 kernel leaves 16-bit image unchanged");
+
+  my $full = $imbase->copy;
+  ok($full->filter(type => "conv2d",
+		   coef => [ [ 1, 2, 1 ], [ 2, 4, 2 ], [ 1, 2, 1 ] ]),
+     "conv2d with separable kernel");
+  my $twice = $imbase->copy;
+  ok($twice->filter(type => "conv2d", coef => [ [ 1, 2, 1 ] ]),
+     "horizontal part");
+  ok($twice->filter(type => "conv2d", coef => [ [ 1 ], [ 2 ], [ 1 ] ]),
+     "vertical part");
+  is_image_similar($full, $twice, 20000, "matches the separate passes");
+
+  my $full16 = $base16->copy;
+  ok($full16->filter(type => "conv2d",
+		     coef => [ [ 1, 2, 1 ], [ 2, 4, 2 ], [ 1, 2, 1 ] ]),
+     "conv2d 16-bit with separable kernel");
+  is_image_similar($full, $full16, 10000, "8 and 16 bit conv2d match");
+
+  my $flat = Imager->new(xsize => 20, ysize => 20);
+  $flat->box(filled => 1, color => "#808080");
+  ok($flat->filter(type => "conv2d",
+		   coef => [ [ -1, -1, -1 ], [ -1, 8, -1 ], [ -1, -1, -1 ] ]),
+     "zero sum kernel");
+  is_color3($flat->getpixel(x => 0, y => 0), 0, 0, 0,
+	    "flat image has no edges, even at the edge");
+  is_color3($flat->getpixel(x => 10, y => 10), 0, 0, 0,
+	    "flat image has no edges");
+
+  my $bad = $imbase->copy;
+  ok(!$bad->filter(type => "conv2d", coef => [ [ 1, 2 ], [ 1 ] ]),
+     "ragged kernel");
+  is($bad->errstr, "all kernel rows must be the same length",
+     "check message");
+  ok(!$bad->filter(type => "conv2d", coef => [ 1, 2, 1 ]),
+     "rows not arrays");
+  ok(!$bad->filter(type => "conv2d", coef => []), "empty kernel");
+  is($bad->errstr, "there must be at least one coefficient",
+     "check message");
+}
+
 {
   my $gauss = test($imbase, {type=>'gaussian', stddev=>5 },
 		   'testout/t61_gaussian.ppm');
@@ -65,6 +116,41 @@ test($imbase, {type=>'conv', coef=>[ 0.3, 1, 0.3, ], },
   is_image_similar($gauss, $gauss16, 250000, "8 and 16 gaussian match");
 }
 
+{ # recursive gaussian
+  my $base16 = $imbase->to_rgb16;
+  my $fir = $base16->copy;
+  ok($fir->filter(type => "gaussian", stddev => 10, method => "fir"),
+     "fir gaussian");
+  my $iir = $base16->copy;
+  ok($iir->filter(type => "gaussian", stddev => 10, method => "iir"),
+     "iir gaussian");
+  # the edges are handled differently, so only compare the middle
+  my %crop = ( left => 30, top => 30, right => 120, bottom => 120 );
+  is_image_similar($iir->crop(%crop), $fir->crop(%crop), 270000,
+		   "iir approximates fir");
+
+  my $auto = $base16->copy;
+  ok($auto->filter(type => "gaussian", stddev => 10), "auto gaussian");
+  is_image($auto, $iir, "auto uses iir above the threshold");
+  my $auto_fir = $base16->copy;
+  ok($auto_fir->filter(type => "gaussian", stddev => 10, iir_threshold => 11),
+     "auto gaussian with higher threshold");
+  is_image($auto_fir, $fir, "auto uses fir below the threshold");
+
+  my $huge = $imbase->copy;
+  ok($huge->filter(type => "gaussian", stddev => 5000, method => "iir"),
+     "iir gaussian with a very large stddev");
+
+  my $bad = $imbase->copy;
+  ok(!$bad->filter(type => "gaussian", stddev => 2, method => "foo"),
+     "unknown gaussian method");
+  is($bad->errstr, "method must be one of auto, fir or iir",
+     "check message");
+  ok(!$bad->filter(type => "gaussian", stddev => 0),
+     "gaussian with zero stddev fails");
+  is($bad->errstr, "stddev must be positive", "check message");
+}
+
 
 test($imbase, { type=>'gradgen', dist=>1,
                    xo=>[ 10,  10, 120 ],
@@ -424,6 +510,71 @@ is($name, "test gradient", "check the name matches");
   is_image($diff2, $cmp2, "difference() - check image with mindist 1.1 - large samples");
 }
 
+{ # difference_bounds
+  for my $bits (8, "double") {
+    my $im1 = Imager->new(xsize => 60, ysize => 40, bits => $bits);
+    $im1->box(filled => 1, color => "#0080FF");
+    my $im2 = $im1->copy;
+    is_deeply([ $im1->difference_bounds(other => $im2) ], [ 0, 0, 0, 0 ],
+	      "$bits: no difference");
+    $im2->setpixel(x => 30, y => 5, color => "#0081FF");
+    $im2->setpixel(x => 12, y => 20, color => "#00FFFF");
+    $im2->setpixel(x => 40, y => 33, color => "#0080FE");
+    is_deeply([ $im1->difference_bounds(other => $im2) ], [ 12, 5, 41, 34 ],
+	      "$bits: bounds of all changes");
+    is_deeply([ $im1->difference_bounds(other => $im2, mindist => 1.5) ],
+	      [ 12, 20, 13, 21 ], "$bits: mindist ignores small changes");
+    my $diff = $im1->difference(other => $im2);
+    my ($left, $top, $right, $bottom) = $im1->difference_bounds(other => $im2);
+    my $inside = $diff->crop(left => $left, top => $top,
+			     right => $right, bottom => $bottom);
+    my $full = Imager->new(xsize => 60, ysize => 40, channels => 4);
+    $full->paste(src => $inside, left => $left, top => $top);
+    is_image($full, $diff, "$bits: nothing different outside the bounds");
+  }
+  my $im = Imager->new(xsize => 5, ysize => 5);
+  ok(!$im->difference_bounds(other => $im->convert(preset => "gray")),
+     "channels must match");
+  is($im->errstr, "different number of channels", "check message");
+  ok(!$im->difference_bounds, "other is required");
+}
+
+{ # set_seed
+  ok(Imager->set_seed(11), "set a seed");
+  my @noise;
+  for my $seed (11, 11, 12) {
+    Imager->set_seed($seed);
+    my $im = $imbase->copy;
+    $im->filter(type => "noise", amount => 40, subtype => 1);
+    push @noise, $im;
+  }
+  is_image($noise[1], $noise[0], "same seed, same noise");
+  ok(Imager::i_img_diff($noise[2]{IMG}, $noise[0]{IMG}),
+     "different seed, different noise");
+
+  my @fills;
+  for (1, 2) {
+    Imager->set_seed(5);
+    my $im = $imbase->copy;
+    $im->filter(type => "fountain", xa => 20, ya => 20, xb => 130, yb => 60,
+		super_sample => "random", ssample_param => 4);
+    push @fills, $im;
+  }
+  is_image($fills[1], $fills[0], "random super-sampling is repeatable");
+
+  my @palettes;
+  for (1, 2) {
+    Imager->set_seed(5);
+    push @palettes, [ map [ $_->rgba ],
+		      Imager->make_palette({ make_colors => "addi" }, $imbase) ];
+  }
+  is_deeply($palettes[1], $palettes[0], "addi palette is repeatable");
+
+  ok(!Imager->set_seed, "seed is required");
+  is(Imager->errstr, "set_seed: seed must be a non-negative integer",
+     "check message");
+}
+
 {
   my $empty = Imager->new;
   ok(!$empty->filter(type => "hardinvert"), "can't filter an empty image");
@@ -0,0 +1,145 @@
+#!perl
+use strict;
+use Imager;
+use Imager::Test qw(is_image);
+use Test::More;
+
+# worker threads are started by Imager itself, so this doesn't need
+# threads.pm, just a build with thread support
+Imager->set_threads(2)
+  or plan skip_all => "no worker thread support: " . Imager->errstr;
+Imager->set_threads(1);
+
+plan tests => 61;
+
+is(Imager->get_threads, 1, "back to one thread");
+
+{
+  ok(!Imager->set_threads(0), "can't set 0 threads");
+  like(Imager->errstr, qr/thread count must be from 1 to/, "check message");
+  ok(!Imager->set_threads(257), "can't set 257 threads");
+  ok(!Imager->set_threads(), "count is required");
+  like(Imager->errstr, qr/missing thread count/, "check message");
+  is(Imager->get_threads, 1, "failures leave the count alone");
+}
+
+my $src = Imager->new(xsize => 301, ysize => 250);
+$src->filter(type => "gradgen",
+	     xo => [ 0, 150, 300 ],
+	     yo => [ 0, 249, 60 ],
+	     colors => [ qw/red green blue/ ]);
+$src->filter(type => "noise", amount => 40, subtype => 0);
+my $src16 = $src->to_rgb16;
+my $srca = $src->convert(preset => "addalpha");
+
+my @ops =
+  (
+   [ "gaussian fir", $src,
+     sub { $_[0]->filter(type => "gaussian", stddev => 3, method => "fir") } ],
+   [ "gaussian iir", $src,
+     sub { $_[0]->filter(type => "gaussian", stddev => 10, method => "iir") } ],
+   [ "gaussian 16-bit", $src16,
+     sub { $_[0]->filter(type => "gaussian", stddev => 2) } ],
+   [ "conv", $src,
+     sub { $_[0]->filter(type => "conv", coef => [ 1, 2, 4, 2, 1 ]) } ],
+   [ "conv2d", $src16,
+     sub { $_[0]->filter(type => "conv2d",
+			 coef => [ [ -1, -1, -1 ], [ -1, 9, -1 ], [ -1, -1, -1 ] ]) } ],
+   [ "scale down", $srca,
+     sub { $_[0] = $_[0]->scale(xpixels => 97, ypixels => 61, type => "nonprop",
+				qtype => "mixing") } ],
+   [ "scale up", $src16,
+     sub { $_[0] = $_[0]->scale(xpixels => 500, ypixels => 430, type => "nonprop",
+				qtype => "mixing") } ],
+   [ "scale y only", $src,
+     sub { $_[0] = $_[0]->scale(xpixels => 301, ypixels => 99, type => "nonprop",
+				qtype => "mixing") } ],
+   [ "scale lanczos3", $srca,
+     sub { $_[0] = $_[0]->scale(xpixels => 190, ypixels => 333, type => "nonprop",
+				qtype => "lanczos3") } ],
+   [ "scale mitchell", $src16,
+     sub { $_[0] = $_[0]->scale(scalefactor => 0.4, qtype => "mitchell") } ],
+   [ "convert matrix", $srca,
+     sub { $_[0] = $_[0]->convert(matrix => [ [ 0.2, 0.3, 0.5, 0 ] ]) } ],
+   [ "convert copy", $src16,
+     sub { $_[0] = $_[0]->convert(matrix => [ [ 0, 0, 1 ], [ 1, 0, 0 ], [ 0, 1, 0 ] ]) } ],
+   [ "rotate", $srca,
+     sub { $_[0] = $_[0]->rotate(degrees => 33, back => "#FF0000") } ],
+   [ "palette mediancut", $src,
+     sub { $_[0] = $_[0]->to_paletted(make_colors => "mediancut") } ],
+   [ "palette mediancut 16-bit", $src16,
+     sub { $_[0] = $_[0]->to_paletted(make_colors => "mediancut") } ],
+   [ "palette wu", $srca,
+     sub { $_[0] = $_[0]->to_paletted(make_colors => "wu") } ],
+   [ "apply_levels", $srca,
+     sub { $_[0]->apply_levels([ { type => "autolevels" },
+				 { type => "contrast", intensity => 1.2 },
+				 { type => "hardinvert" } ]) } ],
+   [ "noise", $src16,
+     sub { Imager->set_seed(7);
+	   $_[0]->filter(type => "noise", amount => 30, subtype => 1) } ],
+  );
+
+for my $op (@ops) {
+  my ($name, $im, $code) = @$op;
+
+  Imager->set_threads(1);
+  my $single = $im->copy;
+  $code->($single) or die "$name: ", $single->errstr;
+
+  Imager->set_threads(4);
+  my $multi = $im->copy;
+  $code->($multi) or die "$name: ", $multi->errstr;
+  is_image($multi, $single, "$name: 4 threads match 1 thread");
+
+  Imager->set_threads(3);
+  my $odd = $im->copy;
+  $code->($odd) or die "$name: ", $odd->errstr;
+  is_image($odd, $single, "$name: 3 threads match 1 thread");
+}
+
+{ # histograms over several images
+  my @frames = ($src, $src16->scale(scalefactor => 0.5),
+		$srca->convert(preset => "gray"));
+  for my $mc (qw(mediancut wu)) {
+    Imager->set_threads(1);
+    my @single = map [ $_->rgba ],
+      Imager->make_palette({ make_colors => $mc }, @frames);
+    Imager->set_threads(4);
+    my @multi = map [ $_->rgba ],
+      Imager->make_palette({ make_colors => $mc }, @frames);
+    is_deeply(\@multi, \@single, "$mc: several images, 4 threads match 1 thread");
+  }
+}
+
+{ # translating several images
+  my @frames = ($src, $src16->scale(scalefactor => 0.5),
+		$srca->convert(preset => "gray"), $src->to_paletted,
+		$src->rotate(degrees => 90), $src->flip(dir => "h"));
+  for my $opts ({ translate => "closest" },
+		{ translate => "errdiff", errdiff => "jarvis" },
+		{ translate => "errdiff", lookup_exact => 0 },
+		{ translate => "perturb", perturb => 40 }) {
+    my $name = join ", ", map "$_ $opts->{$_}", sort keys %$opts;
+    Imager->set_threads(1);
+    Imager->set_seed(3);
+    my @single = Imager->to_paletted_multi({ %$opts }, @frames);
+    for my $threads (4, 3) {
+      Imager->set_threads($threads);
+      Imager->set_seed(3);
+      my @multi = Imager->to_paletted_multi({ %$opts }, @frames);
+      is(@multi, @frames, "$name: got all images with $threads threads");
+      is_deeply([ map _rows($_), @multi ], [ map _rows($_), @single ],
+		"$name: $threads threads match 1 thread");
+    }
+  }
+}
+
+Imager->set_threads(1);
+
+sub _rows {
+  my ($im) = @_;
+
+  return join "", map scalar($im->getscanline(y => $_, type => "index")),
+    0 .. $im->getheight - 1;
+}